@@ -0,0 +1,219 @@
+//Headless simulation benchmark: N maps x M dogs ticked K times through PlayerSessionManager, no http.
+//Prints one JSON object to stdout so runs can be tracked over time
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include "../src/application.h"
+#include "../src/json_loader.h"
+#include "../src/work_stealing_pool.h"
+#include "heap_accounting.h"
+#include "synthetic_map.h"
+
+namespace {
+using namespace std::literals;
+namespace json = boost::json;
+using Clock = std::chrono::steady_clock;
+
+struct Args {
+    std::string config_path;
+    size_t sessions   = 4;
+    size_t dogs       = 100;
+    size_t max_dogs   = 0;
+    size_t ticks      = 1000;
+    int64_t tick_ms   = 50;
+    int grid          = 20;
+    size_t move_every = 10;
+    unsigned threads  = 1;
+    uint64_t seed     = 1;
+};
+
+std::optional<Args> ParseCommandLine(int argc, const char* const argv[]) {
+    namespace po = boost::program_options;
+
+    Args args;
+    po::options_description desc{"game_sim_bench options"s};
+    desc.add_options()
+        ("help,h", "Show help")
+        ("config-file,c", po::value(&args.config_path)->value_name("config_path"s), "use maps from a game config instead of generated grids")
+        ("sessions,s", po::value(&args.sessions)->value_name("N"s), "number of maps, one session each unless max-dogs-per-session is set, default: 4")
+        ("dogs,d", po::value(&args.dogs)->value_name("M"s), "dogs per map, default: 100")
+        ("max-dogs-per-session", po::value(&args.max_dogs)->value_name("dogs"s), "split maps into sessions of at most this many dogs, default: no limit")
+        ("ticks,k", po::value(&args.ticks)->value_name("K"s), "ticks to run, default: 1000")
+        ("tick-ms", po::value(&args.tick_ms)->value_name("ms"s), "game time per tick, default: 50")
+        ("grid", po::value(&args.grid)->value_name("roads"s), "roads per side of a generated map, default: 20")
+        ("move-every", po::value(&args.move_every)->value_name("ticks"s), "every dog picks a new direction once per this many ticks on average, default: 10")
+        ("threads,t", po::value(&args.threads)->value_name("num_threads"s), "tick sessions on this many threads, default: 1")
+        ("seed", po::value(&args.seed)->value_name("seed"s), "seed for the game and the move generator, default: 1");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if(vm.contains("help"s)) {
+        std::cout << desc;
+        return std::nullopt;
+    }
+    if(args.sessions == 0 || args.ticks == 0 || args.move_every == 0) {
+        throw std::runtime_error("sessions, ticks and move-every must be positive");
+    }
+    return args;
+}
+
+std::shared_ptr<model::Game> MakeGame(const Args& args) {
+    std::shared_ptr<model::Game> game;
+    if(!args.config_path.empty()) {
+        game = std::make_shared<model::Game>(json_loader::LoadGame(args.config_path));
+    } else {
+        game = std::make_shared<model::Game>();
+        bench::GridMapParams params;
+        params.roads_per_side = args.grid;
+        for(size_t i = 0; i < args.sessions; ++i) {
+            game->AddMap(bench::MakeGridMap("map"s + std::to_string(i), params));
+        }
+        game->ConfigLootGen(model::TimeMs{5000}, 0.5);
+    }
+    game->EnableRandomDogSpawn(true);
+    game->SetRandomSeed(args.seed);
+    if(args.max_dogs) {
+        game->SetMaxDogsPerSession(args.max_dogs);
+    }
+    return game;
+}
+
+double ToNs(std::chrono::nanoseconds time) {
+    return static_cast<double>(time.count());
+}
+
+json::object RunBench(const Args& args) {
+    const auto game = MakeGame(args);
+    const size_t num_maps = std::min(args.sessions, game->GetMaps().size());
+
+    app::PlayerSessionManager psm{game};
+    for(size_t map = 0; map < num_maps; ++map) {
+        const auto& map_id = game->GetMaps()[map].GetId();
+        for(size_t dog = 0; dog < args.dogs; ++dog) {
+            psm.CreatePlayer(map_id, model::Dog::Tag{"dog"s + std::to_string(dog)});
+        }
+    }
+
+    //Ids are kept apart so retired players can be found after they are destroyed
+    std::vector<std::pair<app::Player::Id, app::ConstPlayerPtr>> players;
+    players.reserve(psm.GetAllPlayers().size());
+    for(const auto& [id, player] : psm.GetAllPlayers()) {
+        players.emplace_back(id, &player);
+    }
+    //Same move sequence on every run
+    std::ranges::sort(players);
+
+    std::unique_ptr<util::WorkStealingPool> pool;
+    if(args.threads > 1) {
+        pool = std::make_unique<util::WorkStealingPool>(args.threads);
+    }
+
+    constexpr model::Direction directions[] = {
+        model::Direction::NORTH, model::Direction::EAST, model::Direction::SOUTH, model::Direction::WEST
+    };
+    std::mt19937 move_rng{static_cast<uint32_t>(args.seed)};
+    std::uniform_int_distribution<size_t> pick_player(0, players.empty() ? 0 : players.size() - 1);
+    std::uniform_int_distribution<int> pick_dir(0, 3);
+    const size_t moves_per_tick = std::max<size_t>(1, players.size() / args.move_every);
+
+    app::TickPhaseTimes phases;
+    std::chrono::nanoseconds total_tick_time{0};
+    std::vector<std::chrono::nanoseconds> tick_times;
+    tick_times.reserve(args.ticks);
+    size_t tick_allocations = 0;
+    size_t retired_players = 0;
+    size_t dog_ticks = 0;
+    const size_t num_dogs = players.size();
+
+    const auto start = Clock::now();
+    for(size_t tick = 0; tick < args.ticks; ++tick) {
+        for(size_t i = 0; !players.empty() && i < moves_per_tick; ++i) {
+            players[pick_player(move_rng)].second->SetDirection(directions[pick_dir(move_rng)]);
+        }
+
+        dog_ticks += players.size();
+        const size_t allocations_before = bench::heap.allocations.load(std::memory_order_relaxed);
+        const auto tick_start = Clock::now();
+        const auto retired = psm.AdvanceTime(model::TimeMs{args.tick_ms}, pool.get(), &phases);
+        const auto tick_time = Clock::now() - tick_start;
+        tick_allocations += bench::heap.allocations.load(std::memory_order_relaxed) - allocations_before;
+
+        //Idle dogs leave the game, stop moving their players
+        for(const auto& player : retired) {
+            const auto it = std::ranges::lower_bound(players, player.id, {}, &decltype(players)::value_type::first);
+            players.erase(it);
+        }
+        retired_players += retired.size();
+        if(!retired.empty()) {
+            pick_player = std::uniform_int_distribution<size_t>(0, players.empty() ? 0 : players.size() - 1);
+        }
+
+        total_tick_time += tick_time;
+        tick_times.push_back(tick_time);
+    }
+    const auto wall_time = Clock::now() - start;
+
+    std::ranges::sort(tick_times);
+    auto percentile = [&tick_times](double p) {
+        return ToNs(tick_times[static_cast<size_t>(p * static_cast<double>(tick_times.size() - 1))]);
+    };
+
+    size_t loot_items = 0;
+    for(const auto& [_, session] : psm.GetAllSessions()) {
+        loot_items += session.GetLootCount();
+    }
+
+    const double ticks = static_cast<double>(args.ticks);
+    return {
+        {"maps", num_maps},
+        {"sessions", psm.GetAllSessions().size()},
+        {"dogs", num_dogs},
+        {"ticks", args.ticks},
+        {"tickMs", args.tick_ms},
+        {"threads", std::max(1u, args.threads)},
+        {"seed", args.seed},
+        {"ticksPerSec", ticks / std::chrono::duration<double>(total_tick_time).count()},
+        {"nsPerDogTick", ToNs(total_tick_time) / static_cast<double>(std::max<size_t>(1, dog_ticks))},
+        {"tickNs", {
+            {"mean", ToNs(total_tick_time) / ticks},
+            {"p50", percentile(0.5)},
+            {"p99", percentile(0.99)},
+            {"max", ToNs(tick_times.back())}
+        }},
+        //With threads, phases are summed over sessions and can exceed wall time
+        {"phaseNsPerTick", {
+            {"move", ToNs(phases.move) / ticks},
+            {"collisions", ToNs(phases.collisions) / ticks},
+            {"loot", ToNs(phases.loot) / ticks},
+            {"retirement", ToNs(phases.retirement) / ticks}
+        }},
+        {"allocationsPerTick", static_cast<double>(tick_allocations) / ticks},
+        {"lootItemsAtEnd", loot_items},
+        {"retiredPlayers", retired_players},
+        {"wallTimeMs", std::chrono::duration<double, std::milli>(wall_time).count()},
+        {"peakRssKb", util::PeakRssKb()}
+    };
+}
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    try {
+        const auto args = ParseCommandLine(argc, argv);
+        if(!args) {
+            return EXIT_SUCCESS;
+        }
+        std::cout << json::serialize(RunBench(*args)) << std::endl;
+    } catch(const std::exception& ex) {
+        std::cerr << "game_sim_bench: " << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,70 @@
+#pragma once
+//Replaces the global operator new/delete to count allocations and live heap bytes.
+//The replacements can't be inline, so include this once per executable, from the file with main()
+#include <malloc.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace bench {
+
+struct HeapCounters {
+    std::atomic<size_t> allocations{0};
+    std::atomic<size_t> bytes{0};
+    std::atomic<size_t> peak{0};
+};
+
+inline HeapCounters heap;
+
+inline void* CountAllocated(void* ptr) {
+    heap.allocations.fetch_add(1, std::memory_order_relaxed);
+    const size_t bytes = malloc_usable_size(ptr);
+    const size_t now = heap.bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    size_t peak = heap.peak.load(std::memory_order_relaxed);
+    while(now > peak && !heap.peak.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {
+    }
+    return ptr;
+}
+
+inline void CountFreed(void* ptr) {
+    if(ptr) {
+        heap.bytes.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+        std::free(ptr);
+    }
+}
+
+} // namespace bench
+
+void* operator new(size_t size) {
+    if(void* ptr = std::malloc(size ? size : 1)) {
+        return bench::CountAllocated(ptr);
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t align) {
+    const auto alignment = static_cast<size_t>(align);
+    //aligned_alloc wants a multiple of the alignment
+    if(void* ptr = std::aligned_alloc(alignment, (std::max(size, size_t{1}) + alignment - 1) / alignment * alignment)) {
+        return bench::CountAllocated(ptr);
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    bench::CountFreed(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    bench::CountFreed(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    bench::CountFreed(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    bench::CountFreed(ptr);
+}
@@ -0,0 +1,200 @@
+//Microbenchmarks of model building blocks. Not part of the unit tests, run with:
+//  ctest -C Benchmark -L benchmark   or   model_benchmarks "[benchmark]"
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <boost/asio/io_context.hpp>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/application.h"
+#include "../src/collision_detector.h"
+#include "../src/json_loader.h"
+#include "../src/loot_generator.h"
+#include "../src/model.h"
+#include "synthetic_map.h"
+
+using namespace std::literals;
+
+namespace {
+constexpr uint32_t SEED = 42;
+
+std::string Name(std::string_view what, size_t size) {
+    return std::string(what) + " ("s + std::to_string(size) + ")"s;
+}
+
+std::shared_ptr<model::Game> MakeGridGame(int roads_per_side) {
+    auto game = std::make_shared<model::Game>();
+    bench::GridMapParams params;
+    params.roads_per_side = roads_per_side;
+    game->AddMap(bench::MakeGridMap("grid"s, params));
+    game->EnableRandomDogSpawn(true);
+    game->SetRandomSeed(SEED);
+    return game;
+}
+
+//Random points on the map roads, precomputed so benchmarks only time the call itself
+std::vector<geom::Point2D> RoadPoints(const model::Map& map, size_t count) {
+    model::RandomEngine rng{SEED};
+    std::vector<geom::Point2D> points;
+    points.reserve(count);
+    for(size_t i = 0; i < count; ++i) {
+        points.push_back(map.GetRandomRoadPt(rng));
+    }
+    return points;
+}
+
+class VectorProvider final : public collision_detector::ItemGathererProvider {
+public:
+    VectorProvider(size_t items, size_t gatherers, double area) {
+        std::mt19937 rng{SEED};
+        std::uniform_real_distribution<double> coord(0.0, area);
+        for(size_t i = 0; i < items; ++i) {
+            items_.push_back({{coord(rng), coord(rng)}, 0.5});
+        }
+        for(size_t i = 0; i < gatherers; ++i) {
+            const geom::Point2D start{coord(rng), coord(rng)};
+            gatherers_.push_back({start, {start.x + 2.0, start.y}, 0.6});
+        }
+    }
+
+    size_t ItemsCount() const override { return items_.size(); }
+    collision_detector::Item GetItem(size_t idx) const override { return items_[idx]; }
+    size_t GatherersCount() const override { return gatherers_.size(); }
+    collision_detector::Gatherer GetGatherer(size_t idx) const override { return gatherers_[idx]; }
+
+private:
+    std::vector<collision_detector::Item> items_;
+    std::vector<collision_detector::Gatherer> gatherers_;
+};
+} // namespace
+
+TEST_CASE("Road lookup and movement", "[benchmark][Map]") {
+    const int roads_per_side = GENERATE(10, 100, 500);
+    const auto game = MakeGridGame(roads_per_side);
+    const auto& map = *game->GetMap(0);
+    const auto points = RoadPoints(map, 1024);
+    const auto roads = static_cast<size_t>(roads_per_side) * 2;
+
+    BENCHMARK(Name("FindVertRoad", roads)) {
+        size_t found = 0;
+        for(const auto& pt : points) {
+            found += map.FindVertRoad(pt) != nullptr;
+        }
+        return found;
+    };
+
+    BENCHMARK(Name("FindHorRoad", roads)) {
+        size_t found = 0;
+        for(const auto& pt : points) {
+            found += map.FindHorRoad(pt) != nullptr;
+        }
+        return found;
+    };
+
+    BENCHMARK(Name("ComputeRoadMove", roads)) {
+        double sum = 0;
+        for(const auto& pt : points) {
+            sum += map.ComputeRoadMove(pt, {pt.x + 25.0, pt.y}).dst.x;
+        }
+        return sum;
+    };
+
+    BENCHMARK(Name("ComputeRoadMove through junctions", roads)) {
+        double sum = 0;
+        for(const auto& pt : points) {
+            sum += map.ComputeRoadMove(pt, {pt.x, pt.y + 25.0}, true).dst.y;
+        }
+        return sum;
+    };
+
+    BENCHMARK_ADVANCED(Name("GetRandomRoadPt", roads))(Catch::Benchmark::Chronometer meter) {
+        model::RandomEngine rng{SEED};
+        meter.measure([&] {
+            return map.GetRandomRoadPt(rng);
+        });
+    };
+}
+
+TEST_CASE("Collision detection", "[benchmark][Collisions]") {
+    const size_t size = GENERATE(10, 100, 1000);
+
+    BENCHMARK("TryCollectPoint") {
+        return collision_detector::TryCollectPoint({0.0, 0.0}, {10.0, 0.0}, {5.0, 0.3});
+    };
+
+    const VectorProvider provider{size, size, 100.0};
+    BENCHMARK(Name("FindGatherEvents items = gatherers", size)) {
+        return collision_detector::FindGatherEvents(provider);
+    };
+}
+
+TEST_CASE("Loot generation", "[benchmark][LootGenerator]") {
+    loot_gen::LootGenerator generator{model::TimeMs{5000}, 0.5};
+
+    BENCHMARK("LootGenerator::Generate") {
+        return generator.Generate(model::TimeMs{50}, 10, 100);
+    };
+}
+
+TEST_CASE("Players and tokens", "[benchmark][PlayerSessionManager]") {
+    const size_t players = GENERATE(100, 10000);
+    const auto game = MakeGridGame(10);
+    const auto& map_id = game->GetMap(0)->GetId();
+
+    BENCHMARK_ADVANCED(Name("CreatePlayer (token generation)", players))(Catch::Benchmark::Chronometer meter) {
+        app::PlayerSessionManager psm{game};
+        for(size_t i = 0; i < players; ++i) {
+            psm.CreatePlayer(map_id, model::Dog::Tag{"dog"s});
+        }
+        meter.measure([&] {
+            return psm.CreatePlayer(map_id, model::Dog::Tag{"dog"s});
+        });
+    };
+
+    app::PlayerSessionManager psm{game};
+    std::vector<app::Token> tokens;
+    tokens.reserve(players);
+    for(size_t i = 0; i < players; ++i) {
+        tokens.push_back(*psm.GetToken(psm.CreatePlayer(map_id, model::Dog::Tag{"dog"s})));
+    }
+
+    BENCHMARK(Name("GetPlayerByToken", players)) {
+        size_t found = 0;
+        for(const auto& token : tokens) {
+            found += psm.GetPlayerByToken(token) != nullptr;
+        }
+        return found;
+    };
+
+    const auto hex = tokens.front().ToHex();
+    BENCHMARK("Token::FromHex") {
+        return app::Token::FromHex(hex);
+    };
+}
+
+TEST_CASE("Game state json", "[benchmark][json]") {
+    const size_t dogs = GENERATE(10, 100, 1000);
+    const auto game = MakeGridGame(20);
+    game->ConfigLootGen(model::TimeMs{1000}, 1.0);
+
+    boost::asio::io_context io;
+    auto game_app = std::make_shared<app::GameInterface>(io, game, nullptr);
+    app::ConstPlayerPtr player = nullptr;
+    for(size_t i = 0; i < dogs; ++i) {
+        const auto result = game_app->JoinGame("grid"s, "dog"s + std::to_string(i));
+        player = game_app->FindPlayerByToken(*result.token);
+    }
+    //Let some loot appear
+    game_app->AdvanceGameTime(model::TimeMs{10000});
+
+    BENCHMARK(Name("PrintGameState dogs", dogs)) {
+        return json_loader::PrintGameState(player, game_app);
+    };
+    BENCHMARK(Name("PrintGameState viewRadius 10 dogs", dogs)) {
+        return json_loader::PrintGameState(player, game_app, 10.0);
+    };
+}
@@ -0,0 +1,262 @@
+//State save and restore benchmark: a synthetic PlayerSessionManager of the given size goes through
+//SaveGameState and Restore once per snapshot format. Prints one JSON object to stdout so runs can be tracked over time
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/program_options.hpp>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "../src/application.h"
+#include "../src/state_serialization.h"
+#include "heap_accounting.h"
+#include "synthetic_map.h"
+
+namespace {
+using namespace std::literals;
+namespace fs = std::filesystem;
+namespace json = boost::json;
+using Clock = std::chrono::steady_clock;
+
+struct Args {
+    size_t sessions     = 4;
+    size_t dogs         = 1000;
+    size_t loot         = 200;
+    size_t bag_capacity = 3;
+    double bag_fill     = 0.5;
+    size_t runs         = 3;
+    int grid            = 20;
+    uint64_t seed       = 1;
+    std::string dir;
+};
+
+std::optional<Args> ParseCommandLine(int argc, const char* const argv[]) {
+    namespace po = boost::program_options;
+
+    Args args;
+    po::options_description desc{"state_save_bench options"s};
+    desc.add_options()
+        ("help,h", "Show help")
+        ("sessions,s", po::value(&args.sessions)->value_name("N"s), "number of maps, one session each, default: 4")
+        ("dogs,d", po::value(&args.dogs)->value_name("M"s), "dogs per session, default: 1000")
+        ("loot,l", po::value(&args.loot)->value_name("items"s), "loot items lying on the roads of each session, default: 200")
+        ("bag-capacity", po::value(&args.bag_capacity)->value_name("items"s), "bag capacity of every dog, default: 3")
+        ("bag-fill", po::value(&args.bag_fill)->value_name("share"s), "share of every bag filled with loot, 0 to 1, default: 0.5")
+        ("runs,r", po::value(&args.runs)->value_name("runs"s), "saves and restores per format, the fastest is reported, default: 3")
+        ("grid", po::value(&args.grid)->value_name("roads"s), "roads per side of a generated map, default: 20")
+        ("seed", po::value(&args.seed)->value_name("seed"s), "seed for the game, default: 1")
+        ("dir", po::value(&args.dir)->value_name("dir"s), "where the save files go, default: a directory in the system temp");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if(vm.contains("help"s)) {
+        std::cout << desc;
+        return std::nullopt;
+    }
+    if(args.sessions == 0 || args.runs == 0 || args.bag_fill < 0 || args.bag_fill > 1) {
+        throw std::runtime_error("sessions and runs must be positive, bag-fill within [0, 1]");
+    }
+    if(args.dir.empty()) {
+        args.dir = (fs::temp_directory_path() / ("state_save_bench_"s + std::to_string(::getpid()))).string();
+    }
+    return args;
+}
+
+struct StateSize {
+    size_t players = 0;
+    size_t loot_items = 0;
+    size_t bag_items = 0;
+
+    //Dogs come with their players
+    size_t GetObjects() const {
+        return players + loot_items + bag_items;
+    }
+};
+
+std::shared_ptr<model::Game> MakeGame(const Args& args) {
+    auto game = std::make_shared<model::Game>();
+    bench::GridMapParams params;
+    params.roads_per_side = args.grid;
+    for(size_t i = 0; i < args.sessions; ++i) {
+        game->AddMap(bench::MakeGridMap("map"s + std::to_string(i), params));
+    }
+    game->ConfigLootGen(model::TimeMs{5000}, 0.5);
+    game->EnableRandomDogSpawn(true);
+    game->SetRandomSeed(args.seed);
+    game->ModifyDefaultBagCapacity(args.bag_capacity);
+    return game;
+}
+
+StateSize FillState(const Args& args, app::PlayerSessionManager& psm) {
+    StateSize size;
+    const auto bag_items = static_cast<size_t>(std::lround(args.bag_fill * static_cast<double>(args.bag_capacity)));
+    model::GameObject::Id next_bag_item = 0;
+    for(const auto& map : psm.GetGame()->GetMaps()) {
+        app::SessionPtr session = nullptr;
+        for(size_t dog = 0; dog < args.dogs; ++dog) {
+            const auto player = psm.CreatePlayer(map.GetId(), model::Dog::Tag{"dog"s + std::to_string(dog)});
+            session = player->GetSession();
+            for(size_t item = 0; item < bag_items; ++item) {
+                size.bag_items += player->GetDog()->TryCollectItem(model::LootItemInfo{next_bag_item++, 0, 10, true});
+            }
+            ++size.players;
+        }
+        if(session) {
+            session->AddRandomLootItems(args.loot);
+            size.loot_items += session->GetLootCount();
+        }
+    }
+    return size;
+}
+
+double ToMs(std::chrono::nanoseconds time) {
+    return std::chrono::duration<double, std::milli>(time).count();
+}
+
+//Heap grown above what was live when it started, peak over the call
+template <typename Fn>
+std::pair<std::chrono::nanoseconds, size_t> Measure(Fn&& fn) {
+    const size_t base = bench::heap.bytes.load(std::memory_order_relaxed);
+    bench::heap.peak.store(base, std::memory_order_relaxed);
+    const auto start = Clock::now();
+    fn();
+    const auto time = Clock::now() - start;
+    return {time, bench::heap.peak.load(std::memory_order_relaxed) - base};
+}
+
+enum class Format {
+    TEXT,
+    BINARY,
+    DEFLATE,
+};
+
+std::string_view FormatName(Format format) {
+    switch(format) {
+        case Format::TEXT:
+            return "text"sv;
+        case Format::BINARY:
+            return "binary"sv;
+        case Format::DEFLATE:
+            return "binaryDeflate"sv;
+    }
+    return {};
+}
+
+//Text archives are what servers before the binary snapshot wrote, Restore still reads them
+void SaveText(const fs::path& path, const app::PlayerSessionManager& psm) {
+    std::ofstream out{path, std::ios_base::trunc};
+    boost::archive::text_oarchive archive{out};
+    archive << serialization::PsmRepr{psm};
+}
+
+json::object RunFormat(const Args& args, Format format, const app::PlayerSessionManager& psm, const StateSize& size) {
+    const fs::path dir = fs::path{args.dir} / FormatName(format);
+    fs::remove_all(dir);
+    const fs::path save_file = dir / "state";
+    serialization::StateSerializer serializer{save_file, false, 0,
+                                              serialization::SnapshotOptions{.compress = format == Format::DEFLATE}};
+    if(format == Format::TEXT) {
+        fs::create_directories(dir);
+    }
+
+    std::chrono::nanoseconds save_time = std::chrono::nanoseconds::max();
+    std::chrono::nanoseconds restore_time = std::chrono::nanoseconds::max();
+    size_t save_heap = 0;
+    size_t restore_heap = 0;
+    size_t restored_players = 0;
+    for(size_t run = 0; run < args.runs; ++run) {
+        const auto [save, save_peak] = Measure([&] {
+            if(format == Format::TEXT) {
+                SaveText(save_file, psm);
+            } else {
+                serializer.SaveGameState(psm);
+            }
+        });
+        save_time = std::min(save_time, save);
+        save_heap = std::max(save_heap, save_peak);
+
+        const auto [restore, restore_peak] = Measure([&] {
+            restored_players = serializer.Restore(psm.GetGame()).GetAllPlayers().size();
+        });
+        restore_time = std::min(restore_time, restore);
+        restore_heap = std::max(restore_heap, restore_peak);
+    }
+    if(restored_players != size.players) {
+        throw std::runtime_error("restored "s + std::to_string(restored_players) + " players of "s
+                                 + std::to_string(size.players));
+    }
+
+    const auto file_bytes = fs::file_size(save_file);
+    const double megabytes = static_cast<double>(file_bytes) / (1 << 20);
+    const double objects = static_cast<double>(size.GetObjects());
+    const double save_sec = std::chrono::duration<double>(save_time).count();
+    const double restore_sec = std::chrono::duration<double>(restore_time).count();
+    fs::remove_all(dir);
+
+    return {
+        {"format", FormatName(format)},
+        {"fileBytes", file_bytes},
+        //Binary saves include fsync and rename, text ones are written the way they used to be, unsynced
+        {"saveMs", ToMs(save_time)},
+        {"saveMBPerSec", megabytes / save_sec},
+        {"saveObjectsPerSec", objects / save_sec},
+        {"saveHeapPeakBytes", save_heap},
+        {"restoreMs", ToMs(restore_time)},
+        {"restoreMBPerSec", megabytes / restore_sec},
+        {"restoreObjectsPerSec", objects / restore_sec},
+        {"restoreHeapPeakBytes", restore_heap}
+    };
+}
+
+json::object RunBench(const Args& args) {
+    app::PlayerSessionManager psm{MakeGame(args)};
+    const auto size = FillState(args, psm);
+
+    //What a background save costs the tick, the same for every format
+    std::chrono::nanoseconds capture_time = std::chrono::nanoseconds::max();
+    for(size_t run = 0; run < args.runs; ++run) {
+        capture_time = std::min(capture_time, Measure([&] {
+            serialization::StateCapture state{psm};
+        }).first);
+    }
+
+    json::array formats;
+    for(const auto format : {Format::TEXT, Format::BINARY, Format::DEFLATE}) {
+        formats.push_back(RunFormat(args, format, psm, size));
+    }
+    fs::remove_all(args.dir);
+
+    return {
+        {"sessions", psm.GetAllSessions().size()},
+        {"players", size.players},
+        {"lootItems", size.loot_items},
+        {"bagItems", size.bag_items},
+        {"objects", size.GetObjects()},
+        {"runs", args.runs},
+        {"captureMs", ToMs(capture_time)},
+        {"formats", std::move(formats)},
+        {"peakRssKb", util::PeakRssKb()}
+    };
+}
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    try {
+        const auto args = ParseCommandLine(argc, argv);
+        if(!args) {
+            return EXIT_SUCCESS;
+        }
+        std::cout << json::serialize(RunBench(*args)) << std::endl;
+    } catch(const std::exception& ex) {
+        std::cerr << "state_save_bench: " << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <algorithm>
+#include <string>
+
+#include <boost/json.hpp>
+
+#include "../src/model.h"
+
+namespace bench {
+using namespace std::literals;
+
+struct GridMapParams {
+    //Horizontal and vertical roads each
+    int roads_per_side = 20;
+    int cell_size = 10;
+    int offices = 4;
+    int loot_types = 3;
+};
+
+//Square grid of full-length roads with offices spread along the diagonal.
+//Not compiled, Game::AddMap does that
+inline model::Map MakeGridMap(const std::string& id, const GridMapParams& params) {
+    using model::Point;
+    using model::Road;
+
+    model::Map map{model::Map::Id{id}, id};
+    const int side = (params.roads_per_side - 1) * params.cell_size;
+    for(int i = 0; i < params.roads_per_side; ++i) {
+        const int pos = i * params.cell_size;
+        map.AddRoad({Road::HORIZONTAL, Point{0, pos}, side});
+        map.AddRoad({Road::VERTICAL, Point{pos, 0}, side});
+    }
+
+    for(int i = 0; i < params.offices; ++i) {
+        const int pos = (i * params.roads_per_side / std::max(1, params.offices)) * params.cell_size;
+        map.AddOffice({model::Office::Id{"o"s + std::to_string(i)}, Point{pos, pos}, model::Offset{0, 0}});
+    }
+
+    boost::json::array loot_types;
+    for(int i = 0; i < params.loot_types; ++i) {
+        loot_types.push_back(boost::json::object{{"name", "loot"s + std::to_string(i)}, {"value", 10 * (i + 1)}});
+    }
+    map.AddLootInfo(std::move(loot_types));
+    return map;
+}
+
+} // namespace bench
@@ -0,0 +1,60 @@
+#include "alias_table.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace util {
+
+AliasTable::AliasTable(std::span<const double> weights)
+    : prob_(weights.size(), 1.0)
+    , alias_(weights.size()) {
+    if(weights.empty()) {
+        return;
+    }
+
+    std::vector<double> scaled(weights.size());
+    std::ranges::transform(weights, scaled.begin(), [](double w) {
+        return std::max(w, 0.0);
+    });
+    const double total = std::accumulate(scaled.begin(), scaled.end(), 0.0);
+    if(total <= 0.0) {
+        std::iota(alias_.begin(), alias_.end(), size_t{0});
+        return;
+    }
+
+    //Scale so that the average column is exactly 1
+    const double scale = static_cast<double>(weights.size()) / total;
+    std::vector<size_t> small, large;
+    for(size_t i = 0; i < scaled.size(); ++i) {
+        scaled[i] *= scale;
+        (scaled[i] < 1.0 ? small : large).push_back(i);
+    }
+
+    //Fill every under-full column with the rest from an over-full one
+    while(!small.empty() && !large.empty()) {
+        const size_t s = small.back();
+        small.pop_back();
+        const size_t l = large.back();
+
+        prob_[s] = scaled[s];
+        alias_[s] = l;
+
+        scaled[l] -= 1.0 - scaled[s];
+        if(scaled[l] < 1.0) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+
+    //Whatever is left is full up to rounding errors
+    for(size_t i : small) {
+        prob_[i] = 1.0;
+        alias_[i] = i;
+    }
+    for(size_t i : large) {
+        prob_[i] = 1.0;
+        alias_[i] = i;
+    }
+}
+
+} // namespace util
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <random>
+#include <span>
+#include <vector>
+
+namespace util {
+
+//Walker's alias table: picks index i with probability weights[i] / sum(weights) in O(1).
+//Built once, read-only afterwards.
+class AliasTable {
+public:
+    AliasTable() = default;
+    //Negative weights count as zero. If all weights are zero, every index is equally likely
+    explicit AliasTable(std::span<const double> weights);
+
+    size_t Size() const { return prob_.size(); }
+    bool Empty() const { return prob_.empty(); }
+
+    //Table must not be empty
+    template<typename Rng>
+    size_t Sample(Rng& rng) const;
+
+private:
+    //Chance to keep the column, otherwise its alias is picked
+    std::vector<double> prob_;
+    std::vector<size_t> alias_;
+};
+
+template<typename Rng>
+size_t AliasTable::Sample(Rng& rng) const {
+    std::uniform_int_distribution<size_t> column_distr(0, prob_.size() - 1);
+    std::uniform_real_distribution<double> coin_distr(0.0, 1.0);
+
+    const size_t column = column_distr(rng);
+    return coin_distr(rng) < prob_[column] ? column : alias_[column];
+}
+
+} // namespace util
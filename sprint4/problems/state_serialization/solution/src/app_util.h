@@ -5,6 +5,8 @@
 #include <filesystem>
 #include <random>
 
+#include <sys/resource.h>
+
 //DEBUG
 #ifdef DEBUG
 #include <iostream>
@@ -131,4 +133,16 @@ inline std::chrono::milliseconds ConvertSecToMsec(double seconds) {
     return std::chrono::milliseconds(static_cast<uint64_t>(seconds * 1000));
 }
 
+inline double ConvertMsecToSec(std::chrono::milliseconds msec) {
+    return static_cast<double>(msec.count()) / 1000.0;
+}
+
+//Peak resident set size of the process so far
+inline size_t PeakRssKb() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    //Kilobytes on linux
+    return static_cast<size_t>(usage.ru_maxrss);
+}
+
 }  // namespace util
@@ -3,10 +3,12 @@
 //
 
 #include <algorithm>
-#include <iomanip>
-#include <sstream>
 
 #include "application.h"
+#include "input_log.h"
+#include "leaderboard.h"
+#include "records_writer.h"
+#include "server_logger.h"
 //DEBUG
 #include <iostream>
 
@@ -15,23 +17,33 @@ app::Token GenerateToken() {
     thread_local static std::mt19937_64 gen1(std::random_device{}());
     thread_local static std::mt19937_64 gen2(std::random_device{}());
 
-    using int64_num_t = std::mt19937_64::result_type;
-    std::uniform_int_distribution<int64_num_t> dist(0, std::numeric_limits<int64_num_t>::max());
-
-    std::stringstream ss;
-
-    ss << std::hex << std::setfill('0') << std::setw(16) << dist(gen1);
-    ss << std::hex << std::setfill('0') << std::setw(16) << dist(gen2);
+    return app::Token{gen1(), gen2()};
+}
 
-    return app::Token{std::move(ss.str())};
+model::RandomEngine MakeSessionRng(const std::optional<uint64_t>& seed, size_t session_id) {
+    if (!seed) {
+        return model::RandomEngine{std::random_device{}()};
+    }
+    //Sessions on one seed still get different streams
+    std::seed_seq seq{
+        static_cast<uint32_t>(*seed), static_cast<uint32_t>(*seed >> 32), static_cast<uint32_t>(session_id)
+    };
+    return model::RandomEngine{seq};
+}
+
+template<typename Fn>
+void TimePhase(std::chrono::nanoseconds* total, Fn&& fn) {
+    if (!total) {
+        fn();
+        return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    *total += std::chrono::steady_clock::now() - start;
 }
 }
 
 namespace app {
-size_t TokenHasher::operator()(const Token& token) const {
-    auto str_hasher = std::hash<std::string>();
-    return str_hasher(*token);
-}
 
 //=================================================
 //=================== Session =====================
@@ -39,7 +51,10 @@ Session::Session(size_t id, MapPtr map, gamedata::Settings settings)
     : id_(id)
     , map_(map)
     , settings_(std::move(settings))
-    , loot_generator_(settings_.loot_gen_interval, settings_.loot_gen_prob) {
+    , loot_generator_(settings_.loot_gen_interval, settings_.loot_gen_prob)
+    , rng_(MakeSessionRng(settings_.random_seed, id))
+    , roster_grid_(map ? map->GetViewRadius().value_or(DEFAULT_GRID_CELL) : DEFAULT_GRID_CELL)
+    , loot_grid_(map ? map->GetViewRadius().value_or(DEFAULT_GRID_CELL) : DEFAULT_GRID_CELL) {
 
     if (!map) {
         throw std::runtime_error("map nullptr passed to Session constructor");
@@ -63,10 +78,26 @@ model::TimeMs Session::GetTime() const {
     return session_time_;
 }
 
+void Session::SetTime(model::TimeMs time) {
+    session_time_ = time;
+}
+
+void Session::Reserve(size_t num_dogs, size_t num_loot_items) {
+    dogs_.reserve(num_dogs);
+    gatherers_.reserve(num_dogs);
+    gatherer_pos_.Reserve(num_dogs);
+    roster_.reserve(num_dogs);
+    loot_items_.Reserve(num_loot_items);
+}
+
 const Map::Id &Session::GetMapId() const {
     return map_->GetId();
 }
 
+Map::Index Session::GetMapIndex() const {
+    return map_->GetIndex();
+}
+
 size_t Session::GetDogCount() const {
     return dogs_.size();
 }
@@ -101,6 +132,71 @@ const Session::LootItems &Session::GetLootItems() const {
     return loot_items_;
 }
 
+std::span<const Player* const> Session::GetRoster() const {
+    return roster_;
+}
+
+std::span<const DogPtr> Session::GetGatherers() const {
+    return gatherers_;
+}
+
+Session::GeneratorState Session::GetGeneratorState() const {
+    return {rng_, next_object_id_, loot_generator_.GetTimeWithoutLoot()};
+}
+
+void Session::SetGeneratorState(const GeneratorState& state) {
+    rng_ = state.rng;
+    next_object_id_ = state.next_object_id;
+    loot_generator_.SetTimeWithoutLoot(state.time_without_loot);
+}
+
+Session::VisibleObjects Session::FindVisible(const Player& viewer, double radius) const {
+    if (!spatial_index_valid_) {
+        roster_grid_.Build(roster_.size(), [this](size_t idx) {
+            return roster_[idx]->GetDog()->GetPos();
+        });
+        loot_grid_.Build(loot_items_.size(), [this](size_t idx) {
+            return loot_items_[idx].GetPos();
+        });
+        spatial_index_valid_ = true;
+    }
+
+    const auto center = viewer.GetDog()->GetPos();
+    VisibleObjects result;
+    roster_grid_.ForEachInRadius(center, radius, [&](size_t idx) {
+        result.players.push_back(roster_[idx]);
+    });
+    loot_grid_.ForEachInRadius(center, radius, [&](size_t idx) {
+        result.loot.push_back(idx);
+    });
+    //A radius below zero finds nobody, not even the viewer
+    if (std::ranges::find(result.players, &viewer) == result.players.end()) {
+        result.players.push_back(&viewer);
+    }
+    //Same order as the full state
+    std::ranges::sort(result.players, {}, &Player::GetId);
+    std::ranges::sort(result.loot);
+    return result;
+}
+
+void Session::AddToRoster(const Player* player) {
+    spatial_index_valid_ = false;
+    auto it = std::ranges::lower_bound(roster_, player->GetId(), {}, &Player::GetId);
+    if (it != roster_.end() && (*it)->GetId() == player->GetId()) {
+        *it = player;
+        return;
+    }
+    roster_.insert(it, player);
+}
+
+void Session::RemoveFromRoster(size_t player_id) {
+    spatial_index_valid_ = false;
+    auto it = std::ranges::lower_bound(roster_, player_id, {}, &Player::GetId);
+    if (it != roster_.end() && (*it)->GetId() == player_id) {
+        roster_.erase(it);
+    }
+}
+
 DogPtr Session::AddDog(Dog dog) {
     auto dog_id                      = dog.GetId();
     const auto [dog_map_it, success] = dogs_.emplace(dog_id, std::move(dog));
@@ -112,13 +208,17 @@ DogPtr Session::AddDog(Dog dog) {
         }
         return &dog_map_it->second;
     }
+    if (!dog_map_it->second.IsMoving() && dog_map_it->second.GetIdleSince()) {
+        ScheduleRetirement(dog_map_it->second);
+    }
+    gatherer_pos_.Emplace(dog_id, gatherers_.size());
     return gatherers_.emplace_back(&dog_map_it->second);
 }
 
 //---------------------------------------------------------
 DogPtr Session::AddDog(Dog::Id id, const Dog::Tag& name) {
     const auto starting_pos = settings_.randomised_dog_spawn
-                                  ? map_->GetRandomRoadPt()
+                                  ? map_->GetRandomRoadPt(rng_)
                                   : map_->GetFirstRoadPt();
 
     const auto [dog_map_it, success] = dogs_.emplace(id,
@@ -133,64 +233,91 @@ DogPtr Session::AddDog(Dog::Id id, const Dog::Tag& name) {
         }
         return &dog_map_it->second;
     }
+    //A new dog stands still until its player moves it
+    dog_map_it->second.SetJoinTime(session_time_).SetIdleSince(session_time_);
+    ScheduleRetirement(dog_map_it->second);
+
     //update gatherers index
+    gatherer_pos_.Emplace(id, gatherers_.size());
     return gatherers_.emplace_back(&dog_map_it->second);
 }
 
-void Session::AddLootItem(LootItem::Id id, LootItem::Type type, model::Point2D pos) {
-    loot_items_.emplace_back(std::make_shared<LootItem>(
-        id, pos, settings_.loot_item_width, type, map_->GetLootItemValue(type)
-    ));
+Session::LootItemHandle Session::AddLootItem(LootItem::Id id, LootItem::Type type, model::Point2D pos) {
+    spatial_index_valid_ = false;
+    return loot_items_.Emplace(id, pos, settings_.loot_item_width, type, map_->GetLootItemValue(type));
 }
 
 void Session::AddRandomLootItems(size_t num_items) {
     for (int i = 0; i < num_items; ++i) {
         AddLootItem(
             next_object_id_,
-            model::GenRandomNum(map_->GetLootTypesSize()),
-            map_->GetRandomRoadPt()
+            model::GenRandomNum(rng_, map_->GetLootTypesSize()),
+            map_->GetRandomRoadPt(rng_)
         );
         ++next_object_id_;
     }
 }
 
 void Session::RemoveDog(Dog::Id dog_id) {
+    //Gatherers point into dogs_, drop the pointer before the dog
+    if (const auto* pos = gatherer_pos_.Find(dog_id)) {
+        gatherers_[*pos] = nullptr;
+        gatherer_pos_.Erase(dog_id);
+        ++removed_gatherers_;
+    }
     dogs_.erase(dog_id);
-    gatherers_.erase(
-        std::ranges::find_if(gatherers_, [dog_id](const DogPtr& dog_ptr) {
-            return dog_ptr->GetId() == dog_id;
-        })
-    );
 }
 
-void Session::RemoveLootItem(GameObject::Id loot_item_id) {
+void Session::CompactGatherers() {
+    if (removed_gatherers_ == 0) {
+        return;
+    }
+    //Stable, replay depends on the collision order
+    std::erase(gatherers_, nullptr);
+    for (size_t pos = 0; pos < gatherers_.size(); ++pos) {
+        *gatherer_pos_.Find(gatherers_[pos]->GetId()) = pos;
+    }
+    removed_gatherers_ = 0;
+}
 
-    auto it = std::ranges::find_if(loot_items_, [loot_item_id](const LootItemPtr& item) {
-        return item->GetId() == loot_item_id;
-    });
+bool Session::RemoveLootItem(LootItemHandle handle) {
+    spatial_index_valid_ = false;
+    return loot_items_.Erase(handle);
+}
+
+const std::vector<Dog::Id>& Session::GetRetiredDogs() const {
+    return retired_dogs_;
+}
+
+void Session::ClearRetiredDogs() {
+    retired_dogs_.clear();
+}
+
+const std::vector<Dog::Id>& Session::GetScoredDogs() const {
+    return scored_dogs_;
+}
 
-    //Delete item and remove from deque
-    it->reset();
-    loot_items_.erase(it);
+void Session::ClearScoredDogs() {
+    scored_dogs_.clear();
 }
 
-void Session::AdvanceTime(model::TimeMs delta_t) {
+void Session::AdvanceTime(model::TimeMs delta_t, TickPhaseTimes* phase_times) {
+    CompactGatherers();
     session_time_ += delta_t;
+    spatial_index_valid_ = false;
 
-    MoveAllDogs(delta_t);
-    ProcessCollisions();
+    TimePhase(phase_times ? &phase_times->move : nullptr, [&] { MoveAllDogs(delta_t); });
+    TimePhase(phase_times ? &phase_times->collisions : nullptr, [&] { ProcessCollisions(); });
 
     //Generate loot after, so that a loot item is not randomly picked up by dog
-    GenerateLoot(delta_t);
+    TimePhase(phase_times ? &phase_times->loot : nullptr, [&] { GenerateLoot(delta_t); });
+    TimePhase(phase_times ? &phase_times->retirement : nullptr, [&] { RetireIdleDogs(); });
 }
 
 void Session::AddOffices(const Map::Offices& offices) {
-    for (const auto& office : map_->GetOffices()) {
-        const auto& off_ptr = offices_.emplace_back(std::make_shared<ItemsReturnPoint>(
-            next_object_id_++, office, settings_.office_width
-        ));
-
-        objects_.emplace_back(off_ptr);
+    offices_.reserve(offices.size());
+    for (const auto& office : offices) {
+        offices_.emplace_back(next_object_id_++, office, settings_.office_width);
     }
 }
 
@@ -201,7 +328,7 @@ void Session::MoveDog(Dog& dog, model::TimeMs delta_t) {
     using model::operator*;
 
     model::Point2D max_move_pt  = dog.GetPos() + dog.GetSpeed() * delta_t;
-    Map::MoveResult move_result = map_->ComputeRoadMove(dog.GetPos(), max_move_pt);
+    Map::MoveResult move_result = map_->ComputeRoadMove(dog.GetPos(), max_move_pt, settings_.move_through_junctions);
     if (move_result.road_edge_reached_) {
         dog.Stop();
     }
@@ -210,10 +337,35 @@ void Session::MoveDog(Dog& dog, model::TimeMs delta_t) {
 
 void Session::MoveAllDogs(model::TimeMs delta_t) {
     for (auto& [id, dog] : dogs_) {
+        const bool was_moving = dog.IsMoving();
         MoveDog(dog, delta_t);
+
+        //Idle time is counted from the end of the tick the dog stopped in
+        if (dog.IsMoving()) {
+            dog.SetIdleSince(std::nullopt);
+        } else if (was_moving || !dog.GetIdleSince()) {
+            dog.SetIdleSince(session_time_);
+            ScheduleRetirement(dog);
+        }
     }
 }
 
+void Session::ScheduleRetirement(const Dog& dog) {
+    idle_expiry_.Schedule(*dog.GetIdleSince() + settings_.dog_retirement_time, dog.GetId());
+}
+
+void Session::RetireIdleDogs() {
+    idle_expiry_.Advance(session_time_, [this](Dog::Id dog_id) {
+        //Stale if the dog is gone or has moved since the entry was scheduled
+        const auto dog = GetDog(dog_id);
+        if (!dog || dog->IsMoving() || !dog->GetIdleSince()
+            || *dog->GetIdleSince() + settings_.dog_retirement_time > session_time_) {
+            return;
+        }
+        retired_dogs_.push_back(dog_id);
+    });
+}
+
 void Session::GenerateLoot(model::TimeMs delta_t) {
 #ifdef GATHER_DEBUG
     if(loot_items_.empty()) {
@@ -226,16 +378,36 @@ void Session::GenerateLoot(model::TimeMs delta_t) {
 }
 
 //---------------------------------------------------------
-void Session::ProcessCollisions() const {
+void Session::ProcessCollisions() {
     try {
         //NB: this used to be a member of Session, but recent changes introduced bugs:
         // - refs to object/gatherer container were becoming invalidates - could be due to std::move or unordered_map/rehash?
-        model::CollisionDetector collision_detector{objects_, gatherers_};
+        model::CollisionDetector collision_detector{loot_items_, offices_, gatherers_};
         auto collision_events = collision_detector.FindCollisions();
 
+        //Item indices are positions in the containers, so collected loot is only removed after all events
+        std::vector<LootItemHandle> collected;
         for (const auto& event : collision_events) {
-            const auto& dog = gatherers_.at(event.gatherer_id);
-            dog->ProcessCollision(objects_.at(event.item_id));
+            const DogPtr dog = gatherers_[event.gatherer_id];
+            const auto item = collision_detector.ResolveItem(event.item_id);
+
+            switch (item.kind) {
+                case model::CollisionItemKind::LOOT:
+                    if (auto& loot = loot_items_[item.idx]; !loot.IsCollected() && dog->TryCollectItem(loot)) {
+                        collected.push_back(loot_items_.GetHandle(item.idx));
+                    }
+                    break;
+                case model::CollisionItemKind::ITEMS_RETURN:
+                    if (!dog->GetBag().empty()) {
+                        scored_dogs_.push_back(dog->GetId());
+                    }
+                    dog->ReturnItems();
+                    break;
+            }
+        }
+
+        for (const auto& handle : collected) {
+            loot_items_.Erase(handle);
         }
     } catch (...) {
         std::cerr << "collision detection error";
@@ -257,17 +429,25 @@ void Player::SetDirection(model::Direction dir) const {
 //=================================================
 //=============PlayerManager ======================
 PlayerSessionManager::PlayerSessionManager(const GamePtr& game)
-    : game_(game) {
+    : game_(game)
+    , map_to_session_index_(game_->GetMaps().size())
+    , live_tops_(game_->GetMaps().size(), LiveTop{LIVE_TOP_SIZE}) {
 }
 
 PlayerSessionManager::PlayerSessionManager(GamePtr&& game)
-    : game_(std::move(game)) {
+    : game_(std::move(game))
+    , map_to_session_index_(game_->GetMaps().size())
+    , live_tops_(game_->GetMaps().size(), LiveTop{LIVE_TOP_SIZE}) {
 }
 
 PlayerPtr PlayerSessionManager::CreatePlayer(const Map::Id& map, const Dog::Tag& dog_tag) {
+    return CreatePlayer(map, dog_tag, GenerateToken());
+}
+
+PlayerPtr PlayerSessionManager::CreatePlayer(const Map::Id& map, const Dog::Tag& dog_tag, Token token) {
     auto session = JoinOrCreateSession(next_session_id_++, map);
     auto dog     = session->AddDog(next_dog_id_++, dog_tag);
-    return AddPlayer(next_player_id_++, dog, session, GenerateToken());
+    return AddPlayer(next_player_id_++, dog, session, std::move(token));
 }
 
 PlayerPtr PlayerSessionManager::AddPlayer(Player::Id id, DogPtr dog, SessionPtr session, Token token) {
@@ -275,135 +455,242 @@ PlayerPtr PlayerSessionManager::AddPlayer(Player::Id id, DogPtr dog, SessionPtr
     const auto [player_it, success] = players_.emplace(id, Player{id, session, dog});
 
     //update indices
-    auto token_result = token_to_player_.emplace(std::move(token), id);
-    player_to_token_[id] = token_result.first;
-    map_dog_id_to_player_index_[session->GetMapId()][dog->GetId()] = id;
+    token_to_player_.Emplace(token, id);
+    player_to_token_[id] = token;
+    dog_to_player_.Emplace(dog->GetId(), id);
+    session->AddToRoster(&player_it->second);
+    live_tops_[session->GetMapIndex()].Update(id, dog->GetTag(), dog->GetScore());
 
     //Success;
     return &player_it->second;
 }
 
-//Make sure to use this function only after restoring dog and session
-PlayerPtr PlayerSessionManager::RestorePlayer(Player::Id id, Dog::Id dog_id, Session::Id session_id, Token token) {
-    try {
-        SessionPtr session = &sessions_.at(session_id);
-
-        //Update next_session id during restore
-        if (next_session_id_ <= session_id) {
-            next_session_id_ = session_id + 1;
-        }
+//Make sure to use this function only after restoring dogs and sessions
+size_t PlayerSessionManager::RestorePlayers(std::span<const RestoredPlayer> players) {
+    players_.reserve(players_.size() + players.size());
+    player_to_token_.reserve(player_to_token_.size() + players.size());
+    token_to_player_.Reserve(token_to_player_.Size() + players.size());
+    dog_to_player_.Reserve(dog_to_player_.Size() + players.size());
 
-        DogPtr dog = session->GetDog(dog_id);
+    size_t skipped = 0;
+    for (const auto& restored : players) {
+        const auto session_it = sessions_.find(restored.session_id);
+        DogPtr dog = session_it == sessions_.end() ? nullptr : session_it->second.GetDog(restored.dog_id);
         if (!dog) {
-            throw std::out_of_range("dog not found by id");
-        }
-
-        //update latest player & dog id
-        if (next_player_id_ <= id) {
-            next_player_id_ = id + 1;
-        }
-
-        if (next_dog_id_ <= dog_id) {
-            next_dog_id_ = dog_id + 1;
+            ++skipped;
+            continue;
         }
+        SessionPtr session = &session_it->second;
+
+        //Update latest ids during restore
+        next_session_id_ = std::max(next_session_id_, restored.session_id + 1);
+        next_player_id_ = std::max(next_player_id_, restored.id + 1);
+        next_dog_id_ = std::max(next_dog_id_, restored.dog_id + 1);
+
+        const auto [player_it, _] = players_.emplace(restored.id, Player{restored.id, session, dog});
+        token_to_player_.Emplace(restored.token, restored.id);
+        player_to_token_[restored.id] = restored.token;
+        dog_to_player_.Emplace(dog->GetId(), restored.id);
+        session->AddToRoster(&player_it->second);
+    }
 
-        return AddPlayer(id, dog, session, std::move(token));
-    } catch (std::exception& ex) {
-        //DEBUG
-        std::cerr << "failed to restore player: " << id << ", exc.: " << ex.what() << std::endl;
-        return nullptr;
+    for (Map::Index map_idx = 0; map_idx < live_tops_.size(); ++map_idx) {
+        RebuildLiveTop(map_idx);
     }
+    return skipped;
 }
 
 ConstPlayerPtr PlayerSessionManager::GetPlayerByToken(const Token& token) const {
-    if (auto it = token_to_player_.find(token); it != token_to_player_.end()) {
-        return &players_.at(it->second);
+    if (const auto player_id = token_to_player_.Find(token)) {
+        return &players_.at(*player_id);
     }
     return nullptr;
 }
 
-ConstPlayerPtr PlayerSessionManager::GetPlayerByMapDogId(const model::Map::Id& map_id, size_t dog_id) const {
-    if (!map_dog_id_to_player_index_.contains(map_id)
-        || !map_dog_id_to_player_index_.at(map_id).contains(dog_id)) {
-        return nullptr;
-    }
-    return &players_.at(map_dog_id_to_player_index_.at(map_id).at(dog_id));
-}
-
 TokenPtr PlayerSessionManager::GetToken(const Player::Id player_id) const {
     auto token_it = player_to_token_.find(player_id);
     return token_it == player_to_token_.end()
                ? nullptr
-               : &token_it->second->first;
+               : &token_it->second;
 }
 
 TokenPtr PlayerSessionManager::GetToken(ConstPlayerPtr player) const {
     return GetToken(player->GetId());
 }
 
+PlayerSessionManager::IdCounters PlayerSessionManager::GetIdCounters() const {
+    return {next_dog_id_, next_player_id_, next_session_id_};
+}
+
+void PlayerSessionManager::SetIdCounters(const IdCounters& counters) {
+    next_dog_id_ = counters.next_dog;
+    next_player_id_ = counters.next_player;
+    next_session_id_ = counters.next_session;
+}
+
 const PlayerSessionManager::Players &PlayerSessionManager::GetAllPlayers() const {
     return players_;
 }
 
+const GamePtr& PlayerSessionManager::GetGame() const {
+    return game_;
+}
+
 const PlayerSessionManager::Sessions &PlayerSessionManager::GetAllSessions() const {
     return sessions_;
 }
 
 SessionPtr PlayerSessionManager::JoinOrCreateSession(Session::Id session_id, const Map::Id& map_id) {
     //Check if a session exixts on map. GetMapSessions checks that mapid is valid
-    const auto map_ptr = game_->FindMap(map_id);
-    if (!map_ptr) {
+    //The only string lookup, everything after works with the map index
+    const auto map_idx = game_->FindMapIndex(map_id);
+    if (!map_idx) {
         //DEBUG
         std::cerr << "Cannot join session, map not found";
         return nullptr;
     }
-    //No sessions on map, create new session
-    auto existing_session_it = map_to_session_index_.find(map_id);
-    if (existing_session_it == map_to_session_index_.end()) {
-        const auto& [session_it, success] = sessions_.emplace(session_id,
-                                                              Session{session_id, map_ptr, game_->GetSettings()}
-        );
-
-        try {
-            map_to_session_index_.emplace(map_id, session_id);
-
-            //if successfully emplaced session, increment session id
-            return &session_it->second;
-        } catch (std::exception& ex) {
-            //DEBUG
-            std::cerr << "Failed to create new session on map: " << ex.what();
-            throw std::runtime_error("Failed to make a new session on map");
+    //Least loaded session with room. Without a limit there is never more than one session per map
+    auto& map_sessions = map_to_session_index_[*map_idx];
+    const size_t max_dogs = game_->GetSettings().max_dogs_per_session;
+    SessionPtr best = nullptr;
+    for (const auto id : map_sessions) {
+        auto& session = sessions_.at(id);
+        if (max_dogs != 0 && session.GetDogCount() >= max_dogs) {
+            continue;
+        }
+        if (!best || session.GetDogCount() < best->GetDogCount()) {
+            best = &session;
         }
     }
-    //A session exists and can be joined
-    return &sessions_.at(existing_session_it->second);
+    if (best) {
+        return best;
+    }
+
+    //No session on the map has room, create new session
+    const auto& [session_it, success] = sessions_.emplace(session_id,
+                                                          Session{session_id, game_->GetMap(*map_idx), game_->GetSettings()}
+    );
+    map_sessions.push_back(session_id);
+    return &session_it->second;
 }
 
 ConstSessionPtr PlayerSessionManager::GetPlayerGameSession(ConstPlayerPtr player) {
     return player->GetSession();
 }
 
-std::vector<ConstPlayerPtr> PlayerSessionManager::GetAllPlayersInSession(ConstPlayerPtr player) const {
-    std::vector<ConstPlayerPtr> result;
-
-    auto player_session = player->GetSession();
-    const auto& map_id  = player_session->GetMapId();
-
-    for (const auto& [dog_id, _] : player_session->GetDogs()) {
-        std::cerr << dog_id << std::endl;
-        result.push_back(GetPlayerByMapDogId(map_id, dog_id));
-    }
-    return result;
+std::span<const ConstPlayerPtr> PlayerSessionManager::GetAllPlayersInSession(ConstPlayerPtr player) {
+    return player->GetSession()->GetRoster();
 }
 
 const Session::LootItems &PlayerSessionManager::GetSessionLootList(ConstPlayerPtr player) {
     return player->GetSession()->GetLootItems();
 }
 
-void PlayerSessionManager::AdvanceTime(model::TimeMs delta_t) {
+std::vector<RetiredPlayer> PlayerSessionManager::AdvanceTime(model::TimeMs delta_t, util::WorkStealingPool* pool,
+                                                             TickPhaseTimes* phase_times) {
+    std::vector<RetiredPlayer> retired;
+    if (!pool || sessions_.size() < 2) {
+        for (auto& [_, session] : sessions_) {
+            session.AdvanceTime(delta_t, phase_times);
+            UpdateLiveTop(session);
+            RetireSessionDogs(session, retired);
+        }
+        return retired;
+    }
+
+    //Every task times into its own slot, summed once all are done
+    std::vector<TickPhaseTimes> session_times(phase_times ? sessions_.size() : 0);
+    std::vector<util::WorkStealingPool::Task> tasks;
+    tasks.reserve(sessions_.size());
     for (auto& [_, session] : sessions_) {
-        session.AdvanceTime(delta_t);
+        auto* times = phase_times ? &session_times[tasks.size()] : nullptr;
+        tasks.emplace_back([&session, delta_t, times] {
+            session.AdvanceTime(delta_t, times);
+        });
     }
+    pool->RunAll(std::move(tasks));
+
+    for (const auto& times : session_times) {
+        *phase_times += times;
+    }
+
+    //Indices are shared between sessions, so players are removed after the parallel part
+    for (auto& [_, session] : sessions_) {
+        UpdateLiveTop(session);
+        RetireSessionDogs(session, retired);
+    }
+    return retired;
+}
+
+std::span<const LiveTop::Entry> PlayerSessionManager::GetLiveTop(Map::Index map_idx) const {
+    return live_tops_.at(map_idx).GetEntries();
+}
+
+void PlayerSessionManager::UpdateLiveTop(Session& session) {
+    auto& live_top = live_tops_[session.GetMapIndex()];
+    for (const auto dog_id : session.GetScoredDogs()) {
+        const auto player_id = dog_to_player_.Find(dog_id);
+        const auto dog = session.GetDog(dog_id);
+        if (player_id && dog) {
+            live_top.Update(*player_id, dog->GetTag(), dog->GetScore());
+        }
+    }
+    session.ClearScoredDogs();
+}
+
+void PlayerSessionManager::RebuildLiveTop(Map::Index map_idx) {
+    auto& live_top = live_tops_[map_idx];
+    live_top.Clear();
+    for (const auto session_id : map_to_session_index_[map_idx]) {
+        for (const auto* player : sessions_.at(session_id).GetRoster()) {
+            live_top.Update(player->GetId(), player->GetDog()->GetTag(), player->GetScore());
+        }
+    }
+}
+
+void PlayerSessionManager::RetireSessionDogs(Session& session, std::vector<RetiredPlayer>& retired) {
+    for (const auto dog_id : session.GetRetiredDogs()) {
+        if (const auto player_id = dog_to_player_.Find(dog_id)) {
+            retired.push_back(RemovePlayer(*player_id));
+        } else {
+            //Dog without a player
+            session.RemoveDog(dog_id);
+        }
+    }
+    session.ClearRetiredDogs();
+    //Once per tick, however many dogs retired
+    session.CompactGatherers();
+}
+
+RetiredPlayer PlayerSessionManager::RetirePlayer(Player::Id id) {
+    const auto session = players_.at(id).GetSession();
+    auto result = RemovePlayer(id);
+    session->CompactGatherers();
+    return result;
+}
+
+RetiredPlayer PlayerSessionManager::RemovePlayer(Player::Id id) {
+    auto& player = players_.at(id);
+    const auto session = player.GetSession();
+    const auto dog = player.GetDog();
+    const auto dog_id = dog->GetId();
+
+    RetiredPlayer result{id, dog->GetTag(), dog->GetScore(), session->GetTime() - dog->GetJoinTime()};
+
+    session->RemoveFromRoster(id);
+    session->RemoveDog(dog_id);
+    dog_to_player_.Erase(dog_id);
+    if (const auto token_it = player_to_token_.find(id); token_it != player_to_token_.end()) {
+        token_to_player_.Erase(token_it->second);
+        player_to_token_.erase(token_it);
+    }
+    players_.erase(id);
+
+    //Whoever was next moves up, found among the players still on the map
+    if (live_tops_[session->GetMapIndex()].Remove(id)) {
+        RebuildLiveTop(session->GetMapIndex());
+    }
+    return result;
 }
 
 
@@ -420,7 +707,7 @@ ConstSessionPtr GameInterface::GetSession(ConstPlayerPtr player) const {
     return player_manager_.GetPlayerGameSession(player);
 }
 
-std::vector<ConstPlayerPtr> GameInterface::GetPlayerList(ConstPlayerPtr player) const {
+std::span<const ConstPlayerPtr> GameInterface::GetPlayerList(ConstPlayerPtr player) const {
     return player_manager_.GetAllPlayersInSession(player);
 }
 
@@ -440,9 +727,15 @@ JoinGameResult GameInterface::JoinGame(std::string map_id_str, std::string playe
     const Dog::Tag dog_tag{std::move(player_dog_name)};
 
     const auto player = player_manager_.CreatePlayer(map_id, dog_tag);
+    if (input_log_) {
+        input_log_->RecordJoin(player->GetId(), *map_id, *dog_tag);
+    }
 
     // <-Make response, send player token
     auto token = player_manager_.GetToken(player);
+    if (app_listener_) {
+        app_listener_->OnJoin(player, *token);
+    }
     return {player->GetId(), token};
 }
 
@@ -450,6 +743,12 @@ void GameInterface::SetPlayerMovement(ConstPlayerPtr player, const char move_com
     //use game default speed if map speed not set
     auto dir = static_cast<model::Direction>(move_command);
     player->SetDirection(dir);
+    if (input_log_) {
+        input_log_->RecordMove(player->GetId(), move_command);
+    }
+    if (app_listener_) {
+        app_listener_->OnMove(player, move_command);
+    }
 }
 
 
@@ -461,16 +760,79 @@ model::ConstMapPtr GameInterface::GetMap(std::string_view map_id) const {
     return game_->FindMap(Map::Id(std::string(map_id)));
 }
 
+void GameInterface::SetTickThreads(unsigned num_threads) {
+    tick_pool_ = num_threads > 1
+                     ? std::make_unique<util::WorkStealingPool>(num_threads)
+                     : nullptr;
+}
+
+void GameInterface::SetInputLog(std::shared_ptr<InputLogWriter> input_log) {
+    input_log_ = std::move(input_log);
+}
+
+void GameInterface::SetRecordsWriter(std::shared_ptr<RecordsWriter> records_writer) {
+    records_writer_ = std::move(records_writer);
+}
+
+void GameInterface::SetLeaderboard(std::shared_ptr<Leaderboard> leaderboard) {
+    leaderboard_ = std::move(leaderboard);
+}
+
+std::shared_ptr<const Leaderboard> GameInterface::GetLeaderboard() const {
+    return leaderboard_;
+}
+
+std::optional<std::span<const LiveTop::Entry>> GameInterface::GetLiveTop(std::string_view map_id) const {
+    if (const auto map_idx = game_->FindMapIndex(Map::Id(std::string(map_id)))) {
+        return player_manager_.GetLiveTop(*map_idx);
+    }
+    return std::nullopt;
+}
+
+void GameInterface::EnableTickProfiling(bool enable) {
+    phase_times_ = enable ? std::make_optional<TickPhaseTimes>() : std::nullopt;
+}
+
+TickPhaseTimes GameInterface::GetTickPhaseTimes() const {
+    return phase_times_.value_or(TickPhaseTimes{});
+}
+
 void GameInterface::AdvanceGameTime(model::TimeMs delta_t) {
-    player_manager_.AdvanceTime(delta_t);
+    if (input_log_) {
+        input_log_->RecordTick(delta_t);
+    }
+    //Returns after every session has finished its tick, listeners see a consistent state
+    auto retired = player_manager_.AdvanceTime(delta_t, tick_pool_.get(), phase_times_ ? &*phase_times_ : nullptr);
+    if (leaderboard_ && !retired.empty()) {
+        leaderboard_->Add(retired);
+    }
     try {
         if (app_listener_) {
-            app_listener_->OnTick(delta_t, player_manager_);
+            app_listener_->OnTick(delta_t, retired, player_manager_);
         }
     } catch (std::exception& ex) {
         //TODO: Logger
         std::cerr << "serialization error occured: " << ex.what() << std::endl;
     }
+    if (records_writer_ && !retired.empty() && !records_writer_->Push(std::move(retired))) {
+        ReportDroppedRecords();
+    }
+}
+
+void GameInterface::ReportDroppedRecords() {
+    const auto stats = records_writer_->GetStats();
+    const auto now = std::chrono::steady_clock::now();
+    if (stats.queue_full == reported_queue_full_ || now - last_drop_report_ < drop_report_period_) {
+        return;
+    }
+    BOOST_LOG_TRIVIAL(warning) << boost::log::add_value(log_message, "records queue full"s)
+                               << boost::log::add_value(log_msg_data, boost::json::object{
+                                   {"dropped", stats.queue_full - reported_queue_full_},
+                                   {"droppedTotal", stats.dropped},
+                                   {"written", stats.written}
+                               });
+    reported_queue_full_ = stats.queue_full;
+    last_drop_report_ = now;
 }
 
 bool GameInterface::MoveCommandValid(const char move_command) const {
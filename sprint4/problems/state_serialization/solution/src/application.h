@@ -3,17 +3,23 @@
 //
 #pragma once
 #include <boost/asio/io_context.hpp>
+#include <algorithm>
+#include <chrono>
 #include <deque>
 #include <filesystem>
+#include <span>
 #include <unordered_map>
 
 #include "app_util.h"
+#include "flat_hash_map.h"
+#include "live_top.h"
 #include "model.h"
 #include "loot_generator.h"
-
-namespace detail {
-struct TokenTag {};
-}  // namespace detail
+#include "slot_map.h"
+#include "spatial_grid.h"
+#include "timer_wheel.h"
+#include "token.h"
+#include "work_stealing_pool.h"
 
 namespace app {
 using namespace std::literals;
@@ -29,17 +35,26 @@ using model::LootItem;
 using model::MapPtr;
 using model::DogPtr;
 using model::ConstDogPtr;
-using model::LootItemPtr;
-using model::ItemsReturnPointPtr;
-using model::CollisionObjectPtr;
 using model::ItemsReturnPoint;
 
-using Token = util::Tagged<std::string, detail::TokenTag>;
 
-struct TokenHasher {
-    size_t operator()(const Token& token) const;
-};
+class Player;
 
+//Time spent in each part of Session::AdvanceTime, summed over ticks (and sessions)
+struct TickPhaseTimes {
+    std::chrono::nanoseconds move{0};
+    std::chrono::nanoseconds collisions{0};
+    std::chrono::nanoseconds loot{0};
+    std::chrono::nanoseconds retirement{0};
+
+    TickPhaseTimes& operator+=(const TickPhaseTimes& other) {
+        move += other.move;
+        collisions += other.collisions;
+        loot += other.loot;
+        retirement += other.retirement;
+        return *this;
+    }
+};
 
 //=================================================
 //=================== Session =====================
@@ -47,11 +62,15 @@ class Session {
  public:
     using Id = size_t;
     using Dogs = std::unordered_map<Dog::Id, Dog>;
-    using LootItems = std::deque<LootItemPtr>;
-    using Offices = std::deque<ItemsReturnPointPtr>;
+    //Players of the session ordered by player id. The order only changes when players join or leave
+    using Roster = std::vector<const Player*>;
+    //Stored by value, removal is O(1) and freed slots are reused by new loot
+    using LootItems = util::SlotMap<LootItem>;
+    using LootItemHandle = LootItems::Handle;
+    using Offices = std::vector<ItemsReturnPoint>;
 
-    using Gatherers = std::deque<DogPtr>;
-    using CollisionObjects = std::deque<CollisionObjectPtr>;
+    //Dogs themselves stay in Dogs (players keep pointers to them), this is the packed list for collisions
+    using Gatherers = std::vector<DogPtr>;
 
     //TODO: make a sep. strand for session
     Session(Id id, MapPtr map, gamedata::Settings settings/*, net::io_context& io*/);
@@ -59,8 +78,13 @@ class Session {
     size_t GetId() const;
     model::ConstMapPtr GetMap() const;
     model::TimeMs GetTime() const;
+    //Only for restoring a session, before its dogs are added
+    void SetTime(model::TimeMs time);
+    //Only for restoring a session, sizes its containers for the objects about to be added
+    void Reserve(size_t num_dogs, size_t num_loot_items);
 
     const Map::Id& GetMapId() const;
+    Map::Index GetMapIndex() const;
     size_t GetDogCount() const;
     size_t GetLootCount() const;
     double GetDogSpeedVal() const;
@@ -71,19 +95,58 @@ class Session {
     ConstDogPtr GetDog(Dog::Id id) const;
 
     const LootItems& GetLootItems() const;
+    std::span<const Player* const> GetRoster() const;
+    //Dogs in collision order, the order they were added in
+    std::span<const DogPtr> GetGatherers() const;
+
+    //What the next ticks depend on besides the objects, a restored session must get it back to replay exactly
+    struct GeneratorState {
+        model::RandomEngine rng;
+        GameObject::Id next_object_id = 0;
+        model::TimeMs time_without_loot{0};
+    };
+    GeneratorState GetGeneratorState() const;
+    //Only for restoring a session, after its objects are added
+    void SetGeneratorState(const GeneratorState& state);
+
+    //What the viewer's dog sees; the viewer itself is always there. Loot is given as positions in GetLootItems()
+    struct VisibleObjects {
+        std::vector<const Player*> players;
+        std::vector<size_t> loot;
+    };
+    //The index behind it is rebuilt on the first call after the session changed
+    VisibleObjects FindVisible(const Player& viewer, double radius) const;
+
+    //Kept up to date by PlayerSessionManager
+    void AddToRoster(const Player* player);
+    void RemoveFromRoster(size_t player_id);
 
     //At construction there are 0 dogs. Session is always on 1 map
     //When a player is added, he gets a new dog to control
     DogPtr AddDog(Dog dog);
     DogPtr AddDog(Dog::Id id, const Dog::Tag& name);
 
-    void AddLootItem(LootItem::Id id, LootItem::Type type, model::Point2D pos);
+    LootItemHandle AddLootItem(LootItem::Id id, LootItem::Type type, model::Point2D pos);
     void AddRandomLootItems(size_t num_items);
 
+    //O(1): the dog's gatherer slot is emptied and the gap closed by CompactGatherers,
+    //which AdvanceTime runs first. Callers removing outside a tick compact once they are done
     void RemoveDog(Dog::Id dog_id);
-    void RemoveLootItem(GameObject::Id loot_item_id);
+    //Closes the gaps left by RemoveDog in one pass, keeping the gatherer order
+    void CompactGatherers();
+    bool RemoveLootItem(LootItemHandle handle);
+
+    //Dogs that stood still for the retirement time. They stay in the session until
+    //PlayerSessionManager removes them together with their players
+    const std::vector<Dog::Id>& GetRetiredDogs() const;
+    void ClearRetiredDogs();
+
+    //Dogs that handed in loot during the tick, may repeat
+    const std::vector<Dog::Id>& GetScoredDogs() const;
+    void ClearScoredDogs();
 
-    void AdvanceTime(model::TimeMs delta_t);
+    //Adds the time taken by each phase to phase_times if given
+    void AdvanceTime(model::TimeMs delta_t, TickPhaseTimes* phase_times = nullptr);
 
 private:
     //net::strand<net::io_context::executor_type> strand_;
@@ -94,26 +157,42 @@ private:
     GameObject::Id next_object_id_ {0u};
 
     Dogs dogs_;
+    Roster roster_;
     LootItems loot_items_;
     Offices offices_;
 
     Gatherers gatherers_;
-    CollisionObjects objects_;
+    //Position of every dog in gatherers_, and how many of its slots RemoveDog emptied
+    util::FlatHashMap<Dog::Id, size_t> gatherer_pos_;
+    size_t removed_gatherers_ = 0;
 
     MapPtr map_;
     gamedata::Settings settings_;
     loot_gen::LootGenerator loot_generator_;
+    //Seeded from settings random_seed and the session id, all randomness of the session comes from here
+    model::RandomEngine rng_;
+
+    //Retirement time of every dog that stopped, stale entries are skipped when they come up
+    util::TimerWheel<Dog::Id> idle_expiry_;
+    std::vector<Dog::Id> retired_dogs_;
+    std::vector<Dog::Id> scored_dogs_;
+
+    //Spatial index of the roster dogs and the loot, for area of interest queries.
+    //Cells are the map view radius, a query then touches about 3x3 of them
+    static constexpr double DEFAULT_GRID_CELL = 10.0;
+    mutable util::SpatialGrid roster_grid_;
+    mutable util::SpatialGrid loot_grid_;
+    mutable bool spatial_index_valid_ = false;
 
     void AddOffices(const Map::Offices& offices);
+    void ScheduleRetirement(const Dog& dog);
+    void RetireIdleDogs();
 
     void MoveDog(Dog& dog, model::TimeMs delta_t);
     void MoveAllDogs(model::TimeMs delta_t);
 
     void GenerateLoot(model::TimeMs delta_t);
-    void ProcessCollisions() const;
-
-    // void HandleCollision(const model::LootItemPtr& loot, const DogPtr& dog) const;
-    // void HandleCollision(const model::ItemsReturnPointPtr& office, const DogPtr& dog) const;
+    void ProcessCollisions();
 };
 
 using SessionPtr = Session*;
@@ -144,6 +223,14 @@ class Player {
     DogPtr dog_;
 };
 
+//What is left of a player who left the game
+struct RetiredPlayer {
+    Player::Id id;
+    Dog::Tag name;
+    model::Score score;
+    model::TimeMs play_time;
+};
+
 using GamePtr = std::shared_ptr<Game>;
 using PlayerPtr = Player*;
 using ConstPlayerPtr = const Player*;
@@ -156,42 +243,80 @@ class PlayerSessionManager {
  public:
     using Players = std::unordered_map<Player::Id, Player>;
     using Sessions = std::unordered_map<Session::Id, Session>;
-    using TokenToPlayer = std::unordered_map<Token, Player::Id, TokenHasher>;
-    using MapToSession = std::unordered_map<Map::Id, Session::Id, util::TaggedHasher<Map::Id>>;
+    using TokenToPlayer = util::FlatHashMap<Token, Player::Id, TokenHasher>;
+    using DogToPlayer = util::FlatHashMap<Dog::Id, Player::Id>;
+    //Indexed by Map::Index, all sessions on the map
+    using MapToSession = std::vector<std::vector<Session::Id>>;
+
+    static constexpr size_t LIVE_TOP_SIZE = 10;
 
     explicit PlayerSessionManager(const GamePtr& game);
     explicit PlayerSessionManager(GamePtr&& game);
 
     PlayerSessionManager(const GamePtr& game, Sessions sessions)
-        : game_(game)
-        , sessions_(std::move(sessions)){
+        : PlayerSessionManager(game) {
+        sessions_ = std::move(sessions);
         //update indices
         for(const auto& [sess_id, session] : sessions_) {
-            map_to_session_index_[session.GetMap()->GetId()] = sess_id;
+            map_to_session_index_[session.GetMapIndex()].push_back(sess_id);
+        }
+        for(auto& map_sessions : map_to_session_index_) {
+            std::ranges::sort(map_sessions);
         }
 
     }
 
     PlayerPtr CreatePlayer(const Map::Id& map, const Dog::Tag& dog_tag);
+    //Replays a join from a log, the player keeps the token it was given then
+    PlayerPtr CreatePlayer(const Map::Id& map, const Dog::Tag& dog_tag, Token token);
     PlayerPtr AddPlayer(Player::Id id, DogPtr dog, SessionPtr session, Token token);
-    PlayerPtr RestorePlayer(Player::Id id, Dog::Id dog_id, Session::Id session_id, Token token);
 
+    struct RestoredPlayer {
+        Player::Id id = 0;
+        Dog::Id dog_id = 0;
+        Session::Id session_id = 0;
+        Token token;
+    };
+    //Adds saved players to the restored sessions in one pass: indices are sized once and live tops
+    //built at the end. Players whose session or dog is missing are skipped and counted in the result
+    size_t RestorePlayers(std::span<const RestoredPlayer> players);
+
+    //Joins the least loaded session on the map that has room, or opens session_id if all are full
     SessionPtr JoinOrCreateSession(Session::Id session_id, const Map::Id& map_id);
 
     TokenPtr GetToken(Player::Id player_id) const;
     TokenPtr GetToken(ConstPlayerPtr player) const;
 
+    //Next ids to hand out. Restoring players only raises them to the ids in use,
+    //a checkpoint keeps them so that retired ids are not given out again
+    struct IdCounters {
+        Dog::Id next_dog = 0;
+        Player::Id next_player = 0;
+        Session::Id next_session = 0;
+    };
+    IdCounters GetIdCounters() const;
+    void SetIdCounters(const IdCounters& counters);
+
     const Players& GetAllPlayers() const;
     const Sessions& GetAllSessions() const;
+    const GamePtr& GetGame() const;
 
     ConstPlayerPtr GetPlayerByToken(const Token& token) const;
-    ConstPlayerPtr GetPlayerByMapDogId(const Map::Id& map_id, size_t dog_id) const;
 
     static ConstSessionPtr GetPlayerGameSession(ConstPlayerPtr player);
-    std::vector<ConstPlayerPtr> GetAllPlayersInSession(ConstPlayerPtr player) const;
+    static std::span<const ConstPlayerPtr> GetAllPlayersInSession(ConstPlayerPtr player);
     static const Session::LootItems& GetSessionLootList(ConstPlayerPtr player);
 
-    void AdvanceTime(model::TimeMs delta_t);
+    //Best players on the map right now, across all its sessions
+    std::span<const LiveTop::Entry> GetLiveTop(Map::Index map_idx) const;
+
+    //Removes the player, its dog and every index entry outside a tick
+    RetiredPlayer RetirePlayer(Player::Id id);
+
+    //Sessions are independent, with a pool they are ticked concurrently. Returns when all are done,
+    //with the players whose dogs retired during the tick, already removed
+    std::vector<RetiredPlayer> AdvanceTime(model::TimeMs delta_t, util::WorkStealingPool* pool = nullptr,
+                                           TickPhaseTimes* phase_times = nullptr);
 
 private:
     GamePtr game_;
@@ -203,14 +328,21 @@ private:
     Session::Id next_session_id_ {0u};
 
     //Indices for search
-    using TokenIt = std::unordered_map<Token, Player::Id>::iterator;
     TokenToPlayer token_to_player_;
-    std::unordered_map<Player::Id, TokenIt> player_to_token_;
+    //Node map, so TokenPtr handed out stays valid
+    std::unordered_map<Player::Id, Token> player_to_token_;
+    DogToPlayer dog_to_player_;
 
     MapToSession map_to_session_index_;
+    //Indexed by Map::Index
+    std::vector<LiveTop> live_tops_;
+
+    void UpdateLiveTop(Session& session);
+    void RebuildLiveTop(Map::Index map_idx);
 
-    using MapDogIdToPlayer = std::unordered_map<Map::Id, std::unordered_map<Dog::Id, Player::Id>,  util::TaggedHasher<Map::Id>>;
-    MapDogIdToPlayer map_dog_id_to_player_index_;
+    //RetirePlayer without compacting the session gatherers, a tick compacts once for all its retirements
+    RetiredPlayer RemovePlayer(Player::Id id);
+    void RetireSessionDogs(Session& session, std::vector<RetiredPlayer>& retired);
 
 };
 
@@ -219,8 +351,16 @@ private:
 //=================== App Listener ================
 class ApplicationListener {
 public:
-    virtual void OnTick(model::TimeMs delta_t, const app::PlayerSessionManager& psm) = 0;
-    virtual PlayerSessionManager Restore(GamePtr game) const = 0;
+    //Inputs in the order the game applied them, between the ticks they came in
+    virtual void OnJoin([[maybe_unused]] ConstPlayerPtr player, [[maybe_unused]] const Token& token) {
+    }
+    virtual void OnMove([[maybe_unused]] ConstPlayerPtr player, [[maybe_unused]] char move) {
+    }
+    //retired: players the tick removed from the game
+    virtual void OnTick(model::TimeMs delta_t, std::span<const RetiredPlayer> retired,
+                        const app::PlayerSessionManager& psm) = 0;
+    //Also where the listener picks up from the restored state, so it is not const
+    virtual PlayerSessionManager Restore(GamePtr game) = 0;
 protected:
     virtual ~ApplicationListener() = default;
 };
@@ -230,6 +370,10 @@ using AppListenerPtr = std::shared_ptr<ApplicationListener>;
 
 //=================================================
 //================= GameInterface =================
+class InputLogWriter;
+class RecordsWriter;
+class Leaderboard;
+
 struct JoinGameResult {
     Player::Id player_id;
     const Token* token;
@@ -240,6 +384,23 @@ class GameInterface {
     //GameInterface(const fs::path& game_config);
     GameInterface(net::io_context& io, const GamePtr& game_ptr, const AppListenerPtr& app_listener_ptr);
 
+    //Tick sessions on num_threads worker threads, 0 or 1 ticks them one by one on the calling thread
+    void SetTickThreads(unsigned num_threads);
+
+    //Joins, moves and ticks are written to the log as they come, nullptr stops recording
+    void SetInputLog(std::shared_ptr<InputLogWriter> input_log);
+
+    //Records of players whose dogs retire go here, nullptr keeps them nowhere
+    void SetRecordsWriter(std::shared_ptr<RecordsWriter> records_writer);
+
+    //Retired players are added to it as they leave. Set once before serving, then read from any thread
+    void SetLeaderboard(std::shared_ptr<Leaderboard> leaderboard);
+    std::shared_ptr<const Leaderboard> GetLeaderboard() const;
+
+    //Sums time per tick phase from now on, disabling drops the sums
+    void EnableTickProfiling(bool enable);
+    TickPhaseTimes GetTickPhaseTimes() const;
+
     //use cases
     model::ConstMapPtr GetMap(std::string_view map_id) const;
     const Game::Maps& ListAllMaps() const;
@@ -259,11 +420,14 @@ class GameInterface {
     JoinGameResult JoinGame(std::string map_id_str, std::string player_dog_name);
     ConstPlayerPtr FindPlayerByToken(const Token& token) const;
 
+    //Empty if there is no such map
+    std::optional<std::span<const LiveTop::Entry>> GetLiveTop(std::string_view map_id) const;
+
     //Returns the player's game session
     ConstSessionPtr GetSession(ConstPlayerPtr player) const;
 
     //Returns vector of all players in same session as player
-    std::vector<ConstPlayerPtr> GetPlayerList(ConstPlayerPtr player) const;
+    std::span<const ConstPlayerPtr> GetPlayerList(ConstPlayerPtr player) const;
     const Session::LootItems& GetLootList(ConstPlayerPtr player) const;
 
  private:
@@ -271,6 +435,18 @@ class GameInterface {
     AppListenerPtr app_listener_ = nullptr;
     GamePtr game_;
     PlayerSessionManager player_manager_;
+    std::unique_ptr<util::WorkStealingPool> tick_pool_;
+    std::shared_ptr<InputLogWriter> input_log_;
+    std::shared_ptr<RecordsWriter> records_writer_;
+    std::shared_ptr<Leaderboard> leaderboard_;
+    std::optional<TickPhaseTimes> phase_times_;
+
+    //Records dropped on a full queue are logged at most once per second, with the count since the previous report
+    static constexpr std::chrono::seconds drop_report_period_{1};
+    size_t reported_queue_full_ = 0;
+    std::chrono::steady_clock::time_point last_drop_report_{};
+
+    void ReportDroppedRecords();
 
     //TODO: use from GameSettings
     static constexpr auto valid_move_chars_ = "UDLR"sv;
@@ -0,0 +1,74 @@
+#include "fixed_step_clock.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace util {
+
+FixedStepClock::FixedStepClock(Settings settings)
+    : settings_(settings)
+    , step_(settings.step) {
+    if(settings_.step.count() <= 0) {
+        throw std::invalid_argument("Fixed step clock needs a positive step");
+    }
+    settings_.max_steps_per_wakeup = std::max(1u, settings_.max_steps_per_wakeup);
+}
+
+FixedStepClock::Plan FixedStepClock::PlanSteps(Duration elapsed) {
+    ++stats_.wakeups;
+    accumulated_ += std::max(elapsed, Duration{0});
+
+    Plan plan;
+    const auto due = static_cast<uint64_t>(accumulated_ / step_);
+    plan.count = static_cast<unsigned>(std::min<uint64_t>(due, settings_.max_steps_per_wakeup));
+    plan.last_step = step_;
+    accumulated_ -= step_ * plan.count;
+
+    //Lag is taken before dropping/merging, so it shows how far behind the wakeup found us
+    stats_.lag = accumulated_;
+    stats_.max_lag = std::max(stats_.max_lag, stats_.lag);
+
+    const bool overrun = due > plan.count;
+    if(overrun) {
+        ++stats_.overruns;
+
+        //Keep the remainder below one step, the rest is either dropped or folded into the last step
+        const Duration excess = accumulated_ - accumulated_ % step_;
+        accumulated_ -= excess;
+        //A merged step never outgrows GetMaxMergedStep(), what does not fit is dropped as with SKIP
+        const Duration merged = settings_.catch_up == CatchUp::MERGE
+            ? std::clamp(GetMaxMergedStep() - plan.last_step, Duration{0}, excess)
+            : Duration{0};
+        plan.last_step += merged;
+        stats_.merged += merged;
+        stats_.skipped += excess - merged;
+    }
+    stats_.steps += plan.count;
+
+    Adapt(overrun);
+    return plan;
+}
+
+FixedStepClock::Duration FixedStepClock::GetMaxMergedStep() const {
+    return settings_.max_step > settings_.step ? settings_.max_step
+                                               : settings_.step * settings_.max_steps_per_wakeup;
+}
+
+void FixedStepClock::Adapt(bool overrun) {
+    if(settings_.max_step <= settings_.step) {
+        return;
+    }
+
+    overrun_streak_ = overrun ? overrun_streak_ + 1 : 0;
+    calm_streak_ = overrun ? 0 : calm_streak_ + 1;
+
+    if(overrun_streak_ >= settings_.overloaded_wakeups && step_ < settings_.max_step) {
+        step_ = std::min(step_ + settings_.step, settings_.max_step);
+        overrun_streak_ = 0;
+    } else if(calm_streak_ >= settings_.overloaded_wakeups && step_ > settings_.step) {
+        step_ = std::max(step_ - settings_.step, settings_.step);
+        calm_streak_ = 0;
+    }
+}
+
+} // namespace util
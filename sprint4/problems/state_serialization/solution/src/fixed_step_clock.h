@@ -0,0 +1,86 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+namespace util {
+
+//Turns irregular real-time wakeups into a sequence of fixed simulation steps.
+//Real time is accumulated and only whole steps are handed out, so the cost of a step
+//does not depend on how late the wakeup was.
+class FixedStepClock {
+public:
+    using Duration = std::chrono::milliseconds;
+
+    //What to do with the time left over when the per-wakeup step cap is hit
+    enum class CatchUp {
+        SKIP,   //drop it, simulation falls behind real time
+        MERGE,  //add it to the last step, up to GetMaxMergedStep(), simulation keeps up with real time
+    };
+
+    struct Settings {
+        Duration step{0};
+        unsigned max_steps_per_wakeup = 5;
+        CatchUp catch_up = CatchUp::MERGE;
+
+        //Adaptive step: after overloaded_wakeups overruns in a row the step grows by the base step,
+        //up to max_step. After as many calm wakeups in a row it shrinks back. max_step <= step disables it.
+        //Also the longest step MERGE may build
+        Duration max_step{0};
+        unsigned overloaded_wakeups = 10;
+    };
+
+    struct Stats {
+        uint64_t wakeups = 0;
+        uint64_t steps = 0;
+        //Wakeups that hit the step cap
+        uint64_t overruns = 0;
+        //Real time dropped by CatchUp::SKIP, or by MERGE past the longest step
+        Duration skipped{0};
+        //Real time merged into longer steps by CatchUp::MERGE
+        Duration merged{0};
+        //Accumulated time not yet simulated, after the last wakeup
+        Duration lag{0};
+        Duration max_lag{0};
+    };
+
+    explicit FixedStepClock(Settings settings);
+
+    //Adds elapsed real time and calls run_step(delta) for every step due now
+    template<typename Fn>
+    void Advance(Duration elapsed, Fn&& run_step);
+
+    Duration GetStep() const { return step_; }
+    //max_step, or a whole wakeup worth of base steps without one
+    Duration GetMaxMergedStep() const;
+    const Settings& GetSettings() const { return settings_; }
+    const Stats& GetStats() const { return stats_; }
+
+private:
+    Settings settings_;
+    Duration step_;
+    Duration accumulated_{0};
+    Stats stats_;
+
+    unsigned overrun_streak_ = 0;
+    unsigned calm_streak_ = 0;
+
+    //Number of steps due now and the step to use for the last one, updates all the bookkeeping
+    struct Plan {
+        unsigned count = 0;
+        Duration last_step{0};
+    };
+    Plan PlanSteps(Duration elapsed);
+    void Adapt(bool overrun);
+};
+
+template<typename Fn>
+void FixedStepClock::Advance(Duration elapsed, Fn&& run_step) {
+    //Step size is fixed for the whole wakeup, adaptation only applies to the next one
+    const Duration step = step_;
+    const Plan plan = PlanSteps(elapsed);
+    for(unsigned i = 0; i < plan.count; ++i) {
+        run_step(i + 1 == plan.count ? plan.last_step : step);
+    }
+}
+
+} // namespace util
@@ -0,0 +1,156 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+//Open-addressing hash map with linear probing, all entries in one array.
+//Erase shifts the following entries back instead of leaving tombstones, so probe chains stay short.
+//Pointers returned by Find/Emplace are invalidated by any insert or erase.
+template<typename Key, typename Value, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+class FlatHashMap {
+public:
+    //Returns the stored value and true if it was inserted, or the existing value and false
+    std::pair<Value*, bool> Emplace(const Key& key, Value value) {
+        if((size_ + 1) * 2 > slots_.size()) {
+            Rehash(slots_.empty() ? MIN_CAPACITY : slots_.size() * 2);
+        }
+
+        size_t idx = Home(key);
+        while(slots_[idx].used) {
+            if(equal_(slots_[idx].key, key)) {
+                return {&slots_[idx].value, false};
+            }
+            idx = Next(idx);
+        }
+
+        slots_[idx] = Slot{key, std::move(value), true};
+        ++size_;
+        return {&slots_[idx].value, true};
+    }
+
+    Value* Find(const Key& key) {
+        const size_t idx = FindSlot(key);
+        return idx == NOT_FOUND ? nullptr : &slots_[idx].value;
+    }
+
+    const Value* Find(const Key& key) const {
+        const size_t idx = FindSlot(key);
+        return idx == NOT_FOUND ? nullptr : &slots_[idx].value;
+    }
+
+    bool Contains(const Key& key) const {
+        return FindSlot(key) != NOT_FOUND;
+    }
+
+    bool Erase(const Key& key) {
+        size_t hole = FindSlot(key);
+        if(hole == NOT_FOUND) {
+            return false;
+        }
+
+        //Move back every following entry whose home is not between the hole and its position
+        for(size_t idx = Next(hole); slots_[idx].used; idx = Next(idx)) {
+            const size_t home = Home(slots_[idx].key);
+            const bool stays = hole < idx ? (hole < home && home <= idx)
+                                          : (hole < home || home <= idx);
+            if(!stays) {
+                slots_[hole] = std::move(slots_[idx]);
+                hole = idx;
+            }
+        }
+        slots_[hole] = Slot{};
+        --size_;
+        return true;
+    }
+
+    void Reserve(size_t count) {
+        size_t capacity = MIN_CAPACITY;
+        while(capacity < count * 2) {
+            capacity *= 2;
+        }
+        if(capacity > slots_.size()) {
+            Rehash(capacity);
+        }
+    }
+
+    void Clear() {
+        slots_.assign(slots_.size(), Slot{});
+        size_ = 0;
+    }
+
+    size_t Size() const { return size_; }
+    bool Empty() const { return size_ == 0; }
+
+    //fn(const Key&, Value&) for every entry, in no particular order
+    template<typename Fn>
+    void ForEach(Fn&& fn) {
+        for(auto& slot : slots_) {
+            if(slot.used) {
+                fn(std::as_const(slot.key), slot.value);
+            }
+        }
+    }
+
+    template<typename Fn>
+    void ForEach(Fn&& fn) const {
+        for(const auto& slot : slots_) {
+            if(slot.used) {
+                fn(slot.key, slot.value);
+            }
+        }
+    }
+
+private:
+    static constexpr size_t MIN_CAPACITY = 16;
+    static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+
+    struct Slot {
+        Key key{};
+        Value value{};
+        bool used = false;
+    };
+
+    //Capacity is a power of two, at most half full
+    std::vector<Slot> slots_;
+    size_t size_ = 0;
+    [[no_unique_address]] Hash hash_;
+    [[no_unique_address]] KeyEqual equal_;
+
+    size_t Home(const Key& key) const {
+        return hash_(key) & (slots_.size() - 1);
+    }
+
+    size_t Next(size_t idx) const {
+        return (idx + 1) & (slots_.size() - 1);
+    }
+
+    size_t FindSlot(const Key& key) const {
+        if(slots_.empty()) {
+            return NOT_FOUND;
+        }
+        for(size_t idx = Home(key); slots_[idx].used; idx = Next(idx)) {
+            if(equal_(slots_[idx].key, key)) {
+                return idx;
+            }
+        }
+        return NOT_FOUND;
+    }
+
+    void Rehash(size_t capacity) {
+        std::vector<Slot> old = std::exchange(slots_, std::vector<Slot>(capacity));
+        for(auto& slot : old) {
+            if(slot.used) {
+                size_t idx = Home(slot.key);
+                while(slots_[idx].used) {
+                    idx = Next(idx);
+                }
+                slots_[idx] = std::move(slot);
+            }
+        }
+    }
+};
+
+} // namespace util
@@ -4,6 +4,8 @@
 
 #include "game_data.h"
 
+#include <stdexcept>
+
 namespace gamedata {
 
 boost::json::array LootTypesInfo::AsJsonArray() const {
@@ -11,19 +13,30 @@ boost::json::array LootTypesInfo::AsJsonArray() const {
 }
 LootTypesInfo::LootTypesInfo(boost::json::array map_loot_types)
     : map_loot_types_(std::move(map_loot_types)) {
+    item_values_.reserve(map_loot_types_.size());
+    for(const auto& loot_type : map_loot_types_) {
+        const auto* value = loot_type.as_object().if_contains("value");
+        if(!value) {
+            throw std::invalid_argument("loot type has no value");
+        }
+        const auto item_value = value->as_int64();
+        if(item_value < 0) {
+            throw std::invalid_argument("loot type value must not be negative");
+        }
+        item_values_.push_back(static_cast<size_t>(item_value));
+    }
 }
 
 size_t LootTypesInfo::Size() {
-    return map_loot_types_.size();
+    return item_values_.size();
 }
 
 const size_t LootTypesInfo::Size() const {
-    return map_loot_types_.size();
+    return item_values_.size();
 }
 
 size_t LootTypesInfo::GetItemValue(LootItemType type) const {
-    auto val = map_loot_types_.at(type).as_object().at("value").as_int64();
-    return static_cast<size_t>(val);
+    return item_values_.at(type);
 }
 
 }
\ No newline at end of file
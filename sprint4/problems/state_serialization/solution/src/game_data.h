@@ -4,7 +4,9 @@
 #pragma once
 #include <boost/json.hpp>
 #include <chrono>
+#include <cstdint>
 #include <optional>
+#include <vector>
 
 namespace gamedata {
 using namespace std::literals;
@@ -12,6 +14,9 @@ using namespace std::literals;
 //NB: Default values set here!
 struct Settings {
     bool randomised_dog_spawn = false;
+    bool move_through_junctions = false;
+    //Same seed and same inputs give the same simulation
+    std::optional<uint64_t> random_seed;
 
     std::optional<double> map_dog_speed;
     std::optional<size_t> map_bag_capacity;
@@ -21,6 +26,10 @@ struct Settings {
 
     double default_dog_speed    = 1.0;
     size_t default_bag_capacity = 3;
+    //Joins past this open another session on the same map, 0 - no limit
+    size_t max_dogs_per_session = 0;
+    //Dogs standing still this long leave the game
+    std::chrono::milliseconds dog_retirement_time{60000u};
 
     const double loot_item_width = 0.0;
     const double dog_width       = 0.6;
@@ -41,10 +50,11 @@ namespace json = boost::json;
 using LootItemType = unsigned;
 
 //Funcs -> store map loot info from json
-//Get json for printing
+//Json is only kept for printing, values are copied out into a flat table on load
 class LootTypesInfo {
 public:
     //json [array of loot types] }
+    //Throws std::invalid_argument for a type without a value or with a negative one
     explicit LootTypesInfo(json::array map_loot_types);
 
     json::array AsJsonArray() const;
@@ -53,10 +63,11 @@ public:
 
     const size_t Size() const;
 
+    //Throws std::out_of_range for an unknown type
     size_t GetItemValue(LootItemType type) const;
 
 private:
-    size_t size_ = 0;
     json::array map_loot_types_;
+    std::vector<size_t> item_values_;
 };
 }
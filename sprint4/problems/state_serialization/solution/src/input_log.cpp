@@ -0,0 +1,292 @@
+#include "input_log.h"
+
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace app {
+using namespace std::literals;
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+[[noreturn]] void ThrowMalformed(size_t line_num, std::string_view what) {
+    throw std::runtime_error("malformed input log, line "s + std::to_string(line_num) + ": "s + std::string(what));
+}
+
+//<len> <bytes>, the bytes may hold spaces. Never longer than the line they are on
+bool ReadSized(std::istream& in, std::string& out, size_t max_len) {
+    size_t len = 0;
+    if(!(in >> len) || len > max_len || in.get() != ' ') {
+        return false;
+    }
+    out.resize(len);
+    return static_cast<bool>(in.read(out.data(), static_cast<std::streamsize>(len)));
+}
+
+InputRecord ParseRecord(const std::string& line, size_t line_num) {
+    std::istringstream in(line);
+
+    char type = 0;
+    long long timestamp = 0;
+    if(!(in >> type >> timestamp)) {
+        ThrowMalformed(line_num, "expected record type and timestamp"sv);
+    }
+
+    InputRecord record;
+    record.timestamp = model::TimeMs{timestamp};
+
+    switch(static_cast<InputRecord::Type>(type)) {
+        case InputRecord::Type::JOIN: {
+            if(!(in >> record.player_id) || !ReadSized(in, record.map_id, line.size())) {
+                ThrowMalformed(line_num, "bad join record"sv);
+            }
+            if(!ReadSized(in, record.dog_name, line.size())) {
+                ThrowMalformed(line_num, "dog name is cut short"sv);
+            }
+            if(std::string token_hex; in >> token_hex) {
+                record.token = Token::FromHex(token_hex);
+                if(!record.token) {
+                    ThrowMalformed(line_num, "bad join token"sv);
+                }
+            }
+            break;
+        }
+        case InputRecord::Type::MOVE: {
+            int move = 0;
+            if(!(in >> record.player_id >> move)) {
+                ThrowMalformed(line_num, "bad move record"sv);
+            }
+            record.move = static_cast<char>(move);
+            break;
+        }
+        case InputRecord::Type::TICK: {
+            long long delta = 0;
+            if(!(in >> delta) || delta < 0) {
+                ThrowMalformed(line_num, "bad tick record"sv);
+            }
+            record.delta = model::TimeMs{delta};
+            break;
+        }
+        case InputRecord::Type::RETIRE: {
+            if(!(in >> record.player_id)) {
+                ThrowMalformed(line_num, "bad retire record"sv);
+            }
+            break;
+        }
+        default:
+            ThrowMalformed(line_num, "unknown record type"sv);
+    }
+    record.type = static_cast<InputRecord::Type>(type);
+    return record;
+}
+} // namespace
+
+//=================================================
+//================ InputLogWriter =================
+InputLogWriter::InputLogWriter(const fs::path& path, std::optional<uint64_t> random_seed)
+    : InputLogWriter(std::make_unique<std::ofstream>(path, std::ios::trunc), random_seed) {
+}
+
+InputLogWriter::InputLogWriter(std::unique_ptr<std::ostream> out, std::optional<uint64_t> random_seed)
+    : out_(std::move(out))
+    , start_(Clock::now()) {
+    if(!out_ || !*out_) {
+        throw std::runtime_error("cannot open input log for writing");
+    }
+    *out_ << "seed ";
+    if(random_seed) {
+        *out_ << *random_seed;
+    } else {
+        *out_ << '-';
+    }
+    *out_ << '\n';
+}
+
+InputLogWriter::~InputLogWriter() {
+    if(out_) {
+        out_->flush();
+    }
+}
+
+long long InputLogWriter::Timestamp() const {
+    return std::chrono::duration_cast<model::TimeMs>(Clock::now() - start_).count();
+}
+
+void InputLogWriter::RecordJoin(Player::Id player_id, std::string_view map_id, std::string_view dog_name,
+                                std::optional<Token> token) {
+    *out_ << static_cast<char>(InputRecord::Type::JOIN) << ' ' << Timestamp() << ' ' << player_id << ' '
+          << map_id.size() << ' ' << map_id << ' ' << dog_name.size() << ' ' << dog_name;
+    if(token) {
+        *out_ << ' ' << token->ToHex();
+    }
+    *out_ << '\n';
+}
+
+void InputLogWriter::RecordMove(Player::Id player_id, char move) {
+    *out_ << static_cast<char>(InputRecord::Type::MOVE) << ' ' << Timestamp() << ' ' << player_id << ' '
+          << static_cast<int>(move) << '\n';
+}
+
+void InputLogWriter::RecordTick(model::TimeMs delta_t) {
+    *out_ << static_cast<char>(InputRecord::Type::TICK) << ' ' << Timestamp() << ' ' << delta_t.count() << '\n';
+}
+
+void InputLogWriter::RecordRetire(Player::Id player_id) {
+    *out_ << static_cast<char>(InputRecord::Type::RETIRE) << ' ' << Timestamp() << ' ' << player_id << '\n';
+}
+
+void InputLogWriter::Flush() {
+    out_->flush();
+}
+
+//=================================================
+//================ Reading ========================
+InputLog ReadInputLog(std::istream& in) {
+    InputLog log;
+
+    std::string line;
+    if(!std::getline(in, line) || !line.starts_with("seed "sv)) {
+        ThrowMalformed(1, "expected seed header"sv);
+    }
+    if(const auto seed = line.substr(5); seed != "-"sv) {
+        try {
+            log.random_seed = std::stoull(seed);
+        } catch(const std::exception&) {
+            ThrowMalformed(1, "bad seed"sv);
+        }
+    }
+
+    for(size_t line_num = 2; std::getline(in, line); ++line_num) {
+        if(line.empty() || in.eof()) {
+            continue;
+        }
+        log.records.push_back(ParseRecord(line, line_num));
+    }
+    return log;
+}
+
+InputLog ReadInputLog(const fs::path& path) {
+    std::ifstream in(path);
+    if(!in) {
+        throw std::runtime_error("cannot open input log: "s + path.string());
+    }
+    return ReadInputLog(in);
+}
+
+//=================================================
+//================ Replay =========================
+double ReplayStats::TicksPerSec() const {
+    const double seconds = std::chrono::duration<double>(wall_time).count();
+    return seconds > 0 ? static_cast<double>(ticks) / seconds : 0.0;
+}
+
+ReplayStats ReplayInputLog(GameInterface& game_app, const InputLog& log) {
+    ReplayStats stats;
+    //Recorded ids -> players of this run
+    std::unordered_map<Player::Id, ConstPlayerPtr> players;
+
+    game_app.EnableTickProfiling(true);
+    const auto start = Clock::now();
+
+    for(const auto& record : log.records) {
+        switch(record.type) {
+            case InputRecord::Type::JOIN: {
+                if(!game_app.GetMap(record.map_id)) {
+                    ++stats.skipped;
+                    break;
+                }
+                const auto result = game_app.JoinGame(record.map_id, record.dog_name);
+                players[record.player_id] = game_app.FindPlayerByToken(*result.token);
+                ++stats.joins;
+                break;
+            }
+            case InputRecord::Type::MOVE: {
+                const auto player_it = players.find(record.player_id);
+                if(player_it == players.end() || !game_app.MoveCommandValid(record.move)) {
+                    ++stats.skipped;
+                    break;
+                }
+                game_app.SetPlayerMovement(player_it->second, record.move);
+                ++stats.moves;
+                break;
+            }
+            case InputRecord::Type::TICK: {
+                const auto tick_start = Clock::now();
+                game_app.AdvanceGameTime(record.delta);
+                stats.tick_time += Clock::now() - tick_start;
+                stats.game_time += record.delta;
+                ++stats.ticks;
+                break;
+            }
+            case InputRecord::Type::RETIRE:
+                //The ticks retire players by themselves
+                break;
+        }
+        stats.recorded_time = record.timestamp;
+    }
+
+    stats.wall_time = Clock::now() - start;
+    stats.phases = game_app.GetTickPhaseTimes();
+    game_app.EnableTickProfiling(false);
+    return stats;
+}
+
+ReplayStats RecoverFromInputLog(PlayerSessionManager& psm, const InputLog& log) {
+    ReplayStats stats;
+    //Retired by the last replayed tick
+    std::unordered_set<Player::Id> retired;
+
+    const auto start = Clock::now();
+    for(const auto& record : log.records) {
+        switch(record.type) {
+            case InputRecord::Type::JOIN: {
+                const Map::Id map_id{record.map_id};
+                if(!record.token || !psm.GetGame()->FindMap(map_id)) {
+                    ++stats.skipped;
+                    break;
+                }
+                const auto player = psm.CreatePlayer(map_id, Dog::Tag{record.dog_name}, *record.token);
+                if(player->GetId() != record.player_id) {
+                    ++stats.diverged;
+                }
+                ++stats.joins;
+                break;
+            }
+            case InputRecord::Type::MOVE: {
+                const auto player_it = psm.GetAllPlayers().find(record.player_id);
+                if(player_it == psm.GetAllPlayers().end()) {
+                    ++stats.skipped;
+                    break;
+                }
+                player_it->second.SetDirection(static_cast<model::Direction>(record.move));
+                ++stats.moves;
+                break;
+            }
+            case InputRecord::Type::TICK: {
+                retired.clear();
+                for(const auto& player : psm.AdvanceTime(record.delta)) {
+                    retired.insert(player.id);
+                }
+                stats.game_time += record.delta;
+                ++stats.ticks;
+                break;
+            }
+            case InputRecord::Type::RETIRE:
+                if(!retired.contains(record.player_id)) {
+                    ++stats.diverged;
+                }
+                ++stats.retirements;
+                break;
+        }
+        stats.recorded_time = record.timestamp;
+    }
+    stats.wall_time = Clock::now() - start;
+    return stats;
+}
+
+} // namespace app
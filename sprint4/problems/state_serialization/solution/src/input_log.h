@@ -0,0 +1,117 @@
+#pragma once
+#include <chrono>
+#include <filesystem>
+#include <iosfwd>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "application.h"
+
+namespace app {
+namespace fs = std::filesystem;
+
+//=================================================
+//================ Input log ======================
+//Everything that drives the simulation from outside: joins, moves and tick deltas.
+//With the same seed, replaying the log through a fresh GameInterface simulates exactly the same game.
+//The state log between checkpoints adds join tokens and retirements, the outcomes clients already saw
+struct InputRecord {
+    enum class Type : char {
+        JOIN = 'J',
+        MOVE = 'M',
+        TICK = 'T',
+        RETIRE = 'R',
+    };
+
+    Type type = Type::TICK;
+    //Wall time since recording started, only informational on replay
+    model::TimeMs timestamp{0};
+
+    //JOIN, MOVE, RETIRE. Id the player got when the log was recorded
+    Player::Id player_id = 0;
+    //MOVE
+    char move = 0;
+    //TICK
+    model::TimeMs delta{0};
+    //JOIN
+    std::string map_id;
+    std::string dog_name;
+    //JOIN, optional
+    std::optional<Token> token;
+};
+
+struct InputLog {
+    std::optional<uint64_t> random_seed;
+    std::vector<InputRecord> records;
+};
+
+//Text format, one record per line:
+//  seed <n>|-
+//  J <ts> <player_id> <map_id_len> <map_id> <name_len> <name>[ <token hex>]
+//  M <ts> <player_id> <move char code>
+//  T <ts> <delta>
+//  R <ts> <player_id>
+//Calls must not overlap, GameInterface makes them from the api strand
+class InputLogWriter {
+public:
+    //Throws std::runtime_error if the file cannot be opened
+    InputLogWriter(const fs::path& path, std::optional<uint64_t> random_seed);
+    InputLogWriter(std::unique_ptr<std::ostream> out, std::optional<uint64_t> random_seed);
+    ~InputLogWriter();
+
+    void RecordJoin(Player::Id player_id, std::string_view map_id, std::string_view dog_name,
+                    std::optional<Token> token = std::nullopt);
+    void RecordMove(Player::Id player_id, char move);
+    void RecordTick(model::TimeMs delta_t);
+    void RecordRetire(Player::Id player_id);
+
+    void Flush();
+
+private:
+    std::unique_ptr<std::ostream> out_;
+    std::chrono::steady_clock::time_point start_;
+
+    long long Timestamp() const;
+};
+
+using InputLogWriterPtr = std::shared_ptr<InputLogWriter>;
+
+//Throws std::runtime_error on a malformed log. A last line without its newline was cut short
+//by a crash while being written and is dropped
+InputLog ReadInputLog(std::istream& in);
+InputLog ReadInputLog(const fs::path& path);
+
+
+//=================================================
+//================ Replay =========================
+struct ReplayStats {
+    size_t joins = 0;
+    size_t moves = 0;
+    size_t ticks = 0;
+    size_t retirements = 0;
+    //Joins to unknown maps and moves of players that never joined
+    size_t skipped = 0;
+    //Recovery only: joins that got other ids and retirements that did not happen on replay
+    size_t diverged = 0;
+
+    model::TimeMs game_time{0};
+    model::TimeMs recorded_time{0};
+    std::chrono::nanoseconds wall_time{0};
+    //Only inside AdvanceGameTime
+    std::chrono::nanoseconds tick_time{0};
+    TickPhaseTimes phases;
+
+    double TicksPerSec() const;
+};
+
+//Feeds the log through game_app as fast as possible. game_app should be fresh and seeded like the log
+ReplayStats ReplayInputLog(GameInterface& game_app, const InputLog& log);
+
+//Applies a state log on top of the checkpoint it continues. The checkpoint carries the random state
+//and id counters, so the ticks retire the same players and joins get the ids and tokens they had
+ReplayStats RecoverFromInputLog(PlayerSessionManager& psm, const InputLog& log);
+
+} // namespace app
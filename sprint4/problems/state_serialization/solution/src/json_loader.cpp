@@ -5,6 +5,7 @@
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
+#include <vector>
 
 namespace json_loader {
 
@@ -113,7 +114,7 @@ std::string PrintMap(const Map& map) {
     return ss.str();
 }
 
-json::object MakePlayerListJson(const std::vector<app::ConstPlayerPtr>& players) {
+json::object MakePlayerListJson(std::span<const app::ConstPlayerPtr> players) {
     json::object player_list;
     for(const auto& p_ptr : players) {
         player_list.emplace(std::to_string(p_ptr->GetId()),
@@ -125,7 +126,7 @@ json::object MakePlayerListJson(const std::vector<app::ConstPlayerPtr>& players)
     return player_list;
 }
 
-json::object MakePlayerStateJson(const std::vector<app::ConstPlayerPtr>& players) {
+json::object MakePlayerStateJson(std::span<const app::ConstPlayerPtr> players) {
     json::object player_state;
     for(const auto& player : players) {
         const auto& dog = player->GetDog();
@@ -148,8 +149,8 @@ json::object MakeLostObjectsJson(const LootObjContainer& loot_objects) {
     for(const auto& item : loot_objects) {
 
         loot_jobj.emplace(std::to_string(num++), json::object{
-                              {"type", item->GetType()},
-                              {"pos", json::value_from(item->GetPos()).as_array()}
+                              {"type", item.GetType()},
+                              {"pos", json::value_from(item.GetPos()).as_array()}
                           }
         );
     }
@@ -175,7 +176,7 @@ json::value MapToValue(const Map& map) {
     return jv;
 }
 
-std::string PrintPlayerList(const std::vector<app::ConstPlayerPtr>& players) {
+std::string PrintPlayerList(std::span<const app::ConstPlayerPtr> players) {
     std::stringstream ss;
     print_json(ss, std::move(MakePlayerListJson(players)));
 
@@ -195,30 +196,89 @@ std::string PrintGameState(app::ConstPlayerPtr& player, const std::shared_ptr<ap
     return ss.str();
 }
 
+std::string PrintGameState(app::ConstPlayerPtr& player, const std::shared_ptr<app::GameInterface>& game_app,
+                           double view_radius) {
+    const auto visible = game_app->GetSession(player)->FindVisible(*player, view_radius);
+    const auto& loot_items = game_app->GetLootList(player);
+
+    //Keys are positions in the full list, so an item keeps its key whether filtered or not
+    json::object lost_objects;
+    for(const auto idx : visible.loot) {
+        const auto& item = loot_items[idx];
+        lost_objects.emplace(std::to_string(idx), json::object{
+                                 {"type", item.GetType()},
+                                 {"pos", json::value_from(item.GetPos()).as_array()}
+                             }
+        );
+    }
+
+    std::stringstream ss;
+    json::object game_state;
+    game_state.emplace("players", MakePlayerStateJson(visible.players));
+    game_state.emplace("lostObjects", std::move(lost_objects));
+
+    print_json(ss, game_state);
+    return ss.str();
+}
+
+std::string PrintRecords(std::span<const app::PlayerRecord> records) {
+    json::array records_js;
+    records_js.reserve(records.size());
+    for(const auto& record : records) {
+        records_js.push_back(json::object{
+            {"name", record.name},
+            {"score", record.score},
+            {"playTime", util::ConvertMsecToSec(record.play_time)}
+        });
+    }
+    std::stringstream ss;
+    print_json(ss, records_js);
+    return ss.str();
+}
+
+std::string PrintLiveTop(std::span<const app::LiveTop::Entry> entries) {
+    json::array top_js;
+    top_js.reserve(entries.size());
+    for(const auto& entry : entries) {
+        top_js.push_back(json::object{
+            {"playerId", entry.player_id},
+            {"name", *entry.name},
+            {"score", entry.score}
+        });
+    }
+    std::stringstream ss;
+    print_json(ss, top_js);
+    return ss.str();
+}
+
 Map ParseMap(const json::value& map_json) {
     //if keys can be absent, use 'if (const auto ptr = map_obj.if_contains())'
     Map map = value_to<Map>(map_json);
     const auto& map_obj = map_json.as_object();
+    const auto& roads = map_obj.at(JsonKeys::roads).as_array();
+    const auto& buildings = map_obj.at(JsonKeys::buildings).as_array();
+    const auto& offices = map_obj.at(JsonKeys::offices).as_array();
+    map.Reserve(roads.size(), buildings.size(), offices.size());
 
     //Add roads
-    for(const auto& road_jv : map_json.at(JsonKeys::roads).as_array()) {
+    for(const auto& road_jv : roads) {
         map.AddRoad(value_to<Road>(road_jv));
     }
 
     //Add buildings
-    for(const auto& bld_jv : map_json.at(JsonKeys::buildings).as_array()) {
+    for(const auto& bld_jv : buildings) {
         map.AddBuilding(value_to<Building>(bld_jv));
     }
 
     //Add offices
-    for(const auto& offc_jv : map_json.at(JsonKeys::offices).as_array()) {
+    for(const auto& offc_jv : offices) {
         map.AddOffice(value_to<Office>(offc_jv));
     }
 
-    //Add LootItem info
-    const auto loot_info_json_ptr = map_json.as_object().if_contains(JsonKeys::loot_types);
+    //Add LootItem info. Copied out of the config arena, the map outlives it
+    const auto loot_info_json_ptr = map_obj.if_contains(JsonKeys::loot_types);
     if(loot_info_json_ptr) {
-        map.AddLootInfo(std::move(loot_info_json_ptr->as_array()));
+        map.AddLootInfo(json::array(loot_info_json_ptr->as_array(), json::storage_ptr{}));
     } else {
         //empty array
         map.AddLootInfo(json::array{});
@@ -237,9 +297,17 @@ void ProcessOptionalMapParams(const json::value& map_json, Map& map, const Game&
     if(auto it = map_obj.find(JsonKeys::bag_cap); it != map_obj.end()) {
         map.SetBagCapacity(it->value().as_int64());
     }
+    //Area of interest for /state, if specified in config
+    if(auto it = map_obj.find(JsonKeys::view_radius); it != map_obj.end()) {
+        const auto radius = it->value().to_number<double>();
+        if(!(radius > 0)) {
+            throw std::invalid_argument("viewRadius must be positive");
+        }
+        map.SetViewRadius(radius);
+    }
 }
 
-void ProcessOptionalGameParams(const json::object game_obj, Game& game) {
+void ProcessOptionalGameParams(const json::object& game_obj, Game& game) {
     //Modify default speed, if specified in config
     if(auto it = game_obj.find(JsonKeys::dog_speed_dflt); it != game_obj.end()) {
         game.ModifyDefaultDogSpeed(it->value().as_double());
@@ -250,6 +318,21 @@ void ProcessOptionalGameParams(const json::object game_obj, Game& game) {
         game.ModifyDefaultBagCapacity(it->value().as_int64());
     }
 
+    //Split busy maps into several sessions, if specified in config
+    if(auto it = game_obj.find(JsonKeys::max_dogs_per_session); it != game_obj.end()) {
+        const auto max_dogs = it->value().as_int64();
+        //0 is no cap, a negative value would wrap to a huge one
+        if(max_dogs < 0) {
+            throw std::invalid_argument("maxDogsPerSession must not be negative");
+        }
+        game.SetMaxDogsPerSession(static_cast<size_t>(max_dogs));
+    }
+
+    //Idle time before a dog leaves the game, in seconds in json
+    if(auto it = game_obj.find(JsonKeys::dog_retirement_time); it != game_obj.end()) {
+        game.SetDogRetirementTime(util::ConvertSecToMsec(it->value().to_number<double>()));
+    }
+
     //LootItem gen config
     if(auto it = game_obj.find(JsonKeys::loot_gen); it != game_obj.end()) {
         //NB: Currently period is given as a double in seconds in json! Converting to chrono::duration in msec
@@ -259,47 +342,98 @@ void ProcessOptionalGameParams(const json::object game_obj, Game& game) {
     }
 }
 
-const char ParseMove(const std::string& request_body) {
-    auto j_obj = json::parse(request_body).as_object();
-    if(auto it = j_obj.find("move"); it != j_obj.end()) {
-        auto mv_cmd = it->value().as_string();
-        return mv_cmd.empty() ? char{} : mv_cmd[0];
-    }
-    throw std::invalid_argument("cannot parse move command");
+const char ParseMove(std::string_view request_body) {
+    return ParseRequestBody(request_body, [](const json::value& body) {
+        const json::object& j_obj = body.as_object();
+        if(auto it = j_obj.find("move"); it != j_obj.end()) {
+            const json::string& mv_cmd = it->value().as_string();
+            return mv_cmd.empty() ? char{} : mv_cmd[0];
+        }
+        throw std::invalid_argument("cannot parse move command");
+    });
 }
 
 //Return time in seconds, assume timeDelta is always in ms
-model::TimeMs ParseTick(const std::string& request_body) {
-    auto j_obj = json::parse(request_body).as_object();
-    if(!j_obj.at("timeDelta").as_int64()) {
-        throw std::invalid_argument("expected a number for time");
-    }
-    return model::TimeMs{j_obj.at("timeDelta").as_int64()};
+model::TimeMs ParseTick(std::string_view request_body) {
+    return ParseRequestBody(request_body, [](const json::value& body) {
+        const auto time_delta = body.as_object().at("timeDelta").as_int64();
+        if(!time_delta) {
+            throw std::invalid_argument("expected a number for time");
+        }
+        return model::TimeMs{time_delta};
+    });
+}
+
+std::optional<JoinRequest> ParseJoin(std::string_view request_body) {
+    //Names are copied out of the stack document, the player keeps them anyway
+    return ParseRequestBody(request_body, [](const json::value& body) -> std::optional<JoinRequest> {
+        const json::object& player_data = body.as_object();
+        const auto* map_id = player_data.if_contains("mapId");
+        const auto* user_name = player_data.if_contains("userName");
+        if(!map_id || !map_id->is_string() || !user_name || !user_name->is_string()) {
+            return std::nullopt;
+        }
+        const json::string& map_id_str = map_id->get_string();
+        const json::string& user_name_str = user_name->get_string();
+        return JoinRequest{std::string(map_id_str.data(), map_id_str.size()),
+                           std::string(user_name_str.data(), user_name_str.size())};
+    });
 }
 
-model::Game LoadGame(const std::filesystem::path& json_path) {
-    try {
-        // Загрузить содержимое файла json_path, например, в виде строки
-        std::ifstream input_file(json_path);
-        std::string input(std::istreambuf_iterator<char>(input_file), {});
+namespace {
+constexpr size_t CONFIG_READ_CHUNK = 1u << 16;
 
-        // Распарсить строку как JSON, используя boost::json::parse
-        auto game_config_json = json::parse(input);
+//Values are allocated from storage, the file is never held as a whole
+json::value ParseConfig(const std::filesystem::path& json_path, json::storage_ptr storage, size_t& bytes_read) {
+    std::ifstream input_file(json_path, std::ios_base::binary);
+    if(!input_file) {
+        throw std::runtime_error("Unable to open config file "s + json_path.string());
+    }
 
-        const auto map_array_ptr = game_config_json.as_object().if_contains(JsonKeys::maps);
-        if(!map_array_ptr) {
-            throw std::logic_error("No maps found in json file");
-        }
+    json::stream_parser parser;
+    parser.reset(std::move(storage));
+    std::vector<char> chunk(CONFIG_READ_CHUNK);
+    while(input_file.read(chunk.data(), static_cast<std::streamsize>(chunk.size())) || input_file.gcount() > 0) {
+        const auto size = static_cast<size_t>(input_file.gcount());
+        parser.write(chunk.data(), size);
+        bytes_read += size;
+    }
+    parser.finish();
+    return parser.release();
+}
+} // namespace
 
-        // Загрузить модель игры из файла
+model::Game LoadGame(const std::filesystem::path& json_path, LoadStats* stats) {
+    try {
+        using Clock = std::chrono::steady_clock;
+        LoadStats load_stats;
         Game game;
-        ProcessOptionalGameParams(game_config_json.as_object(), game);
+        {
+            //Nothing in the config is freed before the end, so it all goes into one arena, released in one step
+            json::monotonic_resource arena;
+            const auto start = Clock::now();
+            const auto game_config_json = ParseConfig(json_path, &arena, load_stats.config_bytes);
+            const auto parsed = Clock::now();
+            load_stats.parse_time = parsed - start;
+
+            const auto map_array_ptr = game_config_json.as_object().if_contains(JsonKeys::maps);
+            if(!map_array_ptr) {
+                throw std::logic_error("No maps found in json file");
+            }
+
+            // Загрузить модель игры из файла
+            ProcessOptionalGameParams(game_config_json.as_object(), game);
 
-        for(const auto& json_map : map_array_ptr->as_array()) {
-            auto new_map = ParseMap(json_map);
+            for(const auto& json_map : map_array_ptr->as_array()) {
+                auto new_map = ParseMap(json_map);
 
-            ProcessOptionalMapParams(json_map, new_map, game);
-            game.AddMap(std::move(new_map));
+                ProcessOptionalMapParams(json_map, new_map, game);
+                game.AddMap(std::move(new_map));
+            }
+            load_stats.build_time = Clock::now() - parsed;
+        }
+        if(stats) {
+            *stats = load_stats;
         }
         return game;
     }
@@ -3,9 +3,14 @@
 //#define BOOST_JSON_STANDALONE
 
 #include <boost/json.hpp>
+#include <chrono>
 #include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
 
 #include "application.h"
+#include "leaderboard.h"
 
 namespace json_loader {
 namespace json = boost::json;
@@ -21,9 +26,12 @@ struct JsonKeys {
     static constexpr Key loot_types = "lootTypes";
     static constexpr Key dog_speed = "dogSpeed";
     static constexpr Key bag_cap = "bagCapacity";
+    static constexpr Key view_radius = "viewRadius";
 
     static constexpr Key dog_speed_dflt = "defaultDogSpeed";
     static constexpr Key bag_cap_dflt = "defaultBagCapacity";
+    static constexpr Key max_dogs_per_session = "maxDogsPerSession";
+    static constexpr Key dog_retirement_time = "dogRetirementTime";
 };
 
 json::value MapToValue(const model::Map& map);
@@ -31,13 +39,51 @@ json::value MapToValue(const model::Map& map);
 std::string PrintMap(const model::Map& map);
 std::string PrintMapList(const model::Game::Maps& map_list);
 
-const char ParseMove(const std::string& request_body);
-model::TimeMs ParseTick(const std::string& request_body);
+//Request bodies are a few dozen bytes, their document is built in a stack buffer.
+//Only a body that does not fit there goes to the heap
+constexpr size_t REQUEST_BODY_BUFFER_SIZE = 2048;
+
+//Calls fn(const json::value&) with the parsed body and returns what it returns, the document dies with the call.
+//Malformed json throws the same as json::parse
+template<typename Fn>
+auto ParseRequestBody(std::string_view request_body, Fn&& fn) {
+    unsigned char buffer[REQUEST_BODY_BUFFER_SIZE];
+    json::monotonic_resource arena{buffer, sizeof(buffer)};
+    const json::value body = json::parse(json::string_view{request_body.data(), request_body.size()}, &arena);
+    return fn(body);
+}
+
+const char ParseMove(std::string_view request_body);
+model::TimeMs ParseTick(std::string_view request_body);
 
-std::string PrintPlayerList(const std::vector<app::ConstPlayerPtr>& players);
+struct JoinRequest {
+    std::string map_id;
+    std::string user_name;
+};
+//Empty when mapId or userName is missing or not a string.
+//Malformed json, or a body that is not an object, throws like the other bodies
+std::optional<JoinRequest> ParseJoin(std::string_view request_body);
+
+std::string PrintPlayerList(std::span<const app::ConstPlayerPtr> players);
 std::string PrintGameState(app::ConstPlayerPtr& player, const std::shared_ptr<app::GameInterface>& game_app);
+//Only what lies within view_radius of the player's dog
+std::string PrintGameState(app::ConstPlayerPtr& player, const std::shared_ptr<app::GameInterface>& game_app,
+                           double view_radius);
+
+//Play time in seconds
+std::string PrintRecords(std::span<const app::PlayerRecord> records);
+std::string PrintLiveTop(std::span<const app::LiveTop::Entry> entries);
+
+struct LoadStats {
+    size_t config_bytes = 0;
+    std::chrono::nanoseconds parse_time{0};
+    //Maps built from the parsed config and compiled
+    std::chrono::nanoseconds build_time{0};
+};
 
-model::Game LoadGame(const std::filesystem::path& json_path);
+//The config is parsed in chunks as it is read, into an arena released as soon as the maps are built.
+//On error logs it and returns an empty game
+model::Game LoadGame(const std::filesystem::path& json_path, LoadStats* stats = nullptr);
 } // namespace json_loader
 
 
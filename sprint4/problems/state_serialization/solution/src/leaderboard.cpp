@@ -0,0 +1,88 @@
+#include "leaderboard.h"
+
+#include <algorithm>
+#include <optional>
+
+namespace app {
+
+bool RecordOrder::operator()(const PlayerRecord& lhs, const PlayerRecord& rhs) const {
+    if (lhs.score != rhs.score) {
+        return lhs.score > rhs.score;
+    }
+    if (lhs.play_time != rhs.play_time) {
+        return lhs.play_time < rhs.play_time;
+    }
+    return lhs.name < rhs.name;
+}
+
+Leaderboard::Leaderboard(size_t capacity, PageLoader loader)
+    : capacity_(capacity)
+    , loader_(std::move(loader)) {
+    top_.reserve(capacity_);
+}
+
+void Leaderboard::Warm(std::vector<PlayerRecord> records) {
+    std::ranges::sort(records, RecordOrder{});
+
+    std::lock_guard lock{mtx_};
+    //A full cache may have more below it
+    has_all_ = records.size() < capacity_;
+    records.resize(std::min(records.size(), capacity_));
+    top_ = std::move(records);
+}
+
+void Leaderboard::Add(std::span<const RetiredPlayer> retired) {
+    std::lock_guard lock{mtx_};
+    for (const auto& player : retired) {
+        Insert({*player.name, player.score, player.play_time});
+    }
+}
+
+std::vector<PlayerRecord> Leaderboard::GetPage(size_t start, size_t max_items) const {
+    std::vector<PlayerRecord> page;
+    std::optional<PlayerRecord> last_cached;
+    size_t skip = 0;
+    {
+        std::lock_guard lock{mtx_};
+        if (start < top_.size()) {
+            const auto first = top_.begin() + static_cast<ptrdiff_t>(start);
+            page.assign(first, first + static_cast<ptrdiff_t>(std::min(max_items, top_.size() - start)));
+        }
+        if (page.size() == max_items || has_all_ || !loader_) {
+            return page;
+        }
+        //The store is read from the last cached record on, not at an offset of the cache size:
+        //records it has not got yet, or dropped, would shift every deep page
+        if (!top_.empty()) {
+            last_cached = top_.back();
+        }
+        skip = start > top_.size() ? start - top_.size() : 0;
+    }
+
+    //Deep page, the query runs without the lock
+    auto rest = loader_(last_cached ? &*last_cached : nullptr, skip, max_items - page.size());
+    std::move(rest.begin(), rest.end(), std::back_inserter(page));
+    return page;
+}
+
+size_t Leaderboard::GetCachedCount() const {
+    std::lock_guard lock{mtx_};
+    return top_.size();
+}
+
+void Leaderboard::Insert(PlayerRecord record) {
+    const auto pos = std::ranges::upper_bound(top_, record, RecordOrder{});
+    if (top_.size() < capacity_) {
+        top_.insert(pos, std::move(record));
+        return;
+    }
+    has_all_ = false;
+    if (pos != top_.end()) {
+        //pop_back invalidates pos when it points at the last record
+        const auto idx = pos - top_.begin();
+        top_.pop_back();
+        top_.insert(top_.begin() + idx, std::move(record));
+    }
+}
+
+} // namespace app
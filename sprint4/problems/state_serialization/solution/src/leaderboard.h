@@ -0,0 +1,61 @@
+#pragma once
+#include <functional>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "application.h"
+
+namespace app {
+
+//=================================================
+//================ Leaderboard ====================
+struct PlayerRecord {
+    std::string name;
+    model::Score score = 0;
+    model::TimeMs play_time{0};
+
+    auto operator<=>(const PlayerRecord&) const = default;
+};
+
+//Leaderboard order: score desc, then play time, then name
+struct RecordOrder {
+    bool operator()(const PlayerRecord& lhs, const PlayerRecord& rhs) const;
+};
+
+//Best `capacity` records of all time kept sorted in memory, so pages at the top cost no query.
+//Pages past the cache go to the loader. Safe to use from any thread
+class Leaderboard {
+public:
+    //Returns up to max_items records in leaderboard order that come strictly after `after`
+    //(from the very top when it is null), the first `skip` of them left out. May throw
+    using PageLoader = std::function<std::vector<PlayerRecord>(const PlayerRecord* after, size_t skip, size_t max_items)>;
+
+    //Without a loader the cache is all there is
+    explicit Leaderboard(size_t capacity, PageLoader loader = nullptr);
+
+    //Top of the stored records, read once at startup
+    void Warm(std::vector<PlayerRecord> records);
+    void Add(std::span<const RetiredPlayer> retired);
+
+    std::vector<PlayerRecord> GetPage(size_t start, size_t max_items) const;
+
+    size_t GetCachedCount() const;
+
+private:
+    const size_t capacity_;
+    PageLoader loader_;
+
+    mutable std::mutex mtx_;
+    //Sorted by RecordOrder. Reads are far more frequent than retirements, so it is a vector, not a tree
+    std::vector<PlayerRecord> top_;
+    //False once something fell out of the cache, from then on only the loader knows what lies below it
+    bool has_all_ = true;
+
+    void Insert(PlayerRecord record);
+};
+
+using LeaderboardPtr = std::shared_ptr<Leaderboard>;
+
+} // namespace app
@@ -0,0 +1,63 @@
+#include "live_top.h"
+
+#include <algorithm>
+
+namespace app {
+
+namespace {
+bool Before(const LiveTop::Entry& lhs, const LiveTop::Entry& rhs) {
+    return lhs.score != rhs.score ? lhs.score > rhs.score : lhs.player_id < rhs.player_id;
+}
+} // namespace
+
+LiveTop::LiveTop(size_t capacity)
+    : capacity_(capacity) {
+    entries_.reserve(capacity_ + 1);
+}
+
+void LiveTop::Update(size_t player_id, const model::Dog::Tag& name, model::Score score) {
+    Entry entry{player_id, name, score};
+
+    auto it = std::ranges::find(entries_, player_id, &Entry::player_id);
+    if (it == entries_.end()) {
+        if (entries_.size() == capacity_ && (capacity_ == 0 || !Before(entry, entries_.back()))) {
+            return;
+        }
+        entries_.push_back(std::move(entry));
+        it = std::prev(entries_.end());
+    } else {
+        it->score = score;
+    }
+
+    //Score went up, move towards the front
+    while (it != entries_.begin() && Before(*it, *std::prev(it))) {
+        std::iter_swap(it, std::prev(it));
+        --it;
+    }
+    if (entries_.size() > capacity_) {
+        entries_.pop_back();
+    }
+}
+
+bool LiveTop::Remove(size_t player_id) {
+    const auto it = std::ranges::find(entries_, player_id, &Entry::player_id);
+    if (it == entries_.end()) {
+        return false;
+    }
+    entries_.erase(it);
+    return true;
+}
+
+void LiveTop::Clear() {
+    entries_.clear();
+}
+
+size_t LiveTop::GetCapacity() const {
+    return capacity_;
+}
+
+std::span<const LiveTop::Entry> LiveTop::GetEntries() const {
+    return entries_;
+}
+
+} // namespace app
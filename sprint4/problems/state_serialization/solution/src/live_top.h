@@ -0,0 +1,35 @@
+#pragma once
+#include <span>
+#include <vector>
+
+#include "model.h"
+
+namespace app {
+
+//Best players on one map right now. Scores only grow while a player is in the game,
+//so an update is a lookup in a few entries and at most one shift
+class LiveTop {
+public:
+    struct Entry {
+        size_t player_id;
+        model::Dog::Tag name;
+        model::Score score;
+    };
+
+    explicit LiveTop(size_t capacity);
+
+    void Update(size_t player_id, const model::Dog::Tag& name, model::Score score);
+    //Returns true if the player was listed: the list is one short until rebuilt
+    bool Remove(size_t player_id);
+    void Clear();
+
+    size_t GetCapacity() const;
+    std::span<const Entry> GetEntries() const;
+
+private:
+    size_t capacity_;
+    //Score desc, then player id
+    std::vector<Entry> entries_;
+};
+
+} // namespace app
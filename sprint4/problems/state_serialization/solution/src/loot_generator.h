@@ -34,6 +34,14 @@ public:
      */
     unsigned Generate(TimeInterval time_delta, unsigned loot_count, unsigned looter_count);
 
+    //For checkpoints, the only state that changes between calls
+    TimeInterval GetTimeWithoutLoot() const {
+        return time_without_loot_;
+    }
+    void SetTimeWithoutLoot(TimeInterval time) {
+        time_without_loot_ = time;
+    }
+
 private:
     static double DefaultGenerator() noexcept {
         return 1.0;
@@ -7,6 +7,10 @@
 #include <thread>
 #include <boost/serialization/serialization.hpp>
 
+#include "input_log.h"
+#include "leaderboard.h"
+#include "postgres.h"
+#include "records_writer.h"
 #include "request_handling.h"
 #include "state_serialization.h"
 
@@ -24,11 +28,22 @@ struct Args {
 
     //Optional params
     int64_t tick_period         = 0;
+    unsigned tick_threads       = 0;
+    unsigned tick_max_steps     = 5;
+    std::string tick_catch_up   = "merge";
+    int64_t tick_max_period     = 0;
     bool randomize_spawn_points = false;
+    bool move_through_junctions = false;
     std::string state_file      = "";
     bool enable_save            = false;
     int64_t save_period         = 0;
     bool enable_periodic_save   = false;
+    bool state_uncompressed     = false;
+    bool state_log              = false;
+    std::optional<uint64_t> random_seed;
+    std::string record_input    = "";
+    std::string replay_input    = "";
+    size_t leaderboard_cache    = 1000;
 };
 
 [[nodiscard]] std::optional<Args> ParseCommandLine(int argc, const char* const argv[]) {
@@ -37,15 +52,27 @@ struct Args {
     po::options_description desc{"All options"s};
 
     Args args;
+    uint64_t random_seed = 0;
     desc.add_options()
         // Добавляем опцию --help и её короткую версию -h
         ("help,h", "Show help")
         ("tick-period,t", po::value(&args.tick_period)->value_name("tick_period"s), "set tick period")
+        ("tick-max-steps", po::value(&args.tick_max_steps)->value_name("steps"s), "max game steps run per timer wakeup, default: 5")
+        ("tick-catch-up", po::value(&args.tick_catch_up)->value_name("skip|merge"s), "when behind by more than tick-max-steps: skip the extra time or merge it into the last step, default: merge")
+        ("tick-max-period", po::value(&args.tick_max_period)->value_name("max_period"s), "let the tick period grow up to this value under sustained overload, also the longest step merge may build")
+        ("tick-threads", po::value(&args.tick_threads)->value_name("num_threads"s), "tick game sessions on this many threads, default: hardware concurrency")
         ("www-root,w", po::value(&args.static_root)->value_name("static_root"s), "set config file path")
         ("config-file,c", po::value(&args.config_path)->value_name("config_path"s), "set static files root")
         ("randomize_spawn_points", po::bool_switch(&args.randomize_spawn_points), "spawn dogs at random positions")
+        ("move-through-junctions", po::bool_switch(&args.move_through_junctions), "keep dogs moving across road junctions within one tick")
         ("state-file,f", po::value(&args.state_file)->value_name("state_file"s), "set save file path")
-        ("save-state-period,p", po::value(&args.save_period)->value_name("save_period"s), "set state save interval");
+        ("save-state-period,p", po::value(&args.save_period)->value_name("save_period"s), "set state save interval")
+        ("state-uncompressed", po::bool_switch(&args.state_uncompressed), "write state snapshots without block compression")
+        ("state-log", po::bool_switch(&args.state_log), "log inputs between state saves, restore replays them so a crash loses nothing acknowledged")
+        ("random-seed", po::value(&random_seed)->value_name("seed"s), "seed all game randomness, same seed and inputs give the same game")
+        ("record-input", po::value(&args.record_input)->value_name("log_file"s), "write joins, moves and ticks to an input log")
+        ("replay-input", po::value(&args.replay_input)->value_name("log_file"s), "replay an input log as fast as possible, print timings and exit")
+        ("leaderboard-cache", po::value(&args.leaderboard_cache)->value_name("records"s), "best records kept in memory, deeper pages are read from the database, default: 1000");
 
     // variables_map хранит значения опций после разбора
     po::variables_map vm;
@@ -57,14 +84,22 @@ struct Args {
         std::cout << desc;
     }
 
+    if (vm.contains("random-seed"s)) {
+        args.random_seed = random_seed;
+    }
+
     // Проверяем наличие опций src и dst
-    if (!vm.contains("www-root"s)) {
+    if (!vm.contains("www-root"s) && !vm.contains("replay-input"s)) {
         throw std::runtime_error("Static files path has not been specified"s);
     }
     if (!vm.contains("config-file"s)) {
         throw std::runtime_error("Config file path is not specified"s);
     }
 
+    if (args.tick_catch_up != "merge"s && args.tick_catch_up != "skip"s) {
+        throw std::runtime_error("Unknown tick catch-up mode: "s + args.tick_catch_up);
+    }
+
     // Explicitly set bool if option is given
     args.enable_save          = vm.contains("state-file"s);
     args.enable_periodic_save = vm.contains("save-state-period"s);
@@ -74,6 +109,16 @@ struct Args {
 }
 
 namespace {
+constexpr const char DB_URL_ENV_NAME[]{"GAME_DB_URL"};
+
+//Records of retired players are kept only when the database is configured
+std::optional<std::string> GetDbUrlFromEnv() {
+    if (const auto* url = std::getenv(DB_URL_ENV_NAME)) {
+        return url;
+    }
+    return std::nullopt;
+}
+
 // Запускает функцию fn на n потоках, включая текущий
 template<typename Fn>
 void RunWorkers(unsigned n, const Fn& fn) {
@@ -90,6 +135,47 @@ void RunWorkers(unsigned n, const Fn& fn) {
         t.join();
     }
 }
+
+double ToMs(std::chrono::nanoseconds time) {
+    return std::chrono::duration<double, std::milli>(time).count();
+}
+
+json::object MakeReplayReport(const app::ReplayStats& stats) {
+    const double ticks = stats.ticks ? static_cast<double>(stats.ticks) : 1.0;
+    return {
+        {"joins", stats.joins},
+        {"moves", stats.moves},
+        {"ticks", stats.ticks},
+        {"skipped", stats.skipped},
+        {"gameTimeMs", stats.game_time.count()},
+        {"recordedTimeMs", stats.recorded_time.count()},
+        {"wallTimeMs", ToMs(stats.wall_time)},
+        {"ticksPerSec", stats.TicksPerSec()},
+        {"tickAvgMs", ToMs(stats.tick_time) / ticks},
+        {"phasesMs", {
+            {"move", ToMs(stats.phases.move)},
+            {"collisions", ToMs(stats.phases.collisions)},
+            {"loot", ToMs(stats.phases.loot)},
+            {"retirement", ToMs(stats.phases.retirement)}
+        }}
+    };
+}
+
+//Replays on a fresh game, without saved state, and prints the report to stdout
+void RunReplay(const Args& args) {
+    auto log = app::ReadInputLog(args.replay_input);
+
+    auto game = std::make_shared<model::Game>(json_loader::LoadGame(args.config_path));
+    game->EnableRandomDogSpawn(args.randomize_spawn_points);
+    game->EnableMoveThroughJunctions(args.move_through_junctions);
+    game->SetRandomSeed(args.random_seed ? args.random_seed : log.random_seed);
+
+    net::io_context ioc;
+    app::GameInterface game_app(ioc, game, nullptr);
+    game_app.SetTickThreads(args.tick_threads);
+
+    std::cout << json::serialize(MakeReplayReport(app::ReplayInputLog(game_app, log))) << std::endl;
+}
 } // namespace
 
 int main(int argc, const char* argv[]) {
@@ -115,21 +201,66 @@ int main(int argc, const char* argv[]) {
             throw std::runtime_error("Failed to parse command line arguments");
         }
 
+        if (!args->replay_input.empty()) {
+            RunReplay(*args);
+            return EXIT_SUCCESS;
+        }
+
         // 1. Инициализируем io_context и другие переменные
         const auto num_threads = std::thread::hardware_concurrency();
         net::io_context ioc(static_cast<int>(num_threads));
         auto api_strand          = net::make_strand(ioc);
 
         auto serializer_listener = args->enable_save
-            ? std::make_shared<serialization::StateSerializer>(args->state_file, args->enable_periodic_save, args->save_period)
+            ? std::make_shared<serialization::StateSerializer>(args->state_file, args->enable_periodic_save, args->save_period,
+                                                               serialization::SnapshotOptions{.compress = !args->state_uncompressed},
+                                                               args->state_log)
             : nullptr;
 
         // 2. Загружаем карту из файла, создаем модель и интерфейс (application) игры
-        auto game = std::make_shared<model::Game>(json_loader::LoadGame(args->config_path));
+        json_loader::LoadStats load_stats;
+        auto game = std::make_shared<model::Game>(json_loader::LoadGame(args->config_path, &load_stats));
+        BOOST_LOG_TRIVIAL(info) << logging::add_value(log_message, "config loaded")
+                                << logging::add_value(log_msg_data, json::object{
+                                    {"maps", game->GetMaps().size()},
+                                    {"configBytes", load_stats.config_bytes},
+                                    {"parseMs", ToMs(load_stats.parse_time)},
+                                    {"buildMs", ToMs(load_stats.build_time)},
+                                    {"peakRssKb", util::PeakRssKb()}
+                                });
         game->EnableRandomDogSpawn(args->randomize_spawn_points);
+        game->EnableMoveThroughJunctions(args->move_through_junctions);
+        game->SetRandomSeed(args->random_seed);
 
         // 2.1. При наличии сохраненного состояния, восстанавливаем данные из файла //TODO: Restore throw if unsuccessful
         auto game_app = std::make_shared<app::GameInterface>(ioc, game, serializer_listener);
+        game_app->SetTickThreads(args->tick_threads ? args->tick_threads : num_threads);
+        if (!args->record_input.empty()) {
+            //Replays exactly only when the server started without a saved state
+            game_app->SetInputLog(std::make_shared<app::InputLogWriter>(args->record_input, args->random_seed));
+        }
+
+        // 2.2. Рекорды вышедших игроков пишутся в БД в фоновом потоке, лучшие из них хранятся в памяти
+        app::RecordsWriterPtr records_writer;
+        app::LeaderboardPtr leaderboard;
+        if (const auto db_url = GetDbUrlFromEnv()) {
+            auto records_repository = std::make_shared<postgres::RecordsRepository>(*db_url);
+            records_writer = std::make_shared<app::RecordsWriter>(
+                [records_repository](std::span<const app::RetiredPlayer> records) {
+                    records_repository->SaveBatch(records);
+                });
+            game_app->SetRecordsWriter(records_writer);
+
+            leaderboard = std::make_shared<app::Leaderboard>(args->leaderboard_cache,
+                [records_repository](const app::PlayerRecord* after, size_t skip, size_t max_items) {
+                    return records_repository->LoadRecords(after, skip, max_items);
+                });
+            leaderboard->Warm(records_repository->LoadRecords(nullptr, 0, args->leaderboard_cache));
+        } else {
+            //Records of this run only
+            leaderboard = std::make_shared<app::Leaderboard>(args->leaderboard_cache);
+        }
+        game_app->SetLeaderboard(leaderboard);
 
         // 3. Добавляем асинхронный обработчик сигналов SIGINT и SIGTERM
         net::signal_set signals(ioc, SIGINT, SIGTERM);
@@ -144,7 +275,15 @@ int main(int argc, const char* argv[]) {
         });
 
         //4. Создаем handler и оборачиваем его в логирующий декоратор
-        auto handler = std::make_shared<http_handler::RequestHandler>(args->static_root, api_strand, game_app, model::TimeMs{args->tick_period});
+        util::FixedStepClock::Settings tick_settings;
+        tick_settings.step                 = model::TimeMs{args->tick_period};
+        tick_settings.max_steps_per_wakeup = args->tick_max_steps;
+        tick_settings.catch_up             = args->tick_catch_up == "skip"s
+            ? util::FixedStepClock::CatchUp::SKIP
+            : util::FixedStepClock::CatchUp::MERGE;
+        tick_settings.max_step             = model::TimeMs{args->tick_max_period};
+
+        auto handler = std::make_shared<http_handler::RequestHandler>(args->static_root, api_strand, game_app, tick_settings);
 
         server_logger::LoggingRequestHandler logging_handler{
             [handler](auto&& endpoint, auto&& req, auto&& send) {
@@ -175,6 +314,43 @@ int main(int argc, const char* argv[]) {
         // 7. Созраняем состояние игры при завершении работы программы
         if(serializer_listener) {
             serializer_listener->SaveGameState(game_app->GetPlayerManager());
+
+            const auto save_stats = serializer_listener->GetStats();
+            const auto to_ms = [](std::chrono::nanoseconds time) {
+                return std::chrono::duration<double, std::milli>(time).count();
+            };
+            const auto background_saves = std::max<size_t>(1, save_stats.saves + save_stats.failed);
+            log_server_exit_report["stateSaves"] = json::object{
+                {"saves", save_stats.saves},
+                {"deferred", save_stats.deferred},
+                {"failed", save_stats.failed},
+                {"captureMsMean", to_ms(save_stats.capture_time) / static_cast<double>(background_saves)},
+                {"captureMsMax", to_ms(save_stats.max_capture_time)},
+                {"writeMsMean", to_ms(save_stats.write_time) / static_cast<double>(background_saves)}
+            };
+        }
+        if(records_writer) {
+            records_writer->Flush();
+
+            const auto records_stats = records_writer->GetStats();
+            log_server_exit_report["records"] = json::object{
+                {"written", records_stats.written},
+                {"dropped", records_stats.dropped},
+                {"queueFull", records_stats.queue_full},
+                {"failedAttempts", records_stats.failed_attempts}
+            };
+        }
+        //Workers are joined, the ticker is not running any more
+        if(const auto tick_stats = handler->GetTickStats()) {
+            log_server_exit_report["tick"] = json::object{
+                {"wakeups", tick_stats->wakeups},
+                {"steps", tick_stats->steps},
+                {"overruns", tick_stats->overruns},
+                {"skippedMs", tick_stats->skipped.count()},
+                {"mergedMs", tick_stats->merged.count()},
+                {"lagMs", tick_stats->lag.count()},
+                {"maxLagMs", tick_stats->max_lag.count()}
+            };
         }
     } catch (const std::exception& ex) {
         log_server_exit_report["code"]      = EXIT_FAILURE;
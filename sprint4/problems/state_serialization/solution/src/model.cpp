@@ -22,11 +22,16 @@ Point to_int_pt(Point2D pt_double) {
     return Point(std::round(pt_double.x), std::round(pt_double.y));
 }
 
-//==== Random int generator for use in game model
-int GenRandomNum(int limit1, int limit2) {
-    ///'static' allows to reuse generator in the same thread, since expensive to init
-    static thread_local std::mt19937 gen_local{std::random_device()()};
+namespace {
+///'static' allows to reuse generator in the same thread, since expensive to init
+RandomEngine& LocalRandomGen() {
+    static thread_local RandomEngine gen_local{std::random_device()()};
+    return gen_local;
+}
+} // namespace
 
+//==== Random int generator for use in game model
+int GenRandomNum(RandomEngine& rng, int limit1, int limit2) {
     //when min max are swapped:
     size_t min = std::min(limit1, limit2);
     size_t max = std::max(limit1, limit2);
@@ -37,12 +42,20 @@ int GenRandomNum(int limit1, int limit2) {
     }
     ///distribution is cheap to construct, so no need to reuse
     std::uniform_int_distribution<int> distr(min,max);
-    return distr(gen_local);
+    return distr(rng);
 }
 
-size_t GenRandomNum(size_t limit1, size_t limit2) {
+size_t GenRandomNum(RandomEngine& rng, size_t limit1, size_t limit2) {
     int a = static_cast<int>(limit1), b = static_cast<int>(limit2);
-    return static_cast<size_t>(GenRandomNum(a,b));
+    return static_cast<size_t>(GenRandomNum(rng, a, b));
+}
+
+int GenRandomNum(int limit1, int limit2) {
+    return GenRandomNum(LocalRandomGen(), limit1, limit2);
+}
+
+size_t GenRandomNum(size_t limit1, size_t limit2) {
+    return GenRandomNum(LocalRandomGen(), limit1, limit2);
 }
 
 //=================================================
@@ -74,11 +87,15 @@ Point Road::GetEnd() const {
 }
 
 Point Road::GetRandomPt() const {
+    return GetRandomPt(LocalRandomGen());
+}
+
+Point Road::GetRandomPt(RandomEngine& rng) const {
     if(IsHorizontal()) {
-        auto rand_x = GenRandomNum(start_.x, end_.x);
+        auto rand_x = GenRandomNum(rng, start_.x, end_.x);
         return {static_cast<Coord>(rand_x), start_.y};
     }
-    auto rand_y = GenRandomNum(start_.y, end_.y);
+    auto rand_y = GenRandomNum(rng, start_.y, end_.y);
     return {start_.x, static_cast<Coord>(rand_y)};
     //return {static_cast<Coord>(start_.x, util::random_num(start_.y, end_.y))};
 }
@@ -158,18 +175,6 @@ collision_detector::Item CollisionObject::AsCollisionItem() const {
     return {GetPos(), GetWidth()};
 }
 
-bool CollisionObject::IsCollectible() const {
-    return false;
-}
-
-bool CollisionObject::IsItemsReturn() const {
-    return false;
-}
-
-LootItemInfo CollisionObject::Collect() {
-    return {};
-}
-
 Speed DynamicObject::GetSpeed() const {
     return speed_;
 }
@@ -215,6 +220,10 @@ void DynamicObject::Stop() {
     SetSpeed({0.0, 0.0});
 }
 
+bool DynamicObject::IsMoving() const {
+    return speed_ != Speed{0.0, 0.0};
+}
+
 Point2D DynamicObject::ComputeMoveEndPoint(TimeMs delta_t) const {
     //converts to seconds
     double delta_t_sec = std::chrono::duration<double>(delta_t).count();
@@ -239,8 +248,8 @@ Score LootItem::GetValue() const {
     return value_;
 }
 
-bool LootItem::IsCollectible() const {
-    return true;
+bool LootItem::IsCollected() const {
+    return is_collected_;
 }
 
 LootItemInfo LootItem::Collect() {
@@ -260,10 +269,6 @@ ItemsReturnPoint::ItemsReturnPoint(GameObject::Id id, const Office& office, doub
 , tag_(office.GetId()) {
 }
 
-bool ItemsReturnPoint::IsItemsReturn() const {
-    return true;
-}
-
 
 //=================================================
 //=================== Dog =========================
@@ -277,6 +282,7 @@ Dog::Dog(Id id, Point2D pos, double width, Tag tag, size_t bag_cap)
     : DynamicObject(id, pos, width)
     , tag_(std::move(tag))
     , bag_capacity_(bag_cap) {
+    bag_.reserve(bag_capacity_);
 }
 
 Dog::Tag Dog::GetTag() const {
@@ -285,6 +291,7 @@ Dog::Tag Dog::GetTag() const {
 
 Dog& Dog::SetBagCap(size_t capacity) {
     bag_capacity_ = capacity;
+    bag_.reserve(bag_capacity_);
     return *this;
 }
 
@@ -297,6 +304,20 @@ bool Dog::TryCollectItem(LootItemInfo loot_info) {
     return true;
 }
 
+bool Dog::TryCollectItem(LootItem& item) {
+    if(BagIsFull()) {
+        return false;
+    }
+    return TryCollectItem(item.Collect());
+}
+
+void Dog::ReturnItems() {
+    for(const auto& item : bag_) {
+        AddScore(item.value);
+    }
+    ClearBag();
+}
+
 void Dog::ClearBag() {
     bag_.clear();
 }
@@ -317,6 +338,24 @@ Score Dog::GetScore() const {
     return score_;
 }
 
+TimeMs Dog::GetJoinTime() const {
+    return join_time_;
+}
+
+Dog& Dog::SetJoinTime(TimeMs time) {
+    join_time_ = time;
+    return *this;
+}
+
+std::optional<TimeMs> Dog::GetIdleSince() const {
+    return idle_since_;
+}
+
+Dog& Dog::SetIdleSince(std::optional<TimeMs> time) {
+    idle_since_ = time;
+    return *this;
+}
+
 void Dog::AddScore(Score points) {
     score_ += points;
 }
@@ -329,6 +368,13 @@ Map::Map(Map::Id id, std::string name)
     , name_(std::move(name)) {
 }
 
+void Map::Reserve(size_t num_roads, size_t num_buildings, size_t num_offices) {
+    roads_.reserve(num_roads);
+    buildings_.reserve(num_buildings);
+    offices_.reserve(num_offices);
+    warehouse_id_to_index_.reserve(num_offices);
+}
+
 void Map::AddOffice(Office office) {
     if(warehouse_id_to_index_.contains(office.GetId())) {
         throw std::invalid_argument("Duplicate warehouse");
@@ -346,14 +392,29 @@ void Map::AddOffice(Office office) {
 }
 
 Point2D Map::GetRandomRoadPt() const {
-    auto& random_road = roads_.at(GenRandomNum(roads_.size()));
-    return ToGeomPt(random_road.GetRandomPt());
+    return GetRandomRoadPt(LocalRandomGen());
+}
+
+Point2D Map::GetRandomRoadPt(RandomEngine& rng) const {
+    //Not compiled yet, fall back to a uniform pick
+    const size_t road_idx = road_spawn_table_.Size() == roads_.size() && !roads_.empty()
+        ? road_spawn_table_.Sample(rng)
+        : GenRandomNum(rng, roads_.size());
+    return ToGeomPt(roads_.at(road_idx).GetRandomPt(rng));
 }
 
 const Map::Id& Map::GetId() const {
     return id_;
 }
 
+Map::Index Map::GetIndex() const {
+    return index_;
+}
+
+void Map::SetIndex(Index index) {
+    index_ = index;
+}
+
 const std::string& Map::GetName() const {
     return name_;
 }
@@ -375,11 +436,31 @@ const Map::Offices& Map::GetOffices() const {
 }
 
 void Map::AddRoad(const Road& road) {
-    auto rd = roads_.emplace_back(road);
+    roads_.emplace_back(road);
+}
+
+void Map::BuildRoadIndex() {
+    road_index_.Build(roads_);
+}
+
+const RoadIndex& Map::GetRoadIndex() const {
+    return road_index_;
+}
+
+void Map::Compile() {
+    BuildRoadIndex();
+    BuildSpawnTable();
+}
 
-    //store road start points in index
-    RoadXtoIndex_[rd.GetStart().x].insert(roads_.size() - 1);
-    RoadYtoIndex_[rd.GetStart().y].insert(roads_.size() - 1);
+void Map::BuildSpawnTable() {
+    //Points are picked in [start, end), so a zero length road has none
+    std::vector<double> lengths;
+    lengths.reserve(roads_.size());
+    for(const auto& road : roads_) {
+        lengths.push_back(static_cast<double>(road.GetMaxCoordX() - road.GetMinCoordX()
+                                            + road.GetMaxCoordY() - road.GetMinCoordY()));
+    }
+    road_spawn_table_ = util::AliasTable{lengths};
 }
 
 std::optional<double> Map::GetDogSpeed() const {
@@ -391,61 +472,29 @@ void Map::SetDogSpeed(double speed) {
 }
 
 const Road* Map::FindVertRoad(Point2D point) const {
-    auto it = RoadXtoIndex_.find(static_cast<Coord>(std::round(point.x)));
-    if(it == RoadXtoIndex_.end()) {
-        return nullptr;
-    }
-
-    auto pt_is_on_road = [&](const Road* rd, const Point2D& pt) {
-        Point check{static_cast<Coord>(std::round(pt.x)), static_cast<Coord>(std::round(pt.y))};
-
-        // for equal x's, check if y is within the vertical road
-        return (check.y >= std::min(rd->GetStart().y, rd->GetEnd().y))
-            || (std::max(rd->GetStart().y, rd->GetEnd().x) >= check.y);
-    };
-
-    for(const auto road_idx : it->second) {
-        const auto road = &roads_.at(road_idx);
-        //skip Horizontal roads
-        if(road->IsVertical() && pt_is_on_road(road, point)) {
-            return &roads_.at(road_idx);
-        }
-    }
-    return nullptr;
+    const auto road_idx = road_index_.FindVertRoad(static_cast<Coord>(std::round(point.x)),
+                                                   static_cast<Coord>(std::round(point.y)));
+    return road_idx == RoadIndex::NO_ROAD ? nullptr : &roads_[road_idx];
 }
 
 const Road* Map::FindHorRoad(Point2D point) const {
-    auto pt_is_on_road = [&](const Road* rd, const Point2D& pt) {
-        Point check{static_cast<Coord>(std::round(pt.x)), static_cast<Coord>(std::round(pt.y))};
-        return (check.x >= std::min(rd->GetStart().x, rd->GetEnd().x))
-            && (std::max(rd->GetStart().x, rd->GetEnd().x) >= check.x);
-    };
-
-    auto it = RoadYtoIndex_.find(static_cast<Coord>(std::round(point.y)));
-    if(it == RoadYtoIndex_.end()) {
-        return nullptr;
-    }
-
-    for(const auto road_idx : it->second) {
-        const auto road = &roads_[road_idx];
-
-        //skip vertical roads
-        if(road->IsHorizontal() && pt_is_on_road(road, point)) {
-            return &roads_[road_idx];
-        }
-    }
-    return nullptr;
+    const auto road_idx = road_index_.FindHorRoad(static_cast<Coord>(std::round(point.x)),
+                                                  static_cast<Coord>(std::round(point.y)));
+    return road_idx == RoadIndex::NO_ROAD ? nullptr : &roads_[road_idx];
 }
 
-Map::MoveResult Map::ComputeRoadMove(Point2D start, Point2D end) const {
-    //TODO: on map Town dog sometimes skips to a different road, debug this
+Map::MoveResult Map::ComputeRoadMove(Point2D start, Point2D end, bool through_junctions) const {
     //Case 0: no move
     if(start == end) {
         return {false, end};
     }
 
-    const auto roadV = FindVertRoad(start);
-    const auto roadH = FindHorRoad(start);
+    //Round once, both lookups are on the same integer cell
+    const Point cell = ToIntPt(start);
+    const auto roadV_idx = road_index_.FindVertRoad(cell.x, cell.y);
+    const auto roadH_idx = road_index_.FindHorRoad(cell.x, cell.y);
+    const Road* roadV = roadV_idx == RoadIndex::NO_ROAD ? nullptr : &roads_[roadV_idx];
+    const Road* roadH = roadH_idx == RoadIndex::NO_ROAD ? nullptr : &roads_[roadH_idx];
 
     //Case 1: start point is not on road
     if(!roadH && !roadV) {
@@ -454,6 +503,7 @@ Map::MoveResult Map::ComputeRoadMove(Point2D start, Point2D end) const {
 
     //move for max dist or until road limit is hit
     const Road* preferred_road;
+    RoadIndex::Extent limits;
     Point2D move_pos = end;
     double road_limit, move_coord;
 
@@ -461,28 +511,39 @@ Map::MoveResult Map::ComputeRoadMove(Point2D start, Point2D end) const {
     if(start.x == end.x) {
         //choose vertical road if available
         preferred_road = roadV ? roadV : roadH;
+        limits = {preferred_road->GetMinCoordY(), preferred_road->GetMaxCoordY()};
+
+        //Keep going onto connected vertical roads, stop only where the line has a gap
+        if(through_junctions && roadV) {
+            limits = *road_index_.FindVertExtent(cell.x, cell.y);
+        }
 
         if(start.y < end.y) {
             //Case 2: move in Increasing Y
-            road_limit = 1.0 * preferred_road->GetMaxCoordY() + 0.4;
+            road_limit = 1.0 * limits.max + 0.4;
             move_coord = std::min(road_limit, end.y);
         } else {
             //Case 3: move in Decreasing Y
-            road_limit = 1.0 * preferred_road->GetMinCoordY() - 0.4;
+            road_limit = 1.0 * limits.min - 0.4;
             move_coord = std::max(road_limit, end.y);
         }
         move_pos.y = move_coord;
     } else {
         //Cases 4 & 5: Move in X coord -> prefer horizontal road
         preferred_road = roadH ? roadH : roadV;
+        limits = {preferred_road->GetMinCoordX(), preferred_road->GetMaxCoordX()};
+
+        if(through_junctions && roadH) {
+            limits = *road_index_.FindHorExtent(cell.x, cell.y);
+        }
 
         if(start.x < end.x) {
             //Case 4: move in Increasing X
-            road_limit = 1.0 * preferred_road->GetMaxCoordX() + 0.4;
+            road_limit = 1.0 * limits.max + 0.4;
             move_coord = std::min(road_limit, end.x);
         } else {
             //Case 5: move in Decreasing X
-            road_limit = 1.0 * preferred_road->GetMinCoordX() - 0.4;
+            road_limit = 1.0 * limits.min - 0.4;
             move_coord = std::max(road_limit, end.x);
         }
         move_pos.x = move_coord;
@@ -499,6 +560,14 @@ void Map::SetBagCapacity(size_t cap) {
     bag_capacity_ = cap;
 }
 
+std::optional<double> Map::GetViewRadius() const {
+    return view_radius_;
+}
+
+void Map::SetViewRadius(double radius) {
+    view_radius_ = radius;
+}
+
 Point2D Map::GetFirstRoadPt() const {
     return ToGeomPt(roads_.at(0).GetStart());
 }
@@ -524,6 +593,8 @@ void Game::AddMap(Map map) {
         throw std::invalid_argument("Map with id "s + *map.GetId() + " already exists"s);
     } else {
         try {
+            map.SetIndex(index);
+            map.Compile();
             maps_.emplace_back(std::move(map));
         } catch(...) {
             map_id_to_index_.erase(it);
@@ -546,6 +617,21 @@ ConstMapPtr Game::FindMap(const Map::Id& id) const {
     return nullptr;
 }
 
+std::optional<Map::Index> Game::FindMapIndex(const Map::Id& id) const {
+    if(const auto it = map_id_to_index_.find(id); it != map_id_to_index_.end()) {
+        return it->second;
+    }
+    return std::nullopt;
+}
+
+MapPtr Game::GetMap(Map::Index index) {
+    return &maps_[index];
+}
+
+ConstMapPtr Game::GetMap(Map::Index index) const {
+    return &maps_[index];
+}
+
 const Game::Maps& Game::GetMaps() const {
     return maps_;
 }
@@ -562,11 +648,28 @@ void Game::ModifyDefaultBagCapacity(size_t capacity) {
     settings_.default_bag_capacity = capacity;
 }
 
+void Game::SetMaxDogsPerSession(size_t max_dogs) {
+    settings_.max_dogs_per_session = max_dogs;
+}
+
+void Game::SetDogRetirementTime(TimeMs time) {
+    settings_.dog_retirement_time = time;
+}
+
 void Game::EnableRandomDogSpawn(bool enable) {
     //is disabled by default
     settings_.randomised_dog_spawn = enable;
 }
 
+void Game::EnableMoveThroughJunctions(bool enable) {
+    //is disabled by default
+    settings_.move_through_junctions = enable;
+}
+
+void Game::SetRandomSeed(std::optional<uint64_t> seed) {
+    settings_.random_seed = seed;
+}
+
 void Game::ConfigLootGen(TimeMs base_period, double probability) {
     settings_.loot_gen_interval = base_period;
     settings_.loot_gen_prob = probability;
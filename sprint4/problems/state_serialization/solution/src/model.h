@@ -1,18 +1,20 @@
 #pragma once
 #include <chrono>
-#include <deque>
 #include <optional>
+#include <random>
 #include <string>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 #include <boost/json.hpp>
 
+#include "alias_table.h"
 #include "app_util.h"
 #include "collision_detector.h"
 #include "game_data.h"
 #include "geom.h"
+#include "road_index.h"
+#include "small_vector.h"
 
 namespace model {
 //==== Time, Coord, Geom ==========//
@@ -76,8 +78,14 @@ Distance operator*(const Speed& v, TimeMs t);
 
 
 //==== Random int generator for use in game model ==========//
-int GenRandomNum(int limit1, int limit2 = 0);
+//Sessions own a seeded engine, so a seeded game simulates the same way on every run
+using RandomEngine = std::mt19937;
+
+int GenRandomNum(RandomEngine& rng, int limit1, int limit2 = 0);
+size_t GenRandomNum(RandomEngine& rng, size_t limit1, size_t limit2 = 0);
 
+//Use a thread local engine seeded from std::random_device
+int GenRandomNum(int limit1, int limit2 = 0);
 size_t GenRandomNum(size_t limit1, size_t limit2 = 0);
 
 
@@ -105,6 +113,7 @@ public:
     Point GetStart() const;
     Point GetEnd() const;
     Point GetRandomPt() const;
+    Point GetRandomPt(RandomEngine& rng) const;
 
     Coord GetMaxCoordX() const;
     Coord GetMinCoordX() const;
@@ -162,12 +171,9 @@ public:
     }
 
 private:
-    const Id id_;
+    Id id_;
 };
 
-using GameObjectPtr = std::shared_ptr<GameObject>;
-using ConstGameObject = std::shared_ptr<const GameObject>;
-
 //------------------------------------------------
 struct LootItemInfo {
     LootItemInfo() = default;
@@ -192,12 +198,11 @@ struct LootItemInfo {
 };
 
 //------------------------------------------------
+//Plain component: position and size. Objects are kept in typed arrays per kind,
+//collision events are resolved by kind, so there is no virtual dispatch
 class CollisionObject : public GameObject {
 public:
-    using PtrToOther = const std::shared_ptr<CollisionObject>;
-
     CollisionObject(Id id, Point2D pos, double width);
-    virtual ~CollisionObject() = default;
 
     Point2D GetPos() const;
     Point2D GetPrevPos() const;
@@ -207,19 +212,12 @@ public:
     double GetWidth() const;
     collision_detector::Item AsCollisionItem() const;
 
-    virtual bool IsCollectible() const;
-    virtual bool IsItemsReturn() const;
-    virtual LootItemInfo Collect();
-
 private:
     Point2D pos_;
     Point2D prev_pos_;
-    const double width_;
+    double width_;
 };
 
-using CollisionObjectPtr = std::shared_ptr<CollisionObject>;
-using ConstCollisionObjectPtr = std::shared_ptr<const CollisionObject>;
-
 //------------------------------------------------
 class DynamicObject : public CollisionObject {
 public:
@@ -233,6 +231,7 @@ public:
     DynamicObject &SetMovement(Direction dir, double speed_value);
 
     void Stop();
+    bool IsMoving() const;
 
     Point2D ComputeMoveEndPoint(TimeMs delta_t) const;
     collision_detector::Gatherer AsGatherer() const;
@@ -242,9 +241,6 @@ private:
     Direction direction_ = Direction::NORTH;
 };
 
-using DynamicObjectPtr = std::shared_ptr<DynamicObject>;
-using ConstDynamicObjectPtr = std::shared_ptr<const DynamicObject>;
-
 //------------------------------------------------
 class LootItem : public CollisionObject {
 public:
@@ -253,41 +249,35 @@ public:
 
     Type GetType() const;
     Score GetValue() const;
+    bool IsCollected() const;
 
-    bool IsCollectible() const override;
-
-    LootItemInfo Collect() override;
+    //Marks the item as collected, can_collect is false if it already was
+    LootItemInfo Collect();
 
 private:
-    const Type type_;
-    const Score value_;
+    Type type_;
+    Score value_;
     bool is_collected_ = false;
 };
 
-using LootItemPtr = std::shared_ptr<LootItem>;
-using ConstLootItemPtr = std::shared_ptr<const LootItem>;
-
 //------------------------------------------------
 class ItemsReturnPoint : public CollisionObject {
 public:
     ItemsReturnPoint(Id id, const Office& office, double width);
 
-    bool IsItemsReturn() const override;
-
 private:
-    const Office::Id tag_;
+    Office::Id tag_;
 };
 
-using ItemsReturnPointPtr = std::shared_ptr<ItemsReturnPoint>;
-using ConstItemsReturnPointPtr = std::shared_ptr<const ItemsReturnPoint>;
-
 
 //=================================================
 //=================== Dog =========================
 class Dog : public DynamicObject {
 public:
     using Tag = util::Tagged<std::string, Dog>;
-    using BagContent = std::deque<LootItemInfo>;
+    //Default bag capacity fits inline, larger bags get one heap block reserved up front
+    static constexpr size_t INLINE_BAG_CAPACITY = 3;
+    using BagContent = util::SmallVector<LootItemInfo, INLINE_BAG_CAPACITY>;
 
     // Dog(Id id, Point pos, double width, Tag tag, size_t bag_cap);
     Dog(Id id, Point2D pos, double width, Tag tag, size_t bag_cap);
@@ -305,33 +295,26 @@ public:
 
     bool TryCollectItem(LootItemInfo loot_info);
 
-    void ProcessCollision(const CollisionObjectPtr& obj) {
-        //Only two options for now, so use this method:
-        // 1.Is a loot item
-        if(obj->IsCollectible()) {
-            TryCollectItem(obj->Collect());
-        }
-        // 2.Is an office
-        else if(obj->IsItemsReturn()) {
-            for(const auto& item : GetBag()) {
-                AddScore(item.value);
-            }
-            ClearBag();
-        }
-        else {
-            throw std::logic_error("unknown collision object type");
-        }
-
-        /// If mechanics become more complex, can potentially use pointer_cast
-            // spBase base = std::make_shared<Derived>();
-            // spDerived derived = std::dynamic_pointer_cast<spDerived::element_type>(base);
-    }
+    //Puts the item into the bag unless the bag is full. A full bag leaves it lying for the next dog
+    bool TryCollectItem(LootItem& item);
+    //Scores everything in the bag and empties it
+    void ReturnItems();
+
+    //Session time when the dog joined
+    TimeMs GetJoinTime() const;
+    Dog &SetJoinTime(TimeMs time);
+
+    //Session time since which the dog stands still, nullopt while it moves
+    std::optional<TimeMs> GetIdleSince() const;
+    Dog &SetIdleSince(std::optional<TimeMs> time);
 
 private:
     //what is a dog? Upd: A dog is a dynamic collision object
     const Tag tag_;
     size_t bag_capacity_{0u};
     Score score_{0u};
+    TimeMs join_time_{0u};
+    std::optional<TimeMs> idle_since_ = TimeMs{0u};
 
     BagContent bag_;
 };
@@ -345,6 +328,8 @@ using ConstDogPtr = const Dog*;
 class Map {
 public:
     using Id = util::Tagged<std::string, Map>;
+    //Position of the map in Game, runtime code uses it instead of hashing the string id
+    using Index = size_t;
     using Roads = std::vector<Road>;
     using Buildings = std::vector<Building>;
     using Offices = std::vector<Office>;
@@ -357,6 +342,8 @@ public:
     Map(Id tag, std::string name);
 
     const Id &GetId() const;
+    Index GetIndex() const;
+    void SetIndex(Index index);
     const std::string &GetName() const;
     const Buildings &GetBuildings() const;
     const Roads &GetRoads() const;
@@ -371,9 +358,21 @@ public:
     std::optional<size_t> GetBagCapacity() const;
     void SetBagCapacity(size_t cap);
 
+    //Players see only this far in /state, if set
+    std::optional<double> GetViewRadius() const;
+    void SetViewRadius(double radius);
+
     void AddRoad(const Road& road);
+    //Compiles the road index, call once all roads have been added
+    void BuildRoadIndex();
+    const RoadIndex& GetRoadIndex() const;
+    //Builds all lookup tables used at runtime (road index, spawn table), done by Game::AddMap
+    void Compile();
+
     void AddBuilding(const Building& building);
     void AddOffice(Office office);
+    //Sizes the containers once when the object counts are known up front, as when loading a config
+    void Reserve(size_t num_roads, size_t num_buildings, size_t num_offices);
 
     template<typename LootTypeData>
     void AddLootInfo(LootTypeData&& loot_types) {
@@ -383,29 +382,36 @@ public:
     const Road* FindVertRoad(Point2D point) const;
     const Road* FindHorRoad(Point2D point) const;
 
-    MoveResult ComputeRoadMove(Point2D start, Point2D end) const;
+    //Moves along the road at start, clamped to its ends. With through_junctions the move
+    //continues onto connected roads on the same line, so one long step equals many short ones
+    MoveResult ComputeRoadMove(Point2D start, Point2D end, bool through_junctions = false) const;
 
     Point2D GetRandomRoadPt() const;
+    Point2D GetRandomRoadPt(RandomEngine& rng) const;
     Point2D GetFirstRoadPt() const;
 
 private:
     using OfficeIdToIndex = std::unordered_map<Office::Id, size_t, util::TaggedHasher<Office::Id>>;
 
     Id id_;
+    Index index_ = 0;
     std::string name_;
     Roads roads_;
     Buildings buildings_;
     std::optional<double> dog_speed_;
     std::optional<size_t> bag_capacity_;
+    std::optional<double> view_radius_;
 
     Offices offices_;
     OfficeIdToIndex warehouse_id_to_index_;
 
-    using RoadIndex = std::unordered_map<Coord, std::unordered_set<size_t>>;
-    RoadIndex RoadXtoIndex_;
-    RoadIndex RoadYtoIndex_;
+    RoadIndex road_index_;
+    //Picks a road with probability proportional to its length
+    util::AliasTable road_spawn_table_;
 
     std::unique_ptr<gamedata::LootTypesInfo> loot_types_ = nullptr;
+
+    void BuildSpawnTable();
 };
 
 using MapPtr = Map*;
@@ -420,8 +426,13 @@ public:
     void AddMap(Map map);
 
     void EnableRandomDogSpawn(bool enable);
+    void EnableMoveThroughJunctions(bool enable);
+    //nullopt seeds every session from std::random_device
+    void SetRandomSeed(std::optional<uint64_t> seed);
     void ModifyDefaultDogSpeed(double speed);
     void ModifyDefaultBagCapacity(size_t capacity);
+    void SetMaxDogsPerSession(size_t max_dogs);
+    void SetDogRetirementTime(TimeMs time);
     void ConfigLootGen(TimeMs base_period, double probability);
 
     const Maps &GetMaps() const;
@@ -429,6 +440,11 @@ public:
 
     MapPtr FindMap(const Map::Id& id);
     ConstMapPtr FindMap(const Map::Id& id) const;
+    std::optional<Map::Index> FindMapIndex(const Map::Id& id) const;
+
+    //Index must be valid
+    MapPtr GetMap(Map::Index index);
+    ConstMapPtr GetMap(Map::Index index) const;
 
 private:
     gamedata::Settings settings_;
@@ -440,7 +456,19 @@ private:
     MapIdToIndex map_id_to_index_;
 };
 
-template<typename ObjPtrContainer, typename DogPtrContainer>
+enum class CollisionItemKind {
+    LOOT,
+    ITEMS_RETURN,
+};
+
+//Item of a collision event: its kind and position in the array of that kind
+struct CollisionItemRef {
+    CollisionItemKind kind;
+    size_t idx;
+};
+
+//Items are the loot items followed by the items return points, both stored by value
+template<typename LootContainer, typename ReturnPointContainer, typename DogPtrContainer>
 class CollisionDetector final : collision_detector::ItemGathererProvider {
     using Item = collision_detector::Item;
     using Gatherer = collision_detector::Gatherer;
@@ -448,8 +476,9 @@ class CollisionDetector final : collision_detector::ItemGathererProvider {
 public:
     using Event = collision_detector::GatheringEvent;
 
-    CollisionDetector(const ObjPtrContainer& objects, const DogPtrContainer& gatherers)
-        : objects_(objects)
+    CollisionDetector(const LootContainer& loot, const ReturnPointContainer& return_points, const DogPtrContainer& gatherers)
+        : loot_(loot)
+        , return_points_(return_points)
         , gatherers_(gatherers) {
     }
 
@@ -458,11 +487,13 @@ public:
     }
 
     size_t ItemsCount() const override {
-        return objects_.size();
+        return loot_.size() + return_points_.size();
     }
 
     collision_detector::Item GetItem(size_t idx) const override {
-        return objects_.at(idx)->AsCollisionItem();
+        return IsLootItem(idx)
+            ? loot_[idx].AsCollisionItem()
+            : return_points_[idx - loot_.size()].AsCollisionItem();
     }
 
     size_t GatherersCount() const override {
@@ -473,8 +504,19 @@ public:
         return gatherers_.at(idx)->AsGatherer();
     }
 
+    bool IsLootItem(size_t item_idx) const {
+        return item_idx < loot_.size();
+    }
+
+    CollisionItemRef ResolveItem(size_t item_idx) const {
+        return IsLootItem(item_idx)
+            ? CollisionItemRef{CollisionItemKind::LOOT, item_idx}
+            : CollisionItemRef{CollisionItemKind::ITEMS_RETURN, item_idx - loot_.size()};
+    }
+
 private:
-    const ObjPtrContainer& objects_;
+    const LootContainer& loot_;
+    const ReturnPointContainer& return_points_;
     const DogPtrContainer& gatherers_;
 };
 } // namespace model
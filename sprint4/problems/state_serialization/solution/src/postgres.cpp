@@ -0,0 +1,102 @@
+#include "postgres.h"
+
+#include <boost/uuid/uuid_io.hpp>
+#include <pqxx/pqxx>
+#include <pqxx/zview.hxx>
+
+namespace postgres {
+
+using namespace std::literals;
+using pqxx::operator"" _zv;
+
+RecordsRepository::RecordsRepository(std::string db_url)
+    : db_url_(std::move(db_url)) {
+    std::lock_guard lock{mtx_};
+    pqxx::work work{GetConnection()};
+    //Ids come from the server: gen_random_uuid() needs PostgreSQL 13 or pgcrypto.
+    //Score and play time are 64-bit in the model, play time outgrows integer after 24.8 days
+    work.exec(R"(
+        CREATE TABLE IF NOT EXISTS retired_players (
+            id UUID PRIMARY KEY,
+            name varchar(100) NOT NULL,
+            score bigint NOT NULL,
+            play_time_ms bigint NOT NULL
+        );
+    )"_zv);
+    //Leaderboard order. Names in "C" collation sort byte-wise, like std::string in app::RecordOrder
+    work.exec(R"(
+        CREATE INDEX IF NOT EXISTS retired_players_leaderboard
+            ON retired_players (score DESC, play_time_ms, name COLLATE "C");
+    )"_zv);
+    work.commit();
+}
+
+void RecordsRepository::SaveBatch(std::span<const app::RetiredPlayer> records) {
+    if (records.empty()) {
+        return;
+    }
+    std::lock_guard lock{mtx_};
+    try {
+        pqxx::work work{GetConnection()};
+
+        std::string query = "INSERT INTO retired_players (id, name, score, play_time_ms) VALUES "s;
+        //Roughly one row of a typical name
+        query.reserve(query.size() + records.size() * 80);
+        for (size_t i = 0; i < records.size(); ++i) {
+            const auto& record = records[i];
+            query += i ? ", ('"s : "('"s;
+            query += to_string(uuid_generator_()) + "', "s;
+            query += work.quote(*record.name);
+            query += ", "s + std::to_string(record.score);
+            query += ", "s + std::to_string(record.play_time.count()) + ")"s;
+        }
+        query += ";"s;
+
+        work.exec(query);
+        work.commit();
+    } catch (const pqxx::broken_connection&) {
+        connection_.reset();
+        throw;
+    }
+}
+
+std::vector<app::PlayerRecord> RecordsRepository::LoadRecords(const app::PlayerRecord* after, size_t skip,
+                                                              size_t max_items) {
+    std::lock_guard lock{mtx_};
+    try {
+        pqxx::read_transaction read{GetConnection()};
+        std::vector<app::PlayerRecord> result;
+        result.reserve(max_items);
+
+        std::string query = "SELECT name, score, play_time_ms FROM retired_players "s;
+        if (after) {
+            //Keyset: whatever follows `after` in leaderboard order
+            const auto score = std::to_string(after->score);
+            const auto play_time = std::to_string(after->play_time.count());
+            query += "WHERE score < "s + score + " OR (score = "s + score + " AND (play_time_ms > "s + play_time
+                   + " OR (play_time_ms = "s + play_time + " AND name COLLATE \"C\" > "s + read.quote(after->name)
+                   + "))) "s;
+        }
+        //Same order as app::RecordOrder, served by the leaderboard index
+        query += "ORDER BY score DESC, play_time_ms, name COLLATE \"C\" "
+                 "LIMIT "s + std::to_string(max_items) + " OFFSET "s + std::to_string(skip) + ";"s;
+
+        for (auto [name, score, play_time_ms] : read.query<std::string, int64_t, int64_t>(query)) {
+            result.push_back({std::move(name), static_cast<model::Score>(score), model::TimeMs{play_time_ms}});
+        }
+        return result;
+    } catch (const pqxx::broken_connection&) {
+        connection_.reset();
+        throw;
+    }
+}
+
+pqxx::connection& RecordsRepository::GetConnection() {
+    if (!connection_ || !connection_->is_open()) {
+        connection_.reset();
+        connection_.emplace(db_url_);
+    }
+    return *connection_;
+}
+
+}  // namespace postgres
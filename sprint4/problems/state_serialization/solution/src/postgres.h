@@ -0,0 +1,41 @@
+#pragma once
+#include <boost/uuid/random_generator.hpp>
+#include <pqxx/connection>
+#include <pqxx/transaction>
+
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "application.h"
+#include "leaderboard.h"
+
+namespace postgres {
+
+//Table of retired players. Calls from different threads share one connection and take turns
+class RecordsRepository {
+public:
+    //Connects and creates the table if needed, throws if the database is unreachable
+    explicit RecordsRepository(std::string db_url);
+
+    //One multi-row INSERT in one transaction, throws on failure.
+    //A broken connection is reopened on the next call
+    void SaveBatch(std::span<const app::RetiredPlayer> records);
+
+    //Records in leaderboard order that come after `after` (from the top when null), skip of them left out.
+    //Names are compared byte-wise, as app::RecordOrder does. Throws on failure
+    std::vector<app::PlayerRecord> LoadRecords(const app::PlayerRecord* after, size_t skip, size_t max_items);
+
+private:
+    std::string db_url_;
+    std::mutex mtx_;
+    std::optional<pqxx::connection> connection_;
+    //Row ids, used under mtx_
+    boost::uuids::random_generator uuid_generator_;
+
+    pqxx::connection& GetConnection();
+};
+
+}  // namespace postgres
@@ -0,0 +1,126 @@
+#include "records_writer.h"
+#include "server_logger.h"
+
+#include <algorithm>
+
+namespace app {
+
+RecordsWriter::RecordsWriter(BatchSink sink)
+    : RecordsWriter(std::move(sink), Settings{}) {
+}
+
+RecordsWriter::RecordsWriter(BatchSink sink, Settings settings)
+    : sink_(std::move(sink))
+    , settings_(settings)
+    , thread_([this] {
+        Run();
+    }) {
+}
+
+RecordsWriter::~RecordsWriter() {
+    {
+        std::lock_guard lock{mtx_};
+        stop_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+}
+
+bool RecordsWriter::Push(std::vector<RetiredPlayer> records) {
+    if (records.empty()) {
+        return true;
+    }
+    size_t accepted = 0;
+    bool full_batch = false;
+    {
+        std::lock_guard lock{mtx_};
+        accepted = std::min(records.size(), settings_.max_queued - std::min(settings_.max_queued, queue_.size()));
+        std::move(records.begin(), records.begin() + accepted, std::back_inserter(queue_));
+        stats_.dropped += records.size() - accepted;
+        stats_.queue_full += records.size() - accepted;
+        full_batch = queue_.size() >= settings_.max_batch;
+    }
+    if (full_batch) {
+        wake_.notify_one();
+    }
+    return accepted == records.size();
+}
+
+void RecordsWriter::Flush() {
+    std::unique_lock lock{mtx_};
+    ++flush_waiters_;
+    wake_.notify_all();
+    idle_.wait(lock, [this] {
+        return queue_.empty() && in_flight_ == 0;
+    });
+    --flush_waiters_;
+}
+
+RecordsWriter::Stats RecordsWriter::GetStats() const {
+    std::lock_guard lock{mtx_};
+    return stats_;
+}
+
+void RecordsWriter::Run() {
+    std::vector<RetiredPlayer> batch;
+    batch.reserve(settings_.max_batch);
+
+    std::unique_lock lock{mtx_};
+    while (true) {
+        //A partial batch goes out after flush_interval, or at once if someone waits for it
+        wake_.wait_for(lock, settings_.flush_interval, [this] {
+            return stop_ || queue_.size() >= settings_.max_batch || (flush_waiters_ > 0 && !queue_.empty());
+        });
+        if (queue_.empty()) {
+            if (stop_) {
+                return;
+            }
+            continue;
+        }
+
+        const auto size = std::min(queue_.size(), settings_.max_batch);
+        std::move(queue_.begin(), queue_.begin() + size, std::back_inserter(batch));
+        queue_.erase(queue_.begin(), queue_.begin() + size);
+        in_flight_ = size;
+
+        lock.unlock();
+        const bool written = WriteBatch(batch);
+        lock.lock();
+
+        (written ? stats_.written : stats_.dropped) += batch.size();
+        in_flight_ = 0;
+        batch.clear();
+        if (queue_.empty()) {
+            idle_.notify_all();
+        }
+    }
+}
+
+bool RecordsWriter::WriteBatch(std::span<const RetiredPlayer> batch) {
+    auto delay = settings_.retry_delay;
+    for (unsigned attempt = 1;; ++attempt) {
+        try {
+            sink_(batch);
+            return true;
+        } catch (const std::exception& ex) {
+            std::unique_lock lock{mtx_};
+            ++stats_.failed_attempts;
+            if (attempt >= settings_.max_attempts) {
+                BOOST_LOG_TRIVIAL(error) << boost::log::add_value(log_message, "records dropped"s)
+                                         << boost::log::add_value(log_msg_data, boost::json::object{
+                                             {"dropped", batch.size()},
+                                             {"attempts", attempt},
+                                             {"exception", ex.what()}
+                                         });
+                return false;
+            }
+            //Shutting down skips the wait, not the attempts
+            wake_.wait_for(lock, delay, [this] {
+                return stop_;
+            });
+        }
+        delay *= 2;
+    }
+}
+
+} // namespace app
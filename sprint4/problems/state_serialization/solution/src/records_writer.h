@@ -0,0 +1,84 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "application.h"
+
+namespace app {
+
+//=================================================
+//================ Records writer =================
+//Queues records of retired players and hands them to the sink in batches from its own thread,
+//so the tick never waits for the database
+class RecordsWriter {
+public:
+    //Writes the whole batch or throws, a failed batch is retried as a whole
+    using BatchSink = std::function<void(std::span<const RetiredPlayer>)>;
+
+    struct Settings {
+        //Rows per sink call
+        size_t max_batch = 500;
+        //A partial batch waits at most this long
+        model::TimeMs flush_interval{1000};
+        //Records pushed beyond this are dropped, not waited for
+        size_t max_queued = 100'000;
+        //Attempts per batch, the delay doubles after every failure
+        unsigned max_attempts = 5;
+        model::TimeMs retry_delay{200};
+    };
+
+    struct Stats {
+        size_t written = 0;
+        //Queue full or out of attempts
+        size_t dropped = 0;
+        //Part of dropped that never got into the queue
+        size_t queue_full = 0;
+        size_t failed_attempts = 0;
+    };
+
+    explicit RecordsWriter(BatchSink sink);
+    RecordsWriter(BatchSink sink, Settings settings);
+    //Writes what is still queued, retries included
+    ~RecordsWriter();
+
+    RecordsWriter(const RecordsWriter&) = delete;
+    RecordsWriter& operator=(const RecordsWriter&) = delete;
+
+    //Never blocks on the sink. Returns false if some records did not fit into the queue
+    bool Push(std::vector<RetiredPlayer> records);
+
+    //Waits until everything pushed before the call is written or dropped
+    void Flush();
+
+    Stats GetStats() const;
+
+private:
+    BatchSink sink_;
+    const Settings settings_;
+
+    mutable std::mutex mtx_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    std::deque<RetiredPlayer> queue_;
+    //Taken by the writer thread and not finished yet
+    size_t in_flight_ = 0;
+    size_t flush_waiters_ = 0;
+    bool stop_ = false;
+    Stats stats_;
+
+    //Started last, after everything it uses
+    std::thread thread_;
+
+    void Run();
+    //Returns true if the batch was written
+    bool WriteBatch(std::span<const RetiredPlayer> batch);
+};
+
+using RecordsWriterPtr = std::shared_ptr<RecordsWriter>;
+
+} // namespace app
@@ -1,5 +1,9 @@
 #include "request_handling.h"
 
+#include <charconv>
+
+#include "leaderboard.h"
+
 namespace http_handler {
 
 //==================================================================
@@ -155,6 +159,16 @@ ErrInfo ApiError::GetInfo(ErrCode ec) const {
                     "invalidArgument"sv,
                     "Failed to parse tick request"sv};
             break;
+        case ErrCode::view_radius_invalid_argument:
+            return {http::status::bad_request,
+                    "invalidArgument"sv,
+                    "Invalid view radius"sv};
+            break;
+        case ErrCode::records_invalid_argument:
+            return {http::status::bad_request,
+                    "invalidArgument"sv,
+                    "Invalid records page"sv};
+            break;
         default:
             //Should not get here
             assert(false);
@@ -164,13 +178,13 @@ ErrInfo ApiError::GetInfo(ErrCode ec) const {
 
 //==================================================================
 //======================= Api Request Handler ======================
-ApiHandler::ApiHandler(Strand api_strand, std::shared_ptr<app::GameInterface> game_app, model::TimeMs tick_period)
+ApiHandler::ApiHandler(Strand api_strand, std::shared_ptr<app::GameInterface> game_app, util::FixedStepClock::Settings tick_settings)
     : strand_(api_strand)
     , game_app_(std::move(game_app))
-    , use_http_tick_debug_(tick_period.count() == 0) {
+    , use_http_tick_debug_(tick_settings.step.count() == 0) {
 
     if(!use_http_tick_debug_) {
-        ticker_ = std::make_shared<Ticker>(api_strand, tick_period,
+        ticker_ = std::make_shared<Ticker>(api_strand, tick_settings,
                                            [&](model::TimeMs delta) {
             game_app_->AdvanceGameTime(delta); }
         );
@@ -179,6 +193,13 @@ ApiHandler::ApiHandler(Strand api_strand, std::shared_ptr<app::GameInterface> ga
 
 }
 
+std::optional<util::FixedStepClock::Stats> ApiHandler::GetTickStats() const {
+    if(!ticker_) {
+        return std::nullopt;
+    }
+    return ticker_->GetStats();
+}
+
 std::string_view ApiHandler::ExtractMapId(std::string_view uri) const {
     //If contains pref and has a map id, remove "/api/v1/maps/"
     if(uri.starts_with(Uri::map_list) && Uri::map_list.size() + 1 < uri.size()) {
@@ -188,7 +209,7 @@ std::string_view ApiHandler::ExtractMapId(std::string_view uri) const {
     return {};
 }
 
-std::string ApiHandler::ExtractToken(const auto& request) const {
+app::Token ApiHandler::ExtractToken(const auto& request) const {
     std::string_view token_str;
     try {
         token_str = request.at(http::field::authorization);
@@ -202,15 +223,18 @@ std::string ApiHandler::ExtractToken(const auto& request) const {
     }
     token_str.remove_prefix(Uri::bearer.size());
 
-    if(!util::is_len32hex_num(token_str)) {
-        throw ApiError(ErrCode::invalid_token);
+    //Decoded straight from the header, no string copy
+    const auto token = app::Token::FromHex(token_str);
+    if(!token) {
+        //Uppercase hex is well formed, it just never matches an issued token
+        throw ApiError(util::is_len32hex_num(token_str) ? ErrCode::unknown_token : ErrCode::invalid_token);
     }
-    return std::string{token_str};
+    return *token;
 }
 
 app::ConstPlayerPtr ApiHandler::AuthorizePlayer(const auto& request) const {
     /// -->>  Authorise player
-    app::Token token{std::move(ExtractToken(request))};
+    const app::Token token = ExtractToken(request);
 
     auto player = game_app_->FindPlayerByToken(token);
     if(!player) {
@@ -269,11 +293,12 @@ StringResponse ApiHandler::HandleApiRequest(const StringRequest& req) {
                     throw ApiError(ErrCode::map_not_found);
                 }
 
-                auto join_result = game_app_->JoinGame(join_map_player.first, join_map_player.second);
+                auto join_result = game_app_->JoinGame(std::move(join_map_player.first),
+                                                       std::move(join_map_player.second));
 
                 json::object json_body = {
                     {"playerId", join_result.player_id},
-                    {"authToken", join_result.token->GetVal()},
+                    {"authToken", join_result.token->ToHex()},
                 };
 
                 return to_html(http::status::ok, serialize(json_body));
@@ -295,11 +320,24 @@ StringResponse ApiHandler::HandleApiRequest(const StringRequest& req) {
 
                 auto player = AuthorizePlayer(req);
                 //TODO: catch & report json errors
-                auto json_str_body = json_loader::PrintGameState(player, game_app_);
+                const auto view_radius = ExtractViewRadius(api_uri, *player->GetMap());
+                auto json_str_body = view_radius ? json_loader::PrintGameState(player, game_app_, *view_radius)
+                                                 : json_loader::PrintGameState(player, game_app_);
 
                 return to_html(http::status::ok, json_str_body);
             }
 
+            /// -->> Best players on a map right now
+            if(RemoveIfHasPrefix(Uri::live_top, api_uri)) {
+                CheckHttpMethod(req.method(), http::verb::get, http::verb::head);
+
+                const auto live_top = game_app_->GetLiveTop(ExtractQueryParam(api_uri, "mapId"sv));
+                if(!live_top) {
+                    throw ApiError(ErrCode::map_not_found);
+                }
+                return to_html(http::status::ok, json_loader::PrintLiveTop(*live_top));
+            }
+
             ///->> Player action
             if(RemoveIfHasPrefix(Uri::player_action, api_uri)) {
                 CheckHttpMethod(req.method(), http::verb::post);
@@ -352,6 +390,67 @@ StringResponse ApiHandler::HandleApiRequest(const StringRequest& req) {
 }
 
 
+StringResponse ApiHandler::HandleRecordsRequest(const StringRequest& req) const {
+    CheckHttpMethod(req.method(), http::verb::get, http::verb::head);
+
+    const auto start = ExtractQueryNumber(req.target(), "start"sv, 0);
+    const auto max_items = ExtractQueryNumber(req.target(), "maxItems"sv, max_records_page_);
+    if(max_items > max_records_page_) {
+        throw ApiError(ErrCode::records_invalid_argument);
+    }
+
+    const auto leaderboard = game_app_->GetLeaderboard();
+    const auto records = leaderboard ? leaderboard->GetPage(start, max_items) : std::vector<app::PlayerRecord>{};
+
+    auto resp = MakeStringResponse(http::status::ok, json_loader::PrintRecords(records), req.version(),
+                                   req.keep_alive(), ContentType::APP_JSON);
+    resp.set(http::field::cache_control, "no-cache"sv);
+    return resp;
+}
+
+std::string_view ApiHandler::ExtractQueryParam(std::string_view target, std::string_view name) {
+    const auto query_pos = target.find('?');
+    if(query_pos == target.npos) {
+        return {};
+    }
+    auto query = target.substr(query_pos + 1);
+    while(!query.empty()) {
+        const auto param = query.substr(0, query.find('&'));
+        query.remove_prefix(std::min(query.size(), param.size() + 1));
+
+        if(const auto eq = param.find('='); eq != param.npos && param.substr(0, eq) == name) {
+            return param.substr(eq + 1);
+        }
+    }
+    return {};
+}
+
+size_t ApiHandler::ExtractQueryNumber(std::string_view target, std::string_view name, size_t fallback) {
+    const auto value = ExtractQueryParam(target, name);
+    if(value.empty()) {
+        return fallback;
+    }
+    size_t number = 0;
+    const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), number);
+    if(ec != std::errc{} || end != value.data() + value.size()) {
+        throw ApiError(ErrCode::records_invalid_argument);
+    }
+    return number;
+}
+
+std::optional<double> ApiHandler::ExtractViewRadius(std::string_view target, const model::Map& map) {
+    const auto value = ExtractQueryParam(target, "viewRadius"sv);
+    if(value.empty()) {
+        return map.GetViewRadius();
+    }
+    double radius = 0;
+    const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), radius);
+    if(ec != std::errc{} || end != value.data() + value.size() || !(radius > 0)) {
+        throw ApiError(ErrCode::view_radius_invalid_argument);
+    }
+    return radius;
+}
+
 StringResponse ApiHandler::ReportApiError(const ApiError& err, unsigned version, bool keep_alive) const {
     auto resp = MakeStringResponse(err.status(), err.print_json(), version,
                                    keep_alive, ContentType::APP_JSON);
@@ -383,22 +482,16 @@ bool ApiHandler::RemoveIfHasPrefix(std::string_view prefix, std::string_view& ur
     return false;
 }
 std::pair<std::string, std::string> ApiHandler::ExtractMapIdPlayerName(const std::string& request_body) {
-    std::string map_id_str;
-    std::string player_dog_name;
-
-    json::object player_data = json::parse(request_body).as_object();
-
-    try {
-        map_id_str = player_data.at("mapId").as_string();
-        player_dog_name = std::string(player_data.at("userName").as_string());
-    } catch (...) {
+    //Malformed json is not an api error, it propagates as it is
+    auto join = json_loader::ParseJoin(request_body);
+    if(!join) {
         throw ApiError(ErrCode::join_game_parse_err);
     }
 
-    if(player_dog_name.empty()) {
+    if(join->user_name.empty()) {
         throw ApiError(ErrCode::invalid_player_name);
     }
-    return {map_id_str, player_dog_name};
+    return {std::move(join->map_id), std::move(join->user_name)};
 }
 
 //==================================================================
@@ -458,9 +551,9 @@ StringResponse FileHandler::ReportFileError(unsigned version, bool keep_alive) c
 
 //==================================================================
 //================== Request Handling Interface ====================
-RequestHandler::RequestHandler(fs::path root, Strand api_strand, std::shared_ptr<app::GameInterface> game_app, model::TimeMs tick_period)
+RequestHandler::RequestHandler(fs::path root, Strand api_strand, std::shared_ptr<app::GameInterface> game_app, util::FixedStepClock::Settings tick_settings)
 : file_handler_(std::make_shared<FileHandler>(std::move(root)))
-, api_handler_(std::make_shared<ApiHandler>(api_strand, std::move(game_app), tick_period)) {
+, api_handler_(std::make_shared<ApiHandler>(api_strand, std::move(game_app), tick_settings)) {
 }
 
 StringResponse RequestHandler::ReportServerError(const ServerError& err, unsigned version, bool keep_alive) const {
@@ -481,9 +574,9 @@ StringResponse RequestHandler::ReportServerError(unsigned version, bool keep_ali
 
 //==================================================================
 //================== Ticker Class ====================
-Ticker::Ticker(Strand strand, std::chrono::milliseconds period, Handler handler)
+Ticker::Ticker(Strand strand, util::FixedStepClock::Settings settings, Handler handler)
         : strand_{strand}
-        , period_{period}
+        , step_clock_{settings}
         , handler_{std::move(handler)} {
     }
 
@@ -496,7 +589,7 @@ Ticker::Ticker(Strand strand, std::chrono::milliseconds period, Handler handler)
 
     void Ticker::ScheduleTick() {
         assert(strand_.running_in_this_thread());
-        timer_.expires_after(period_);
+        timer_.expires_after(step_clock_.GetStep());
         timer_.async_wait([self = shared_from_this()](sys::error_code ec) {
             self->OnTick(ec);
         });
@@ -507,15 +600,37 @@ Ticker::Ticker(Strand strand, std::chrono::milliseconds period, Handler handler)
         assert(strand_.running_in_this_thread());
 
         if (!ec) {
+            //Only whole steps are passed on, the remainder carries over to the next wakeup
             auto this_tick = Clock::now();
-            model::TimeMs delta = duration_cast<milliseconds>(this_tick - last_tick_);
-            last_tick_ = this_tick;
-            try {
-                handler_(delta);
-            } catch (...) {
-            }
+            auto elapsed = duration_cast<milliseconds>(this_tick - last_tick_);
+            last_tick_ += elapsed;
+            step_clock_.Advance(elapsed, [this](model::TimeMs step) {
+                try {
+                    handler_(step);
+                } catch (...) {
+                }
+            });
+            ReportOverruns();
             ScheduleTick();
         }
     }
 
+    void Ticker::ReportOverruns() {
+        const auto& stats = step_clock_.GetStats();
+        const auto now = Clock::now();
+        if(stats.overruns == reported_overruns_ || now - last_overrun_report_ < overrun_report_period_) {
+            return;
+        }
+        BOOST_LOG_TRIVIAL(warning) << boost::log::add_value(log_message, "tick overrun"s)
+                                   << boost::log::add_value(log_msg_data, json::object{
+                                       {"overruns", stats.overruns - reported_overruns_},
+                                       {"lagMs", stats.lag.count()},
+                                       {"stepMs", step_clock_.GetStep().count()},
+                                       {"skippedMs", stats.skipped.count()},
+                                       {"mergedMs", stats.merged.count()}
+                                   });
+        reported_overruns_ = stats.overruns;
+        last_overrun_report_ = now;
+    }
+
 } // namespace http_handler
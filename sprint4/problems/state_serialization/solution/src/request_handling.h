@@ -10,6 +10,7 @@
 
 #include "model.h"
 #include "application.h"
+#include "fixed_step_clock.h"
 #include "json_loader.h"
 
 namespace http_handler {
@@ -86,6 +87,10 @@ enum class ErrCode {
     token_invalid_argument,
     invalid_content_type,
     time_tick_invalid_argument,
+    view_radius_invalid_argument,
+
+    //records
+    records_invalid_argument,
 };
 
 struct ErrInfo {
@@ -166,20 +171,29 @@ class Ticker : public std::enable_shared_from_this<Ticker> {
     using Strand = net::strand<net::io_context::executor_type>;
     using Handler = std::function<void(model::TimeMs delta)>;
 
-    // Функция handler будет вызываться внутри strand с интервалом period
-    Ticker(Strand strand, std::chrono::milliseconds period, Handler handler);
+    // Функция handler будет вызываться внутри strand, каждый вызов - один шаг фиксированной длины
+    Ticker(Strand strand, util::FixedStepClock::Settings settings, Handler handler);
     void Start();
 
+    //Overruns and lag, only read from inside the strand or once the io_context has stopped
+    const util::FixedStepClock::Stats& GetStats() const { return step_clock_.GetStats(); }
+
  private:
     void ScheduleTick();
     void OnTick(sys::error_code ec);
+    void ReportOverruns();
 
     using Clock = std::chrono::steady_clock;
     Strand strand_;
-    std::chrono::milliseconds period_;
+    util::FixedStepClock step_clock_;
     net::steady_timer timer_{strand_};
     Handler handler_;
     std::chrono::steady_clock::time_point last_tick_;
+
+    //Overruns are logged at most once per second, with the count since the previous report
+    static constexpr std::chrono::seconds overrun_report_period_{1};
+    uint64_t reported_overruns_ = 0;
+    Clock::time_point last_overrun_report_{};
 };
 
 //===================================================================
@@ -188,7 +202,7 @@ class Ticker : public std::enable_shared_from_this<Ticker> {
 class ApiHandler : public std::enable_shared_from_this<ApiHandler> {
  public:
     using Strand = net::strand<net::io_context::executor_type>;
-    ApiHandler(Strand api_strand, std::shared_ptr<app::GameInterface> game_app, model::TimeMs tick_period);
+    ApiHandler(Strand api_strand, std::shared_ptr<app::GameInterface> game_app, util::FixedStepClock::Settings tick_settings);
 
     ApiHandler(const ApiHandler&) = delete;
     ApiHandler& operator=(const ApiHandler&) = delete;
@@ -196,9 +210,16 @@ class ApiHandler : public std::enable_shared_from_this<ApiHandler> {
     template<typename Request>
     bool IsApiRequest(const Request& req) const { return req.target().starts_with(Uri::api); }
 
+    //Records come from the leaderboard, not the game state, so they are served outside the strand
+    template<typename Request>
+    bool IsRecordsRequest(const Request& req) const;
+
     template<typename Body, typename Allocator, typename Send>
     void Execute(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send);
 
+    //Empty when ticks come from the test endpoint. Same thread rules as Ticker::GetStats
+    std::optional<util::FixedStepClock::Stats> GetTickStats() const;
+
  private:
     struct Uri {
         //var
@@ -215,8 +236,15 @@ class ApiHandler : public std::enable_shared_from_this<ApiHandler> {
         static constexpr std::string_view player_list{"players"sv};
         static constexpr std::string_view player_action{"player/action"sv};
         static constexpr std::string_view time_tick{"tick"sv};
+        static constexpr std::string_view live_top{"records/live"sv};
+
+        //Full path, served outside the strand
+        static constexpr std::string_view records{"/api/v1/game/records"sv};
     };
 
+    //Page size limit of the records request
+    static constexpr size_t max_records_page_ = 100;
+
     bool use_http_tick_debug_ = false;
     Strand strand_;
     std::shared_ptr<app::GameInterface> game_app_;
@@ -225,12 +253,19 @@ class ApiHandler : public std::enable_shared_from_this<ApiHandler> {
     std::string_view ExtractMapId(std::string_view uri) const;
     static std::pair<std::string, std::string> ExtractMapIdPlayerName (const std::string& request_body);
 
-    std::string ExtractToken(const auto& request) const;
+    app::Token ExtractToken(const auto& request) const;
     app::ConstPlayerPtr AuthorizePlayer(const auto& request) const;
 
     static bool RemoveIfHasPrefix(std::string_view prefix, std::string_view& uri);
 
     StringResponse HandleApiRequest(const StringRequest& req);
+    StringResponse HandleRecordsRequest(const StringRequest& req) const;
+
+    //Value of a numeric query parameter, fallback if it is absent. Throws ApiError if it is not a number
+    static size_t ExtractQueryNumber(std::string_view target, std::string_view name, size_t fallback);
+    static std::string_view ExtractQueryParam(std::string_view target, std::string_view name);
+    //?viewRadius= if given, the map setting otherwise. Throws ApiError if it is not a positive number
+    static std::optional<double> ExtractViewRadius(std::string_view target, const model::Map& map);
 
     StringResponse ReportApiError(const ApiError& err, unsigned version, bool keep_alive) const;
     StringResponse ReportApiError(unsigned version, bool keep_alive, std::string_view msg = ""sv) const;
@@ -244,6 +279,16 @@ void ApiHandler::Execute(http::request<Body, http::basic_fields<Allocator>>&& re
     auto version = req.version();
     auto keep_alive = req.keep_alive();
 
+    if(IsRecordsRequest(req)) {
+        try {
+            return send(HandleRecordsRequest(req));
+        } catch(const ApiError& err) {
+            return send(ReportApiError(err, version, keep_alive));
+        } catch(const std::exception& ex) {
+            return send(ReportApiError(version, keep_alive, ex.what()));
+        }
+    }
+
     //currently all api requests performed inside one strand consecutively
     //TODO: switch to one strand per Session
     try {
@@ -267,6 +312,12 @@ void ApiHandler::Execute(http::request<Body, http::basic_fields<Allocator>>&& re
     }
 }
 
+template<typename Request>
+bool ApiHandler::IsRecordsRequest(const Request& req) const {
+    std::string_view target = req.target();
+    return RemoveIfHasPrefix(Uri::records, target) && (target.empty() || target.front() == '?');
+}
+
 template<typename... Args>
 void ApiHandler::CheckHttpMethod(const http::verb& received, Args&&... allowed) const {
     if(((received == allowed) || ...)) {
@@ -324,7 +375,7 @@ class RequestHandler {
  public:
     using Strand = net::strand<net::io_context::executor_type>;
 
-    RequestHandler(fs::path root, Strand api_strand, std::shared_ptr<app::GameInterface> game_app, model::TimeMs tick_period);
+    RequestHandler(fs::path root, Strand api_strand, std::shared_ptr<app::GameInterface> game_app, util::FixedStepClock::Settings tick_settings);
 
     RequestHandler(const RequestHandler&) = delete;
     RequestHandler& operator=(const RequestHandler&) = delete;
@@ -332,6 +383,8 @@ class RequestHandler {
     template<typename Body, typename Allocator, typename Send>
     void operator()(tcp::endpoint&&, http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send);
 
+    std::optional<util::FixedStepClock::Stats> GetTickStats() const { return api_handler_->GetTickStats(); }
+
  private:
     std::shared_ptr<ApiHandler> api_handler_;
     std::shared_ptr<FileHandler> file_handler_;
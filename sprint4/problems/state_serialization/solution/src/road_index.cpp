@@ -0,0 +1,244 @@
+#include "road_index.h"
+#include "model.h"
+
+#include <algorithm>
+#include <type_traits>
+
+namespace model {
+static_assert(std::is_same_v<RoadIndex::Coord, Coord>);
+
+//=================================================
+//================ RoadIndex::Axis ================
+void RoadIndex::Axis::Build(std::vector<std::pair<Coord, Span>> entries) {
+    lines.clear();
+    spans.clear();
+    breaks.clear();
+    at_break.clear();
+    after_break.clear();
+    extent_min.clear();
+    extent_max.clear();
+
+    //Group by line, inside a line order by start. Equal starts keep road order,
+    //so lower road indices are preferred where roads overlap
+    std::ranges::stable_sort(entries, [](const auto& lhs, const auto& rhs) {
+        return lhs.first != rhs.first ? lhs.first < rhs.first : lhs.second.min < rhs.second.min;
+    });
+    spans.reserve(entries.size());
+    breaks.reserve(entries.size() * 2);
+
+    for(size_t begin = 0; begin < entries.size();) {
+        const Coord coord = entries[begin].first;
+        size_t end = begin;
+        while(end < entries.size() && entries[end].first == coord) {
+            ++end;
+        }
+
+        Line line{coord, spans.size(), spans.size(), breaks.size(), breaks.size()};
+        for(size_t i = begin; i < end; ++i) {
+            spans.push_back(entries[i].second);
+            breaks.push_back(entries[i].second.min);
+            breaks.push_back(entries[i].second.max);
+        }
+        line.end_span = spans.size();
+
+        //Road ends on this line, sorted & unique
+        auto line_breaks_begin = breaks.begin() + static_cast<std::ptrdiff_t>(line.first_break);
+        std::sort(line_breaks_begin, breaks.end());
+        breaks.erase(std::unique(line_breaks_begin, breaks.end()), breaks.end());
+        line.end_break = breaks.size();
+
+        at_break.resize(breaks.size(), NO_ROAD);
+        after_break.resize(breaks.size(), NO_ROAD);
+
+        //Map every cut point and piece to the lowest-index road covering it
+        std::vector<const Span*> by_road_idx;
+        by_road_idx.reserve(end - begin);
+        for(size_t i = line.first_span; i < line.end_span; ++i) {
+            by_road_idx.push_back(&spans[i]);
+        }
+        std::ranges::sort(by_road_idx, {}, &Span::road_idx);
+
+        const auto line_breaks = std::span<const Coord>(breaks).subspan(line.first_break, line.end_break - line.first_break);
+        for(const Span* span : by_road_idx) {
+            const size_t lo = line.first_break + (std::ranges::lower_bound(line_breaks, span->min) - line_breaks.begin());
+            const size_t hi = line.first_break + (std::ranges::lower_bound(line_breaks, span->max) - line_breaks.begin());
+            for(size_t b = lo; b <= hi; ++b) {
+                if(at_break[b] == NO_ROAD) {
+                    at_break[b] = span->road_idx;
+                }
+                if(b < hi && after_break[b] == NO_ROAD) {
+                    after_break[b] = span->road_idx;
+                }
+            }
+        }
+
+        //Covered stretches: a cut point joins its neighbour when the piece between them is covered
+        extent_min.resize(breaks.size());
+        extent_max.resize(breaks.size());
+        for(size_t b = line.first_break; b < line.end_break; ++b) {
+            const bool joins_prev = b > line.first_break && after_break[b - 1] != NO_ROAD;
+            extent_min[b] = joins_prev ? extent_min[b - 1] : breaks[b];
+        }
+        for(size_t b = line.end_break; b-- > line.first_break;) {
+            const bool joins_next = b + 1 < line.end_break && after_break[b] != NO_ROAD;
+            extent_max[b] = joins_next ? extent_max[b + 1] : breaks[b];
+        }
+
+        lines.push_back(line);
+        begin = end;
+    }
+}
+
+const RoadIndex::Line* RoadIndex::Axis::FindLine(Coord coord) const {
+    auto it = std::ranges::lower_bound(lines, coord, {}, &Line::coord);
+    return it == lines.end() || it->coord != coord ? nullptr : &*it;
+}
+
+std::optional<RoadIndex::Axis::Location> RoadIndex::Axis::Locate(Coord line_coord, Coord pos) const {
+    const Line* line = FindLine(line_coord);
+    if(!line) {
+        return std::nullopt;
+    }
+
+    const auto first = breaks.begin() + static_cast<std::ptrdiff_t>(line->first_break);
+    const auto last = breaks.begin() + static_cast<std::ptrdiff_t>(line->end_break);
+
+    //first cut point after pos
+    const auto it = std::upper_bound(first, last, pos);
+    if(it == first) {
+        return std::nullopt;
+    }
+
+    const size_t b = static_cast<size_t>(std::prev(it) - breaks.begin());
+    return Location{b, breaks[b] == pos};
+}
+
+size_t RoadIndex::Axis::Find(Coord line_coord, Coord pos) const {
+    const auto loc = Locate(line_coord, pos);
+    if(!loc) {
+        return NO_ROAD;
+    }
+    //after_break of the last cut point on a line is always NO_ROAD
+    return loc->exact ? at_break[loc->break_idx] : after_break[loc->break_idx];
+}
+
+std::optional<RoadIndex::Extent> RoadIndex::Axis::FindExtent(Coord line_coord, Coord pos) const {
+    const auto loc = Locate(line_coord, pos);
+    if(!loc || (loc->exact ? at_break : after_break)[loc->break_idx] == NO_ROAD) {
+        return std::nullopt;
+    }
+    //pos is on the cut point or on the covered piece right after it, both share its stretch
+    return Extent{extent_min[loc->break_idx], extent_max[loc->break_idx]};
+}
+
+
+//=================================================
+//=================== RoadIndex ===================
+void RoadIndex::Build(std::span<const Road> roads) {
+    std::vector<std::pair<Coord, Span>> vertical;
+    std::vector<std::pair<Coord, Span>> horizontal;
+
+    for(size_t idx = 0; idx < roads.size(); ++idx) {
+        const Road& road = roads[idx];
+        if(road.IsVertical()) {
+            vertical.push_back({road.GetStart().x, Span{road.GetMinCoordY(), road.GetMaxCoordY(), idx}});
+        } else {
+            horizontal.push_back({road.GetStart().y, Span{road.GetMinCoordX(), road.GetMaxCoordX(), idx}});
+        }
+    }
+
+    vertical_.Build(std::move(vertical));
+    horizontal_.Build(std::move(horizontal));
+    BuildJunctions(roads.size());
+}
+
+size_t RoadIndex::FindVertRoad(Coord x, Coord y) const {
+    return vertical_.Find(x, y);
+}
+
+size_t RoadIndex::FindHorRoad(Coord x, Coord y) const {
+    return horizontal_.Find(y, x);
+}
+
+std::optional<RoadIndex::Extent> RoadIndex::FindVertExtent(Coord x, Coord y) const {
+    return vertical_.FindExtent(x, y);
+}
+
+std::optional<RoadIndex::Extent> RoadIndex::FindHorExtent(Coord x, Coord y) const {
+    return horizontal_.FindExtent(y, x);
+}
+
+std::span<const RoadIndex::Junction> RoadIndex::GetJunctions(size_t road_idx) const {
+    if(road_idx + 1 >= junction_offsets_.size()) {
+        return {};
+    }
+    return std::span<const Junction>(junctions_).subspan(
+        junction_offsets_[road_idx], junction_offsets_[road_idx + 1] - junction_offsets_[road_idx]
+    );
+}
+
+void RoadIndex::BuildJunctions(size_t road_count) {
+    //Position of a junction along the road it belongs to, used for ordering
+    struct Entry {
+        size_t owner;
+        Coord along;
+        Junction junction;
+    };
+    std::vector<Entry> entries;
+
+    auto add_pair = [&entries](Coord x, Coord y, size_t road_a, bool a_vertical, size_t road_b, bool b_vertical) {
+        entries.push_back({road_a, a_vertical ? y : x, Junction{x, y, road_b}});
+        entries.push_back({road_b, b_vertical ? y : x, Junction{x, y, road_a}});
+    };
+
+    //Crossings: every horizontal road against vertical lines within its x range
+    for(const Line& h_line : horizontal_.lines) {
+        const Coord y = h_line.coord;
+        for(size_t h = h_line.first_span; h < h_line.end_span; ++h) {
+            const Span& h_span = horizontal_.spans[h];
+
+            auto v_first = std::ranges::lower_bound(vertical_.lines, h_span.min, {}, &Line::coord);
+            for(auto v_line = v_first; v_line != vertical_.lines.end() && v_line->coord <= h_span.max; ++v_line) {
+                for(size_t v = v_line->first_span; v < v_line->end_span && vertical_.spans[v].min <= y; ++v) {
+                    const Span& v_span = vertical_.spans[v];
+                    if(v_span.max >= y) {
+                        add_pair(v_line->coord, y, h_span.road_idx, false, v_span.road_idx, true);
+                    }
+                }
+            }
+        }
+    }
+
+    //Continuations: collinear roads that touch or overlap, joined where the later one starts
+    auto add_collinear = [&add_pair](const Axis& axis, bool vertical) {
+        for(const Line& line : axis.lines) {
+            for(size_t i = line.first_span; i < line.end_span; ++i) {
+                const Span& cur = axis.spans[i];
+                for(size_t j = i + 1; j < line.end_span && axis.spans[j].min <= cur.max; ++j) {
+                    const Span& next = axis.spans[j];
+                    vertical
+                        ? add_pair(line.coord, next.min, cur.road_idx, true, next.road_idx, true)
+                        : add_pair(next.min, line.coord, cur.road_idx, false, next.road_idx, false);
+                }
+            }
+        }
+    };
+    add_collinear(vertical_, true);
+    add_collinear(horizontal_, false);
+
+    std::ranges::sort(entries, [](const Entry& lhs, const Entry& rhs) {
+        return lhs.owner != rhs.owner ? lhs.owner < rhs.owner : lhs.along < rhs.along;
+    });
+
+    junction_offsets_.assign(road_count + 1, 0);
+    junctions_.clear();
+    junctions_.reserve(entries.size());
+    for(const Entry& entry : entries) {
+        ++junction_offsets_[entry.owner + 1];
+        junctions_.push_back(entry.junction);
+    }
+    for(size_t i = 1; i < junction_offsets_.size(); ++i) {
+        junction_offsets_[i] += junction_offsets_[i - 1];
+    }
+}
+} // namespace model
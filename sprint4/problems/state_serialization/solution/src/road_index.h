@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace model {
+class Road;
+
+//Compiled, read-only lookup structure for the roads of one map.
+//Roads are grouped by the line they lie on (x for vertical, y for horizontal), lines are kept sorted,
+//so point-on-road queries are two binary searches and never touch a hash table.
+class RoadIndex {
+public:
+    using Coord = int;
+    static constexpr size_t NO_ROAD = std::numeric_limits<size_t>::max();
+
+    //Stretch of one line covered by road without gaps, possibly made of several roads
+    struct Extent {
+        Coord min;
+        Coord max;
+    };
+
+    //A point where another road crosses or touches the road
+    struct Junction {
+        Coord x;
+        Coord y;
+        size_t road_idx;
+    };
+
+    //Must be called again after the road list changes
+    void Build(std::span<const Road> roads);
+
+    //Index of a vertical road containing the point (x, y), NO_ROAD if there is none
+    size_t FindVertRoad(Coord x, Coord y) const;
+    //Index of a horizontal road containing the point (x, y), NO_ROAD if there is none
+    size_t FindHorRoad(Coord x, Coord y) const;
+
+    //Extent of connected vertical roads through the point (x, y), nullopt if no vertical road contains it
+    std::optional<Extent> FindVertExtent(Coord x, Coord y) const;
+    //Extent of connected horizontal roads through the point (x, y), nullopt if no horizontal road contains it
+    std::optional<Extent> FindHorExtent(Coord x, Coord y) const;
+
+    //Roads crossing or touching the road, ordered along it from its min to its max coord
+    std::span<const Junction> GetJunctions(size_t road_idx) const;
+
+private:
+    struct Span {
+        Coord min;
+        Coord max;
+        size_t road_idx;
+    };
+
+    //All roads lying on the same line. Road ends cut the line into pieces, each piece
+    //and each cut point is mapped to one road covering it (or NO_ROAD for gaps).
+    struct Line {
+        Coord coord;
+        size_t first_span, end_span;
+        size_t first_break, end_break;
+    };
+
+    //Roads of one orientation
+    struct Axis {
+        std::vector<Line> lines;
+        std::vector<Span> spans;
+
+        std::vector<Coord> breaks;
+        std::vector<size_t> at_break;
+        std::vector<size_t> after_break;
+
+        //Ends of the covered stretch each cut point belongs to, following continuation junctions
+        std::vector<Coord> extent_min;
+        std::vector<Coord> extent_max;
+
+        //entries: {line coord, road span on that line}
+        void Build(std::vector<std::pair<Coord, Span>> entries);
+        const Line* FindLine(Coord coord) const;
+
+        //Cut point at or before pos, and whether pos is exactly on it
+        struct Location {
+            size_t break_idx;
+            bool exact;
+        };
+        std::optional<Location> Locate(Coord line_coord, Coord pos) const;
+
+        size_t Find(Coord line_coord, Coord pos) const;
+        std::optional<Extent> FindExtent(Coord line_coord, Coord pos) const;
+    };
+
+    Axis vertical_;
+    Axis horizontal_;
+
+    //Junction lists of all roads, stored back to back: road i owns [offsets_[i], offsets_[i + 1])
+    std::vector<size_t> junction_offsets_;
+    std::vector<Junction> junctions_;
+
+    void BuildJunctions(size_t road_count);
+};
+} // namespace model
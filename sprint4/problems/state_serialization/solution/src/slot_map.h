@@ -0,0 +1,145 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+//Pool of objects addressed by generational handles.
+//Values are kept densely packed in one vector, so iteration is contiguous; add and remove are O(1).
+//Removing swaps the last value into the hole, so value order and dense indices change on removal.
+//A handle to a removed value never resolves again, even after its slot has been reused.
+template<typename T>
+class SlotMap {
+public:
+    struct Handle {
+        uint32_t index = NO_INDEX;
+        uint32_t generation = 0;
+
+        bool operator==(const Handle&) const = default;
+    };
+
+    using value_type = T;
+    using iterator = typename std::vector<T>::iterator;
+    using const_iterator = typename std::vector<T>::const_iterator;
+
+    void Reserve(size_t capacity) {
+        values_.reserve(capacity);
+        value_slots_.reserve(capacity);
+        slots_.reserve(capacity);
+    }
+
+    template<typename... Args>
+    Handle Emplace(Args&&... args) {
+        const auto dense_idx = static_cast<uint32_t>(values_.size());
+        values_.emplace_back(std::forward<Args>(args)...);
+
+        uint32_t slot_idx;
+        if(free_head_ != NO_INDEX) {
+            slot_idx = free_head_;
+            free_head_ = slots_[slot_idx].target;
+        } else {
+            slot_idx = static_cast<uint32_t>(slots_.size());
+            slots_.push_back({});
+        }
+        slots_[slot_idx].target = dense_idx;
+        value_slots_.push_back(slot_idx);
+
+        return {slot_idx, slots_[slot_idx].generation};
+    }
+
+    //Returns false if the handle is stale
+    bool Erase(Handle handle) {
+        if(!Contains(handle)) {
+            return false;
+        }
+
+        Slot& slot = slots_[handle.index];
+        const uint32_t dense_idx = slot.target;
+        const uint32_t last_idx = static_cast<uint32_t>(values_.size() - 1);
+
+        //Move the last value into the hole
+        if(dense_idx != last_idx) {
+            values_[dense_idx] = std::move(values_[last_idx]);
+            value_slots_[dense_idx] = value_slots_[last_idx];
+            slots_[value_slots_[dense_idx]].target = dense_idx;
+        }
+        values_.pop_back();
+        value_slots_.pop_back();
+
+        //Invalidate old handles and put the slot on the free list
+        ++slot.generation;
+        slot.target = free_head_;
+        free_head_ = handle.index;
+        return true;
+    }
+
+    void Clear() {
+        //Bump generations so no old handle survives
+        for(uint32_t slot_idx : value_slots_) {
+            Slot& slot = slots_[slot_idx];
+            ++slot.generation;
+            slot.target = free_head_;
+            free_head_ = slot_idx;
+        }
+        values_.clear();
+        value_slots_.clear();
+    }
+
+    bool Contains(Handle handle) const {
+        return handle.index < slots_.size()
+            && slots_[handle.index].generation == handle.generation
+            && slots_[handle.index].target < values_.size()
+            && value_slots_[slots_[handle.index].target] == handle.index;
+    }
+
+    //nullptr if the handle is stale
+    T* Find(Handle handle) {
+        return Contains(handle) ? &values_[slots_[handle.index].target] : nullptr;
+    }
+
+    const T* Find(Handle handle) const {
+        return Contains(handle) ? &values_[slots_[handle.index].target] : nullptr;
+    }
+
+    //Handle of the value currently at dense position idx
+    Handle GetHandle(size_t idx) const {
+        const uint32_t slot_idx = value_slots_.at(idx);
+        return {slot_idx, slots_[slot_idx].generation};
+    }
+
+    size_t Size() const { return values_.size(); }
+    size_t size() const { return values_.size(); }
+    bool Empty() const { return values_.empty(); }
+    bool empty() const { return values_.empty(); }
+
+    T& operator[](size_t idx) { return values_[idx]; }
+    const T& operator[](size_t idx) const { return values_[idx]; }
+
+    std::span<T> Values() { return values_; }
+    std::span<const T> Values() const { return values_; }
+
+    iterator begin() { return values_.begin(); }
+    iterator end() { return values_.end(); }
+    const_iterator begin() const { return values_.begin(); }
+    const_iterator end() const { return values_.end(); }
+
+private:
+    static constexpr uint32_t NO_INDEX = std::numeric_limits<uint32_t>::max();
+
+    struct Slot {
+        //Dense index of the value while in use, next free slot while free
+        uint32_t target = NO_INDEX;
+        uint32_t generation = 0;
+    };
+
+    std::vector<T> values_;
+    //Slot owning each value, parallel to values_
+    std::vector<uint32_t> value_slots_;
+    std::vector<Slot> slots_;
+    uint32_t free_head_ = NO_INDEX;
+};
+
+} // namespace util
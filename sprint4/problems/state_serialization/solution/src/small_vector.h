@@ -0,0 +1,209 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace util {
+
+//Vector that keeps up to N elements inside the object itself and only goes to the heap when it grows past N.
+//Once on the heap it stays there, clear() keeps the buffer, so a reserved vector never reallocates.
+template<typename T, size_t N>
+class SmallVector {
+    static_assert(N > 0, "use std::vector for no inline storage");
+
+public:
+    using value_type = T;
+    using size_type = size_t;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    SmallVector() = default;
+
+    SmallVector(std::initializer_list<T> init) {
+        reserve(init.size());
+        for(const auto& value : init) {
+            push_back(value);
+        }
+    }
+
+    SmallVector(const SmallVector& other) {
+        reserve(other.size_);
+        std::uninitialized_copy(other.begin(), other.end(), data_);
+        size_ = other.size_;
+    }
+
+    SmallVector(SmallVector&& other) noexcept(std::is_nothrow_move_constructible_v<T>) {
+        MoveFrom(std::move(other));
+    }
+
+    SmallVector& operator=(const SmallVector& other) {
+        if(this != &other) {
+            clear();
+            reserve(other.size_);
+            std::uninitialized_copy(other.begin(), other.end(), data_);
+            size_ = other.size_;
+        }
+        return *this;
+    }
+
+    SmallVector& operator=(SmallVector&& other) noexcept(std::is_nothrow_move_constructible_v<T>) {
+        if(this != &other) {
+            clear();
+            FreeHeap();
+            MoveFrom(std::move(other));
+        }
+        return *this;
+    }
+
+    ~SmallVector() {
+        clear();
+        FreeHeap();
+    }
+
+    void reserve(size_t new_capacity) {
+        if(new_capacity <= capacity_) {
+            return;
+        }
+
+        MoveTo(Allocate(new_capacity), new_capacity);
+    }
+
+    void push_back(const T& value) {
+        emplace_back(value);
+    }
+
+    void push_back(T&& value) {
+        emplace_back(std::move(value));
+    }
+
+    template<typename... Args>
+    T& emplace_back(Args&&... args) {
+        if(size_ == capacity_) {
+            return GrowAndEmplace(std::forward<Args>(args)...);
+        }
+        T* elem = std::construct_at(data_ + size_, std::forward<Args>(args)...);
+        ++size_;
+        return *elem;
+    }
+
+    void pop_back() {
+        std::destroy_at(data_ + --size_);
+    }
+
+    void clear() {
+        std::destroy(begin(), end());
+        size_ = 0;
+    }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    bool empty() const { return size_ == 0; }
+    bool is_inline() const { return data_ == InlineData(); }
+
+    T& operator[](size_t idx) { return data_[idx]; }
+    const T& operator[](size_t idx) const { return data_[idx]; }
+
+    T& at(size_t idx) {
+        if(idx >= size_) {
+            throw std::out_of_range("SmallVector index out of range");
+        }
+        return data_[idx];
+    }
+    const T& at(size_t idx) const {
+        return const_cast<SmallVector*>(this)->at(idx);
+    }
+
+    T& front() { return data_[0]; }
+    const T& front() const { return data_[0]; }
+    T& back() { return data_[size_ - 1]; }
+    const T& back() const { return data_[size_ - 1]; }
+
+    T* data() { return data_; }
+    const T* data() const { return data_; }
+
+    iterator begin() { return data_; }
+    iterator end() { return data_ + size_; }
+    const_iterator begin() const { return data_; }
+    const_iterator end() const { return data_ + size_; }
+
+    bool operator==(const SmallVector& other) const {
+        return std::equal(begin(), end(), other.begin(), other.end());
+    }
+
+private:
+    alignas(T) std::byte inline_storage_[sizeof(T) * N];
+    T* data_ = InlineData();
+    size_t size_ = 0;
+    size_t capacity_ = N;
+
+    T* InlineData() {
+        return reinterpret_cast<T*>(inline_storage_);
+    }
+    const T* InlineData() const {
+        return reinterpret_cast<const T*>(inline_storage_);
+    }
+
+    static T* Allocate(size_t capacity) {
+        return static_cast<T*>(::operator new(capacity * sizeof(T), std::align_val_t{alignof(T)}));
+    }
+
+    static void Deallocate(T* data) {
+        ::operator delete(data, std::align_val_t{alignof(T)});
+    }
+
+    void FreeHeap() {
+        if(!is_inline()) {
+            Deallocate(data_);
+            data_ = InlineData();
+            capacity_ = N;
+        }
+    }
+
+    //Moves the elements into new_data and makes it the buffer
+    void MoveTo(T* new_data, size_t new_capacity) {
+        std::uninitialized_move(begin(), end(), new_data);
+        std::destroy(begin(), end());
+        FreeHeap();
+
+        data_ = new_data;
+        capacity_ = new_capacity;
+    }
+
+    //args may refer to an element, e.g. push_back(v[0]): the new element is built before the old buffer goes away
+    template<typename... Args>
+    T& GrowAndEmplace(Args&&... args) {
+        const size_t new_capacity = capacity_ * 2;
+        T* new_data = Allocate(new_capacity);
+        T* elem = nullptr;
+        try {
+            elem = std::construct_at(new_data + size_, std::forward<Args>(args)...);
+        } catch(...) {
+            Deallocate(new_data);
+            throw;
+        }
+        MoveTo(new_data, new_capacity);
+        ++size_;
+        return *elem;
+    }
+
+    //Expects this to be empty and inline
+    void MoveFrom(SmallVector&& other) {
+        if(other.is_inline()) {
+            std::uninitialized_move(other.begin(), other.end(), data_);
+            size_ = other.size_;
+            other.clear();
+        } else {
+            //Take over the heap buffer
+            data_ = std::exchange(other.data_, other.InlineData());
+            size_ = std::exchange(other.size_, 0);
+            capacity_ = std::exchange(other.capacity_, N);
+        }
+    }
+};
+
+} // namespace util
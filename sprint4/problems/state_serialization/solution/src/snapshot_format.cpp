@@ -0,0 +1,225 @@
+#include "snapshot_format.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <istream>
+#include <iterator>
+#include <ostream>
+
+#include "state_serialization.h"
+#include "work_stealing_pool.h"
+
+namespace serialization {
+
+namespace {
+
+constexpr std::array<char, 4> SNAPSHOT_MAGIC{'G', 'S', 'N', 'P'};
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+constexpr size_t HEADER_SIZE = 32;
+constexpr size_t BLOCK_HEADER_SIZE = 8;
+
+enum SnapshotFlags : uint32_t {
+    SNAPSHOT_DEFLATE = 1u << 0,
+};
+
+struct SnapshotHeader {
+    uint32_t version = SNAPSHOT_VERSION;
+    uint32_t flags = 0;
+    uint32_t block_count = 0;
+    uint64_t payload_size = 0;
+    uint32_t payload_crc = 0;
+    uint32_t reserved = 0;
+
+    template <typename Archive>
+    void serialize(Archive& ar, const unsigned) {
+        ar& version;
+        ar& flags;
+        ar& block_count;
+        ar& payload_size;
+        ar& payload_crc;
+        ar& reserved;
+    }
+};
+
+uint32_t Checksum(std::span<const char> data) {
+    return static_cast<uint32_t>(crc32_z(0, reinterpret_cast<const Bytef*>(data.data()), data.size()));
+}
+
+void WriteBytes(std::ostream& out, std::span<const char> bytes) {
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+} // namespace
+
+void WriteSnapshot(std::ostream& out, const PsmRepr& repr, const SnapshotOptions& options) {
+    std::vector<char> payload;
+    BinaryOutArchive{payload} << repr;
+
+    const size_t block_size = std::clamp<size_t>(options.block_size, 1, UINT32_MAX);
+    SnapshotHeader header;
+    header.flags = options.compress ? SNAPSHOT_DEFLATE : 0;
+    header.block_count = static_cast<uint32_t>((payload.size() + block_size - 1) / block_size);
+    header.payload_size = payload.size();
+    header.payload_crc = Checksum(payload);
+
+    std::vector<char> head;
+    head.reserve(HEADER_SIZE);
+    head.insert(head.end(), SNAPSHOT_MAGIC.begin(), SNAPSHOT_MAGIC.end());
+    //The header struct itself carries no version field in the file
+    BinaryOutArchive head_ar{head};
+    header.serialize(head_ar, 0);
+    WriteBytes(out, head);
+
+    std::vector<char> deflated;
+    std::vector<char> block_head;
+    for(size_t offset = 0; offset < payload.size(); offset += block_size) {
+        const std::span<const char> raw{payload.data() + offset, std::min(block_size, payload.size() - offset)};
+        std::span<const char> stored = raw;
+        if(options.compress) {
+            uLongf deflated_size = compressBound(static_cast<uLong>(raw.size()));
+            deflated.resize(deflated_size);
+            //Fastest level: most of the gain comes from repeated field patterns, not from effort
+            if(compress2(reinterpret_cast<Bytef*>(deflated.data()), &deflated_size,
+                         reinterpret_cast<const Bytef*>(raw.data()), static_cast<uLong>(raw.size()),
+                         Z_BEST_SPEED) == Z_OK && deflated_size < raw.size()) {
+                stored = {deflated.data(), deflated_size};
+            }
+        }
+
+        block_head.clear();
+        BinaryOutArchive{block_head} << static_cast<uint32_t>(raw.size()) << static_cast<uint32_t>(stored.size());
+        WriteBytes(out, block_head);
+        WriteBytes(out, stored);
+    }
+    if(!out) {
+        throw std::runtime_error("Failed to write snapshot");
+    }
+}
+
+PsmRepr ReadSnapshot(std::span<const char> data, util::WorkStealingPool* pool) {
+    if(!IsBinarySnapshot(data)) {
+        throw std::runtime_error("Not a snapshot file");
+    }
+    if(data.size() < HEADER_SIZE) {
+        throw std::runtime_error("Snapshot is truncated");
+    }
+    SnapshotHeader header;
+    BinaryInArchive head_ar{data.subspan(SNAPSHOT_MAGIC.size(), HEADER_SIZE - SNAPSHOT_MAGIC.size())};
+    header.serialize(head_ar, 0);
+    if(header.version > SNAPSHOT_VERSION) {
+        throw std::runtime_error("Snapshot was written by a newer server");
+    }
+
+    //Block headers give every block its place in the payload before any of them is decoded
+    struct Block {
+        std::span<const char> stored;
+        size_t offset = 0;
+        uint32_t raw_size = 0;
+        uint32_t crc = 0;
+    };
+    std::vector<Block> blocks;
+    blocks.reserve(std::min<size_t>(header.block_count, data.size() / BLOCK_HEADER_SIZE));
+    size_t pos = HEADER_SIZE;
+    size_t offset = 0;
+    for(uint32_t block = 0; block < header.block_count; ++block) {
+        if(data.size() - pos < BLOCK_HEADER_SIZE) {
+            throw std::runtime_error("Snapshot is truncated");
+        }
+        uint32_t raw_size = 0;
+        uint32_t stored_size = 0;
+        BinaryInArchive{data.subspan(pos, BLOCK_HEADER_SIZE)} >> raw_size >> stored_size;
+        pos += BLOCK_HEADER_SIZE;
+        if(raw_size > header.payload_size - offset || stored_size > raw_size) {
+            throw std::runtime_error("Snapshot block is damaged");
+        }
+        if(data.size() - pos < stored_size) {
+            throw std::runtime_error("Snapshot is truncated");
+        }
+        blocks.push_back({data.subspan(pos, stored_size), offset, raw_size});
+        pos += stored_size;
+        offset += raw_size;
+    }
+    if(offset != header.payload_size) {
+        throw std::runtime_error("Snapshot checksum mismatch");
+    }
+
+    std::vector<char> payload(header.payload_size);
+    const auto decode = [&payload](Block& block) {
+        char* raw = payload.data() + block.offset;
+        if(block.stored.size() == block.raw_size) {
+            std::memcpy(raw, block.stored.data(), block.raw_size);
+        } else {
+            uLongf inflated_size = block.raw_size;
+            const int status = uncompress(reinterpret_cast<Bytef*>(raw), &inflated_size,
+                                          reinterpret_cast<const Bytef*>(block.stored.data()),
+                                          static_cast<uLong>(block.stored.size()));
+            if(status != Z_OK || inflated_size != block.raw_size) {
+                throw std::runtime_error("Snapshot block is damaged");
+            }
+        }
+        block.crc = Checksum({raw, block.raw_size});
+    };
+    if(pool && blocks.size() > 1) {
+        std::vector<util::WorkStealingPool::Task> tasks;
+        tasks.reserve(blocks.size());
+        for(auto& block : blocks) {
+            tasks.emplace_back([&decode, &block] {
+                decode(block);
+            });
+        }
+        pool->RunAll(std::move(tasks));
+    } else {
+        std::ranges::for_each(blocks, decode);
+    }
+
+    //Block checksums chain into the one of the whole payload
+    uint32_t payload_crc = 0;
+    for(const auto& block : blocks) {
+        payload_crc = static_cast<uint32_t>(crc32_combine(payload_crc, block.crc, block.raw_size));
+    }
+    if(payload_crc != header.payload_crc) {
+        throw std::runtime_error("Snapshot checksum mismatch");
+    }
+
+    PsmRepr repr;
+    BinaryInArchive payload_ar{payload};
+    payload_ar >> repr;
+    if(payload_ar.GetRemaining() != 0) {
+        throw std::runtime_error("Snapshot has trailing data");
+    }
+    return repr;
+}
+
+PsmRepr ReadSnapshot(std::istream& in, util::WorkStealingPool* pool) {
+    std::vector<char> data;
+    const auto start = in.tellg();
+    if(start != std::istream::pos_type(-1) && in.seekg(0, std::ios_base::end)) {
+        data.resize(static_cast<size_t>(in.tellg() - start));
+        in.seekg(start);
+        in.read(data.data(), static_cast<std::streamsize>(data.size()));
+    } else {
+        //Not seekable
+        in.clear();
+        data.assign(std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{});
+    }
+    return ReadSnapshot(std::span{data}, pool);
+}
+
+bool IsBinarySnapshot(std::span<const char> data) {
+    return data.size() >= SNAPSHOT_MAGIC.size() && std::equal(SNAPSHOT_MAGIC.begin(), SNAPSHOT_MAGIC.end(), data.begin());
+}
+
+bool IsBinarySnapshot(std::istream& in) {
+    const auto start = in.tellg();
+    std::array<char, SNAPSHOT_MAGIC.size()> magic{};
+    in.read(magic.data(), magic.size());
+    const bool is_snapshot = in.gcount() == static_cast<std::streamsize>(magic.size()) && magic == SNAPSHOT_MAGIC;
+    in.clear();
+    in.seekg(start);
+    return is_snapshot;
+}
+
+} // namespace serialization
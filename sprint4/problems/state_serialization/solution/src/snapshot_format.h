@@ -0,0 +1,265 @@
+#pragma once
+#include <boost/endian/conversion.hpp>
+#include <boost/serialization/version.hpp>
+
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iosfwd>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "small_vector.h"
+
+namespace util {
+class WorkStealingPool;
+} // namespace util
+
+namespace serialization {
+
+//=================================================
+//================ Binary archive =================
+//Drop-in for the boost text archives in the Repr serialize() templates:
+//every field is written at the fixed width of its type, little-endian, with no separators.
+//Objects with a serialize() member carry their class version, a vector of them carries it once
+namespace detail {
+
+template <typename T>
+struct IsSequence : std::false_type {};
+
+template <typename T, typename Alloc>
+struct IsSequence<std::vector<T, Alloc>> : std::true_type {};
+
+template <typename T, size_t N>
+struct IsSequence<util::SmallVector<T, N>> : std::true_type {};
+
+template <typename T>
+struct IsDuration : std::false_type {};
+
+template <typename Rep, typename Period>
+struct IsDuration<std::chrono::duration<Rep, Period>> : std::true_type {};
+
+template <typename T, typename Archive>
+concept HasSerializeMember = requires(T& obj, Archive& ar) { obj.serialize(ar, 0u); };
+
+template <typename T>
+using Unsigned = std::make_unsigned_t<T>;
+
+template <typename T>
+constexpr uint32_t ClassVersion() {
+    return boost::serialization::version<T>::value;
+}
+
+} // namespace detail
+
+class BinaryOutArchive {
+public:
+    explicit BinaryOutArchive(std::vector<char>& buffer)
+        : buffer_(buffer) {
+    }
+
+    template <typename T>
+    BinaryOutArchive& operator&(const T& value) {
+        Save(value);
+        return *this;
+    }
+
+    template <typename T>
+    BinaryOutArchive& operator<<(const T& value) {
+        Save(value);
+        return *this;
+    }
+
+private:
+    std::vector<char>& buffer_;
+
+    template <typename Int>
+    void PutInt(Int value) {
+        const auto le = boost::endian::native_to_little(value);
+        const auto old_size = buffer_.size();
+        buffer_.resize(old_size + sizeof(le));
+        std::memcpy(buffer_.data() + old_size, &le, sizeof(le));
+    }
+
+    template <typename T>
+    void Save(const T& value) {
+        if constexpr(std::is_same_v<T, bool>) {
+            PutInt(static_cast<uint8_t>(value));
+        } else if constexpr(std::is_enum_v<T>) {
+            PutInt(static_cast<detail::Unsigned<std::underlying_type_t<T>>>(value));
+        } else if constexpr(std::is_integral_v<T>) {
+            PutInt(static_cast<detail::Unsigned<T>>(value));
+        } else if constexpr(std::is_same_v<T, double>) {
+            PutInt(std::bit_cast<uint64_t>(value));
+        } else if constexpr(std::is_same_v<T, std::string>) {
+            PutInt(static_cast<uint32_t>(value.size()));
+            buffer_.insert(buffer_.end(), value.begin(), value.end());
+        } else if constexpr(detail::IsDuration<T>::value) {
+            PutInt(static_cast<uint64_t>(value.count()));
+        } else if constexpr(detail::IsSequence<T>::value) {
+            using Item = typename T::value_type;
+            PutInt(static_cast<uint64_t>(value.size()));
+            if constexpr(detail::HasSerializeMember<Item, BinaryOutArchive>) {
+                PutInt(detail::ClassVersion<Item>());
+            }
+            for(const auto& item : value) {
+                SaveFields(item);
+            }
+        } else if constexpr(detail::HasSerializeMember<T, BinaryOutArchive>) {
+            PutInt(detail::ClassVersion<T>());
+            SaveFields(value);
+        } else {
+            SaveFields(value);
+        }
+    }
+
+    //Without the version, the caller has written it
+    template <typename T>
+    void SaveFields(const T& value) {
+        //serialize() is one function for both directions, so it takes a non-const ref
+        auto& obj = const_cast<T&>(value);
+        if constexpr(detail::HasSerializeMember<T, BinaryOutArchive>) {
+            obj.serialize(*this, detail::ClassVersion<T>());
+        } else if constexpr(std::is_class_v<T> && !detail::IsSequence<T>::value && !detail::IsDuration<T>::value
+                            && !std::is_same_v<T, std::string>) {
+            //Free serialize() next to the type
+            serialize(*this, obj, 0u);
+        } else {
+            Save(value);
+        }
+    }
+};
+
+class BinaryInArchive {
+public:
+    explicit BinaryInArchive(std::span<const char> data)
+        : data_(data) {
+    }
+
+    template <typename T>
+    BinaryInArchive& operator&(T& value) {
+        Load(value);
+        return *this;
+    }
+
+    template <typename T>
+    BinaryInArchive& operator>>(T& value) {
+        Load(value);
+        return *this;
+    }
+
+    size_t GetRemaining() const {
+        return data_.size() - pos_;
+    }
+
+private:
+    std::span<const char> data_;
+    size_t pos_ = 0;
+
+    void Require(size_t bytes) const {
+        if(GetRemaining() < bytes) {
+            throw std::runtime_error("Snapshot is truncated");
+        }
+    }
+
+    template <typename Int>
+    Int GetInt() {
+        Require(sizeof(Int));
+        Int le;
+        std::memcpy(&le, data_.data() + pos_, sizeof(le));
+        pos_ += sizeof(le);
+        return boost::endian::little_to_native(le);
+    }
+
+    template <typename T>
+    void Load(T& value) {
+        if constexpr(std::is_same_v<T, bool>) {
+            value = GetInt<uint8_t>() != 0;
+        } else if constexpr(std::is_enum_v<T>) {
+            value = static_cast<T>(GetInt<detail::Unsigned<std::underlying_type_t<T>>>());
+        } else if constexpr(std::is_integral_v<T>) {
+            value = static_cast<T>(GetInt<detail::Unsigned<T>>());
+        } else if constexpr(std::is_same_v<T, double>) {
+            value = std::bit_cast<double>(GetInt<uint64_t>());
+        } else if constexpr(std::is_same_v<T, std::string>) {
+            const auto size = GetInt<uint32_t>();
+            Require(size);
+            value.assign(data_.data() + pos_, size);
+            pos_ += size;
+        } else if constexpr(detail::IsDuration<T>::value) {
+            value = T{static_cast<typename T::rep>(GetInt<uint64_t>())};
+        } else if constexpr(detail::IsSequence<T>::value) {
+            using Item = typename T::value_type;
+            const auto count = GetInt<uint64_t>();
+            uint32_t version = 0;
+            if constexpr(detail::HasSerializeMember<Item, BinaryInArchive>) {
+                version = GetVersion<Item>();
+            }
+            //Every item takes at least a byte, a bigger count is garbage, not a reason to allocate
+            Require(count);
+            value.clear();
+            value.reserve(count);
+            for(uint64_t i = 0; i < count; ++i) {
+                Item item;
+                LoadFields(item, version);
+                value.push_back(std::move(item));
+            }
+        } else if constexpr(detail::HasSerializeMember<T, BinaryInArchive>) {
+            LoadFields(value, GetVersion<T>());
+        } else {
+            LoadFields(value, 0u);
+        }
+    }
+
+    template <typename T>
+    uint32_t GetVersion() {
+        const auto version = GetInt<uint32_t>();
+        if(version > detail::ClassVersion<T>()) {
+            throw std::runtime_error("Snapshot was written by a newer server");
+        }
+        return version;
+    }
+
+    template <typename T>
+    void LoadFields(T& value, uint32_t version) {
+        if constexpr(detail::HasSerializeMember<T, BinaryInArchive>) {
+            value.serialize(*this, version);
+        } else if constexpr(std::is_class_v<T> && !detail::IsSequence<T>::value && !detail::IsDuration<T>::value
+                            && !std::is_same_v<T, std::string>) {
+            serialize(*this, value, 0u);
+        } else {
+            Load(value);
+        }
+    }
+};
+
+
+//=================================================
+//================ Snapshot file ==================
+//Header, all integers little-endian:
+//  magic "GSNP" | format version u32 | flags u32 | block count u32 | payload size u64 | payload crc32 u32 | reserved u32
+//followed by the payload, a BinaryOutArchive of PsmRepr, cut into blocks:
+//  raw size u32 | stored size u32 | stored bytes, deflated when smaller than raw
+class PsmRepr;
+
+struct SnapshotOptions {
+    bool compress = true;
+    //Payload bytes per block, blocks are compressed independently
+    size_t block_size = 1u << 20;
+};
+
+void WriteSnapshot(std::ostream& out, const PsmRepr& repr, const SnapshotOptions& options = {});
+//Throws std::runtime_error if the snapshot is damaged or not a snapshot.
+//Blocks are independent, with a pool they are inflated and checked concurrently
+PsmRepr ReadSnapshot(std::span<const char> data, util::WorkStealingPool* pool = nullptr);
+PsmRepr ReadSnapshot(std::istream& in, util::WorkStealingPool* pool = nullptr);
+
+bool IsBinarySnapshot(std::span<const char> data);
+//Peeks at the magic, the stream position is left where it was
+bool IsBinarySnapshot(std::istream& in);
+
+} // namespace serialization
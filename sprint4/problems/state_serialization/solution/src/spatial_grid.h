@@ -0,0 +1,135 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "geom.h"
+
+namespace util {
+
+//Uniform grid over a set of points, rebuilt from scratch when they move.
+//Build is two passes of counting sort, a radius query only visits the cells the circle overlaps.
+class SpatialGrid {
+public:
+    explicit SpatialGrid(double cell_size)
+        : cell_size_(cell_size > 0 ? cell_size : 1.0) {
+    }
+
+    //Replaces the content with count points, get_pos(i) gives the position of point i
+    template<typename GetPos>
+    void Build(size_t count, GetPos&& get_pos) {
+        entries_.clear();
+        cell_start_.clear();
+        if(count == 0) {
+            return;
+        }
+
+        auto& unsorted = scratch_;
+        unsorted.clear();
+        double max_x = get_pos(0).x, max_y = get_pos(0).y;
+        min_x_ = max_x;
+        min_y_ = max_y;
+        for(size_t i = 0; i < count; ++i) {
+            const geom::Point2D pos = get_pos(i);
+            unsorted.push_back({pos, static_cast<uint32_t>(i)});
+            min_x_ = std::min(min_x_, pos.x);
+            min_y_ = std::min(min_y_, pos.y);
+            max_x = std::max(max_x, pos.x);
+            max_y = std::max(max_y, pos.y);
+        }
+
+        //Sparse points on a big map would leave most cells empty, coarser cells keep the table near count
+        step_ = cell_size_;
+        const double max_cells = static_cast<double>(std::max<size_t>(64, count * 4));
+        while(CellsAlong(max_x - min_x_) * CellsAlong(max_y - min_y_) > max_cells) {
+            step_ *= 2;
+        }
+        cols_ = static_cast<size_t>(CellsAlong(max_x - min_x_));
+        rows_ = static_cast<size_t>(CellsAlong(max_y - min_y_));
+
+        cell_start_.assign(cols_ * rows_ + 1, 0);
+        for(const auto& entry : unsorted) {
+            ++cell_start_[CellOf(entry.pos) + 1];
+        }
+        for(size_t cell = 1; cell < cell_start_.size(); ++cell) {
+            cell_start_[cell] += cell_start_[cell - 1];
+        }
+        entries_.resize(count);
+        //Counts turn into the write position of each cell
+        fill_.assign(cell_start_.begin(), cell_start_.end() - 1);
+        for(const auto& entry : unsorted) {
+            entries_[fill_[CellOf(entry.pos)]++] = entry;
+        }
+    }
+
+    //Calls fn(i) for every point i within radius of center, in no particular order
+    template<typename Fn>
+    void ForEachInRadius(geom::Point2D center, double radius, Fn&& fn) const {
+        if(entries_.empty() || radius < 0) {
+            return;
+        }
+        const auto first_col = std::max<int64_t>(0, ClampCell(center.x - radius - min_x_, cols_));
+        const auto last_col = std::min<int64_t>(cols_ - 1, ClampCell(center.x + radius - min_x_, cols_));
+        const auto first_row = std::max<int64_t>(0, ClampCell(center.y - radius - min_y_, rows_));
+        const auto last_row = std::min<int64_t>(rows_ - 1, ClampCell(center.y + radius - min_y_, rows_));
+        if(first_col > last_col || first_row > last_row) {
+            return;
+        }
+
+        const double sq_radius = radius * radius;
+        for(auto row = first_row; row <= last_row; ++row) {
+            //Cells of a row are adjacent in entries_
+            const auto begin = cell_start_[static_cast<size_t>(row) * cols_ + static_cast<size_t>(first_col)];
+            const auto end = cell_start_[static_cast<size_t>(row) * cols_ + static_cast<size_t>(last_col) + 1];
+            for(auto i = begin; i < end; ++i) {
+                const auto& entry = entries_[i];
+                const double dx = entry.pos.x - center.x;
+                const double dy = entry.pos.y - center.y;
+                if(dx * dx + dy * dy <= sq_radius) {
+                    fn(static_cast<size_t>(entry.idx));
+                }
+            }
+        }
+    }
+
+    size_t Size() const { return entries_.size(); }
+
+private:
+    struct Entry {
+        geom::Point2D pos;
+        uint32_t idx;
+    };
+
+    double cell_size_;
+    //Actual cell size after coarsening
+    double step_ = 1.0;
+    double min_x_ = 0;
+    double min_y_ = 0;
+    size_t cols_ = 0;
+    size_t rows_ = 0;
+    //Entries of cell c are entries_[cell_start_[c], cell_start_[c + 1]), cells row by row
+    std::vector<uint32_t> cell_start_;
+    std::vector<Entry> entries_;
+    //Kept between builds for their capacity
+    std::vector<Entry> scratch_;
+    std::vector<uint32_t> fill_;
+
+    double CellsAlong(double extent) const {
+        return std::floor(extent / step_) + 1;
+    }
+
+    size_t CellOf(geom::Point2D pos) const {
+        const auto col = std::min(cols_ - 1, static_cast<size_t>((pos.x - min_x_) / step_));
+        const auto row = std::min(rows_ - 1, static_cast<size_t>((pos.y - min_y_) / step_));
+        return row * cols_ + col;
+    }
+
+    //-1 or size mean the coordinate is off the grid on that side
+    int64_t ClampCell(double offset, size_t size) const {
+        const double cell = std::floor(offset / step_);
+        return static_cast<int64_t>(std::clamp(cell, -1.0, static_cast<double>(size)));
+    }
+};
+
+} // namespace util
@@ -1,5 +1,15 @@
 #include "state_serialization.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <charconv>
+
+#include "server_logger.h"
+#include "work_stealing_pool.h"
+
 serialization::DogRepr::DogRepr(const model::Dog& dog): id_(dog.GetId())
     , pos_(dog.GetPos())
     , width_(dog.GetWidth())
@@ -8,7 +18,10 @@ serialization::DogRepr::DogRepr(const model::Dog& dog): id_(dog.GetId())
     , tag_(dog.GetTag())
     , bag_capacity_(dog.GetBagCap())
     , score_(dog.GetScore())
-    , bag_content_(dog.GetBag()) {
+    , bag_content_(dog.GetBag())
+    , join_time_ms_(dog.GetJoinTime().count())
+    , is_idle_(dog.GetIdleSince().has_value())
+    , idle_since_ms_(dog.GetIdleSince().value_or(model::TimeMs{0}).count()) {
 }
 
 model::Dog serialization::DogRepr::Restore() const {
@@ -16,6 +29,8 @@ model::Dog serialization::DogRepr::Restore() const {
     dog.SetSpeed(speed_);
     dog.SetDirection(direction_);
     dog.AddScore(score_);
+    dog.SetJoinTime(model::TimeMs{join_time_ms_});
+    dog.SetIdleSince(is_idle_ ? std::make_optional(model::TimeMs{idle_since_ms_}) : std::nullopt);
     for (const auto& item : bag_content_) {
         if (!dog.TryCollectItem(item)) {
             throw std::runtime_error("Failed to put bag content");
@@ -30,20 +45,69 @@ serialization::LootItemRepr::LootItemRepr(const model::LootItem& item)
     , pos(item.GetPos()) {
 }
 
+serialization::SessionCapture::SessionCapture(const app::Session& session)
+    : id(session.GetId())
+    , map_id(session.GetMapId())
+    , time(session.GetTime())
+    , generator(session.GetGeneratorState())
+    , loot_items(session.GetLootItems().begin(), session.GetLootItems().end()) {
+    dogs.reserve(session.GetGatherers().size());
+    for(const auto dog : session.GetGatherers()) {
+        //Slots of removed dogs stay empty until the next tick compacts them
+        if(dog) {
+            dogs.push_back(*dog);
+        }
+    }
+}
+
+serialization::StateCapture::StateCapture(const app::PlayerSessionManager& psm)
+    : counters(psm.GetIdCounters()) {
+    sessions.reserve(psm.GetAllSessions().size());
+    players.reserve(psm.GetAllPlayers().size());
+    for(const auto& [_, session] : psm.GetAllSessions()) {
+        sessions.emplace_back(session);
+    }
+    for(const auto& [_, player] : psm.GetAllPlayers()) {
+        if(auto token = psm.GetToken(player.GetId()); token) {
+            players.push_back({player.GetId(), player.GetSession()->GetId(), player.GetDog()->GetId(), *token});
+        } else {
+            //DEBUG
+            std::cerr << "invalid pl.token found when saving game state" << std::endl;
+        }
+    }
+}
+
 serialization::SessionRepr::SessionRepr(const app::Session& session)
-    : id_(session.GetId())
-    , map_id_content_(*session.GetMapId()) {
-    for(const auto& [_, dog] : session.GetDogs()) {
-        dog_reprs_.emplace_back(DogRepr{dog});
+    : SessionRepr(SessionCapture{session}) {
+}
+
+serialization::SessionRepr::SessionRepr(const SessionCapture& session)
+    : id_(session.id)
+    , map_id_content_(*session.map_id)
+    , time_ms_(session.time.count())
+    , next_object_id_(session.generator.next_object_id)
+    , time_without_loot_ms_(session.generator.time_without_loot.count()) {
+    std::ostringstream rng_out;
+    rng_out << session.generator.rng;
+    rng_state_ = rng_out.str();
+
+    dog_reprs_.reserve(session.dogs.size());
+    loot_item_reprs_.reserve(session.loot_items.size());
+    //Collision order, restoring adds them back in it
+    for(const auto& dog : session.dogs) {
+        dog_reprs_.emplace_back(dog);
     }
-    for(const auto& item : session.GetLootItems()) {
-        loot_item_reprs_.emplace_back(LootItemRepr{*item});
+    for(const auto& item : session.loot_items) {
+        loot_item_reprs_.emplace_back(item);
     }
 }
 
 app::Session serialization::SessionRepr::Restore(const app::GamePtr& game) const {
     const model::Map::Id map_id{map_id_content_};
     app::Session session(id_, game->FindMap(map_id), game->GetSettings());
+    //Before the dogs, their times are session times
+    session.SetTime(model::TimeMs{time_ms_});
+    session.Reserve(dog_reprs_.size(), loot_item_reprs_.size());
 
     //Restore dogs and loot items
     for(const auto& dog : dog_reprs_) {
@@ -52,6 +116,16 @@ app::Session serialization::SessionRepr::Restore(const app::GamePtr& game) const
     for(const auto& item : loot_item_reprs_) {
         session.AddLootItem(item.id, item.type, item.pos);
     }
+    if(!rng_state_.empty()) {
+        app::Session::GeneratorState state;
+        std::istringstream rng_in{rng_state_};
+        if(!(rng_in >> state.rng)) {
+            throw std::runtime_error("Malformed session random state in save file");
+        }
+        state.next_object_id = next_object_id_;
+        state.time_without_loot = model::TimeMs{time_without_loot_ms_};
+        session.SetGeneratorState(state);
+    }
     return session;
 }
 
@@ -59,10 +133,10 @@ app::Session::Id serialization::SessionRepr::GetId() const {
     return id_;
 }
 
-serialization::PlayerRepr::PlayerRepr(const app::Player& player, app::Token token): id_(player.GetId())
-    , session_id_(player.GetSession()->GetId())
-    , dog_id_(player.GetDog()->GetId())
-    , token_content_(std::move(*token)) {
+serialization::PlayerRepr::PlayerRepr(const PlayerCapture& player): id_(player.id)
+    , session_id_(player.session_id)
+    , dog_id_(player.dog_id)
+    , token_content_(player.token.ToHex()) {
 }
 
 app::Player::Id serialization::PlayerRepr::GetId() const {
@@ -78,96 +152,423 @@ model::Dog::Id serialization::PlayerRepr::GetDogId() const {
 }
 
 app::Token serialization::PlayerRepr::GetToken() const {
-    return app::Token{token_content_};
+    const auto token = app::Token::FromHex(token_content_);
+    if (!token) {
+        throw std::runtime_error("Malformed player token in save file");
+    }
+    return *token;
 }
 
-serialization::PsmRepr::PsmRepr(const app::PlayerSessionManager& psm) {
-    for(const auto& [_, session] : psm.GetAllSessions()) {
+serialization::PsmRepr::PsmRepr(const app::PlayerSessionManager& psm)
+    : PsmRepr(StateCapture{psm}) {
+}
+
+serialization::PsmRepr::PsmRepr(const StateCapture& state)
+    : next_dog_id_(state.counters.next_dog)
+    , next_player_id_(state.counters.next_player)
+    , next_session_id_(state.counters.next_session)
+    , log_segment_(state.log_segment) {
+    session_reprs_.reserve(state.sessions.size());
+    player_reprs_.reserve(state.players.size());
+    for(const auto& session : state.sessions) {
         session_reprs_.emplace_back(session);
     }
-
-    for(const auto& [_, player] : psm.GetAllPlayers()) {
-        if(auto token = psm.GetToken(player.GetId()); token) {
-            player_reprs_.emplace_back(player, *token);
-        } else {
-            //DEBUG
-            std::cerr << "invalid pl.token found when saving game state" << std::endl;
-        }
+    for(const auto& player : state.players) {
+        player_reprs_.emplace_back(player);
     }
+    //Rosters are sorted by player id, restoring in that order appends instead of inserting in the middle
+    std::ranges::sort(player_reprs_, {}, &PlayerRepr::GetId);
 }
 
-app::PlayerSessionManager serialization::PsmRepr::Restore(const app::GamePtr& game) const {
-    //Restores loot items and dogs inside session
-    size_t next_session_id = 0u;
-    size_t next_p = 0u;
+app::PlayerSessionManager serialization::PsmRepr::Restore(const app::GamePtr& game, util::WorkStealingPool* pool,
+                                                          size_t* skipped_players) const {
+    //Restores loot items and dogs inside session. Sessions share nothing, with a pool they are rebuilt concurrently
+    std::vector<std::optional<app::Session>> sessions(session_reprs_.size());
+    if(pool && sessions.size() > 1) {
+        std::vector<util::WorkStealingPool::Task> tasks;
+        tasks.reserve(sessions.size());
+        for(size_t i = 0; i < sessions.size(); ++i) {
+            tasks.emplace_back([this, &game, &sessions, i] {
+                sessions[i].emplace(session_reprs_[i].Restore(game));
+            });
+        }
+        pool->RunAll(std::move(tasks));
+    } else {
+        for(size_t i = 0; i < sessions.size(); ++i) {
+            sessions[i].emplace(session_reprs_[i].Restore(game));
+        }
+    }
     app::PlayerSessionManager::Sessions restored_sessions;
-    for(const auto sess_repr : session_reprs_) {
-        auto id = sess_repr.GetId();
-        restored_sessions.emplace(id, std::move(sess_repr.Restore(game)));
+    restored_sessions.reserve(sessions.size());
+    for(auto& session : sessions) {
+        const auto id = session->GetId();
+        restored_sessions.emplace(id, std::move(*session));
     }
+
     //Restore players in the player manager
+    std::vector<app::PlayerSessionManager::RestoredPlayer> players;
+    players.reserve(player_reprs_.size());
+    for(const auto& plr : player_reprs_) {
+        players.push_back({plr.GetId(), plr.GetDogId(), plr.GetSessionId(), plr.GetToken()});
+    }
     app::PlayerSessionManager psm(game, std::move(restored_sessions));
-    for(const auto plr : player_reprs_) {
-        psm.RestorePlayer(plr.GetId(), plr.GetDogId(), plr.GetSessionId(), std::move(plr.GetToken()));
+    const auto skipped = psm.RestorePlayers(players);
+    if(skipped_players) {
+        *skipped_players = skipped;
     }
+    //Ids of players that retired before the save must not come back
+    auto counters = psm.GetIdCounters();
+    counters.next_dog = std::max(counters.next_dog, next_dog_id_);
+    counters.next_player = std::max(counters.next_player, next_player_id_);
+    counters.next_session = std::max(counters.next_session, next_session_id_);
+    psm.SetIdCounters(counters);
     return psm;
 }
 
-serialization::StateSerializer::StateSerializer(fs::path save_file, bool enable_periodic_backup, int64_t save_period)
+uint64_t serialization::PsmRepr::GetLogSegment() const {
+    return log_segment_;
+}
+
+void serialization::PsmRepr::SetLogSegment(uint64_t segment) {
+    log_segment_ = segment;
+}
+
+serialization::StateSerializer::StateSerializer(fs::path save_file, bool enable_periodic_backup, int64_t save_period,
+                                                SnapshotOptions snapshot_options, bool enable_state_log)
     : save_file_(save_file.filename())
     , save_dir_(save_file.parent_path())
     , enable_periodic_backup_(enable_periodic_backup)
-    , save_period_(save_period) {
+    , save_period_(save_period)
+    , snapshot_options_(snapshot_options)
+    , enable_state_log_(enable_state_log)
+    , thread_([this] {
+        Run();
+    }) {
 }
 
-void serialization::StateSerializer::OnTick(model::TimeMs delta_t, const app::PlayerSessionManager& psm) {
+serialization::StateSerializer::~StateSerializer() {
+    {
+        std::lock_guard lock{mtx_};
+        stop_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+}
+
+void serialization::StateSerializer::OnJoin(app::ConstPlayerPtr player, const app::Token& token) {
+    if(!enable_state_log_) {
+        return;
+    }
+    std::lock_guard lock{log_mtx_};
+    auto& log = GetLog();
+    log.RecordJoin(player->GetId(), *player->GetMap()->GetId(), *player->GetDog()->GetTag(), token);
+    //Flushed per record: a crashed process loses nothing a client was answered about
+    log.Flush();
+}
+
+void serialization::StateSerializer::OnMove(app::ConstPlayerPtr player, char move) {
+    if(!enable_state_log_) {
+        return;
+    }
+    std::lock_guard lock{log_mtx_};
+    auto& log = GetLog();
+    log.RecordMove(player->GetId(), move);
+    log.Flush();
+}
+
+void serialization::StateSerializer::OnTick(model::TimeMs delta_t, std::span<const app::RetiredPlayer> retired,
+                                            const app::PlayerSessionManager& psm) {
+    if(enable_state_log_) {
+        std::lock_guard lock{log_mtx_};
+        auto& log = GetLog();
+        log.RecordTick(delta_t);
+        for(const auto& player : retired) {
+            log.RecordRetire(player.id);
+        }
+        log.Flush();
+    }
+
     time_since_last_save_ += delta_t;
 
     //Do not save On tick if save file or save_period are nullopt
     if(!enable_periodic_backup_ || time_since_last_save_ < save_period_) {
-        time_since_last_save_ += delta_t;
         return;
     }
 
-    //Otherwise, need to save game state
-    time_since_last_save_ = model::TimeMs{0u};
-    SaveGameState(psm);
+    //Otherwise, need to save game state. A busy writer is retried on the next tick
+    if(StartBackgroundSave(psm)) {
+        time_since_last_save_ = model::TimeMs{0u};
+    }
 }
 
-void serialization::StateSerializer::SaveGameState(const app::PlayerSessionManager& psm) const {
+void serialization::StateSerializer::SaveGameState(const app::PlayerSessionManager& psm) {
+    WriteFile(PsmRepr{Capture(psm)});
+}
+
+void serialization::StateSerializer::Flush() const {
+    std::unique_lock lock{mtx_};
+    idle_.wait(lock, [this] {
+        return !pending_ && !writing_;
+    });
+}
+
+serialization::StateSerializer::Stats serialization::StateSerializer::GetStats() const {
+    std::lock_guard lock{mtx_};
+    return stats_;
+}
+
+bool serialization::StateSerializer::StartBackgroundSave(const app::PlayerSessionManager& psm) {
+    {
+        std::lock_guard lock{mtx_};
+        if(pending_ || writing_) {
+            ++stats_.deferred;
+            return false;
+        }
+    }
+
+    //Only the copy runs on the tick, the state may change as soon as it returns
+    const auto start = std::chrono::steady_clock::now();
+    auto state = Capture(psm);
+    const auto capture_time = std::chrono::steady_clock::now() - start;
+
+    {
+        std::lock_guard lock{mtx_};
+        pending_.emplace(std::move(state));
+        stats_.capture_time += capture_time;
+        stats_.max_capture_time = std::max<std::chrono::nanoseconds>(stats_.max_capture_time, capture_time);
+    }
+    wake_.notify_one();
+    return true;
+}
+
+void serialization::StateSerializer::Run() {
+    std::unique_lock lock{mtx_};
+    while(true) {
+        wake_.wait(lock, [this] {
+            return stop_ || pending_;
+        });
+        //Stopping still writes what was captured
+        if(!pending_) {
+            return;
+        }
+        auto state = std::move(*pending_);
+        pending_.reset();
+        writing_ = true;
+
+        lock.unlock();
+        const auto start = std::chrono::steady_clock::now();
+        bool written = true;
+        try {
+            WriteFile(PsmRepr{state});
+        } catch(const std::exception& ex) {
+            BOOST_LOG_TRIVIAL(error) << boost::log::add_value(log_message, "state save failed"s)
+                                     << boost::log::add_value(log_msg_data, boost::json::object{
+                                         {"exception", ex.what()}
+                                     });
+            written = false;
+        }
+        const auto write_time = std::chrono::steady_clock::now() - start;
+        lock.lock();
+
+        writing_ = false;
+        ++(written ? stats_.saves : stats_.failed);
+        stats_.write_time += write_time;
+        idle_.notify_all();
+    }
+}
+
+namespace {
+//Data of a renamed file only survives a crash once both the file and its directory are synced
+void SyncToDisk(const std::filesystem::path& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw std::runtime_error("unable to open " + path.string() + " for sync");
+    }
+    const int res = ::fsync(fd);
+    ::close(fd);
+    if(res != 0) {
+        throw std::runtime_error("unable to sync " + path.string());
+    }
+}
+
+//Read-only mapping of a whole file, a snapshot is decoded from the page cache without copying it first
+class MappedFile {
+public:
+    explicit MappedFile(const std::filesystem::path& path) {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0) {
+            throw std::runtime_error("unable to open " + path.string());
+        }
+        struct stat file_stat{};
+        if(::fstat(fd, &file_stat) != 0) {
+            ::close(fd);
+            throw std::runtime_error("unable to stat " + path.string());
+        }
+        size_ = static_cast<size_t>(file_stat.st_size);
+        void* data = size_ == 0 ? nullptr : ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(data == MAP_FAILED) {
+            throw std::runtime_error("unable to map " + path.string());
+        }
+        if(data) {
+            ::madvise(data, size_, MADV_SEQUENTIAL);
+        }
+        data_ = static_cast<const char*>(data);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if(data_) {
+            ::munmap(const_cast<char*>(data_), size_);
+        }
+    }
+
+    std::span<const char> GetData() const {
+        return {data_, size_};
+    }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+} // namespace
+
+serialization::StateCapture serialization::StateSerializer::Capture(const app::PlayerSessionManager& psm) {
+    std::lock_guard lock{log_mtx_};
+    //Closing the segment flushes it, inputs from now on belong after this save
+    log_.reset();
+    StateCapture state{psm};
+    state.log_segment = ++log_segment_;
+    return state;
+}
+
+void serialization::StateSerializer::WriteFile(const PsmRepr& repr) {
+    std::lock_guard lock{file_mtx_};
+    const auto segment = repr.GetLogSegment();
+    if(segment < written_segment_) {
+        return;
+    }
+
     //Create directories if they do not exist
-    fs::create_directories(save_dir_);
+    const fs::path dir = save_dir_.empty() ? fs::path{"."} : save_dir_;
+    fs::create_directories(dir);
 
-    fs::path temp_full_path = save_dir_ / save_temp_;
-    std::ofstream temp{temp_full_path, std::ios_base::ate};
+    fs::path temp_full_path = dir / save_temp_;
+    std::ofstream temp{temp_full_path, std::ios_base::binary | std::ios_base::trunc};
 
     if(!temp) {
         throw std::runtime_error("unable to open temp save file");
     }
 
-    arch::text_oarchive out{temp};
+    WriteSnapshot(temp, repr, snapshot_options_);
+    temp.close();
+    if(!temp) {
+        throw std::runtime_error("unable to write temp save file");
+    }
+    SyncToDisk(temp_full_path);
 
-    PsmRepr player_manager_state{psm};
-    out << player_manager_state;
+    fs::rename(temp_full_path, dir / save_file_);
+    SyncToDisk(dir);
+    written_segment_ = segment;
 
-    fs::rename(temp_full_path, save_dir_ / save_file_);
+    //The save covers every segment before its own
+    for(const auto old_segment : FindLogSegments(0)) {
+        if(old_segment >= segment) {
+            break;
+        }
+        std::error_code ec;
+        fs::remove(GetLogPath(old_segment), ec);
+    }
 }
 
-app::PlayerSessionManager serialization::StateSerializer::Restore(app::GamePtr game) const {
-    if(!fs::exists(save_dir_ / save_file_)) {
-        return std::move(app::PlayerSessionManager{game});
+app::InputLogWriter& serialization::StateSerializer::GetLog() {
+    if(!log_) {
+        fs::create_directories(save_dir_.empty() ? fs::path{"."} : save_dir_);
+        log_ = std::make_shared<app::InputLogWriter>(GetLogPath(log_segment_), std::nullopt);
     }
+    return *log_;
+}
 
-    std::ifstream saved_state{save_dir_ / save_file_};
+std::filesystem::path serialization::StateSerializer::GetLogPath(uint64_t segment) const {
+    return save_dir_ / (save_file_.string() + ".log." + std::to_string(segment));
+}
 
-    if(!saved_state) {
-        throw std::runtime_error("unable to open saved state file");
+std::vector<uint64_t> serialization::StateSerializer::FindLogSegments(uint64_t first_segment) const {
+    std::vector<uint64_t> segments;
+    const fs::path dir = save_dir_.empty() ? fs::path{"."} : save_dir_;
+    if(!fs::is_directory(dir)) {
+        return segments;
+    }
+    const auto prefix = save_file_.string() + ".log.";
+    for(const auto& entry : fs::directory_iterator{dir}) {
+        const auto name = entry.path().filename().string();
+        if(!name.starts_with(prefix) || name.size() == prefix.size()) {
+            continue;
+        }
+        uint64_t segment = 0;
+        const auto* first = name.data() + prefix.size();
+        const auto* last = name.data() + name.size();
+        const auto [ptr, ec] = std::from_chars(first, last, segment);
+        if(ec == std::errc{} && ptr == last && segment >= first_segment) {
+            segments.push_back(segment);
+        }
     }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
 
-    arch::text_iarchive in{saved_state};
+app::PlayerSessionManager serialization::StateSerializer::Restore(app::GamePtr game) {
+    //Without a save, segments from the very start still hold the whole game
+    uint64_t first_segment = 0;
+    size_t skipped_players = 0;
+    auto psm = [&] {
+        if(!fs::exists(save_dir_ / save_file_)) {
+            return app::PlayerSessionManager{game};
+        }
 
-    PsmRepr psm_repr{};
-    in >> psm_repr;
+        //Only for the restart, blocks and sessions are decoded on all cores
+        const auto num_threads = std::thread::hardware_concurrency();
+        const auto pool = num_threads > 1 ? std::make_unique<util::WorkStealingPool>(num_threads) : nullptr;
 
-    return std::move(psm_repr.Restore(game));
+        PsmRepr psm_repr{};
+        const MappedFile saved_state{save_dir_ / save_file_};
+        if(IsBinarySnapshot(saved_state.GetData())) {
+            psm_repr = ReadSnapshot(saved_state.GetData(), pool.get());
+        } else {
+            std::ifstream text_state{save_dir_ / save_file_};
+            if(!text_state) {
+                throw std::runtime_error("unable to open saved state file");
+            }
+            arch::text_iarchive in{text_state};
+            in >> psm_repr;
+        }
+        first_segment = psm_repr.GetLogSegment();
+        return psm_repr.Restore(game, pool.get(), &skipped_players);
+    }();
+
+    const auto segments = FindLogSegments(first_segment);
+    size_t skipped_records = 0;
+    size_t diverged_records = 0;
+    for(const auto segment : segments) {
+        const auto stats = app::RecoverFromInputLog(psm, app::ReadInputLog(GetLogPath(segment)));
+        skipped_records += stats.skipped;
+        diverged_records += stats.diverged;
+    }
+    //skippedPlayers lacked their session or dog; skipped and diverged count state log records, as in app::ReplayStats
+    BOOST_LOG_TRIVIAL(info) << boost::log::add_value(log_message, "state restored"s)
+                            << boost::log::add_value(log_msg_data, boost::json::object{
+                                {"players", psm.GetAllPlayers().size()},
+                                {"skippedPlayers", skipped_players},
+                                {"replayedSegments", segments.size()},
+                                {"skipped", skipped_records},
+                                {"diverged", diverged_records}
+                            });
+    //A segment may end in a torn line, new inputs never go after it
+    std::lock_guard lock{log_mtx_};
+    log_.reset();
+    log_segment_ = segments.empty() ? first_segment : segments.back() + 1;
+    return psm;
 }
@@ -2,16 +2,68 @@
 #include <boost/serialization/deque.hpp>
 #include <boost/serialization/shared_ptr.hpp>
 #include <boost/serialization/unordered_map.hpp>
+#include <boost/serialization/split_free.hpp>
+#include <boost/serialization/collection_size_type.hpp>
+#include <boost/serialization/item_version_type.hpp>
+#include <boost/serialization/library_version_type.hpp>
+#include <boost/serialization/version.hpp>
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
 // #include <boost/serialization/>
 
 #include "application.h"
+#include "input_log.h"
 #include "model.h"
+#include "snapshot_format.h"
 
 //Debug
 #include <iostream>
 #include <fstream>
+#include <sstream>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+namespace util {
+//Same layout as boost's standard collections (count, item version, items),
+//so saves made while the bag was a std::deque still load
+template <typename Archive, typename T, size_t N>
+void save(Archive& ar, const SmallVector<T, N>& vec, [[maybe_unused]] const unsigned version) {
+    const boost::serialization::collection_size_type count(vec.size());
+    const boost::serialization::item_version_type item_version(boost::serialization::version<T>::value);
+    ar << BOOST_SERIALIZATION_NVP(count);
+    ar << BOOST_SERIALIZATION_NVP(item_version);
+    for (const auto& item : vec) {
+        ar << boost::serialization::make_nvp("item", item);
+    }
+}
+
+template <typename Archive, typename T, size_t N>
+void load(Archive& ar, SmallVector<T, N>& vec, [[maybe_unused]] const unsigned version) {
+    boost::serialization::collection_size_type count;
+    boost::serialization::item_version_type item_version(0);
+    ar >> BOOST_SERIALIZATION_NVP(count);
+    if (boost::serialization::library_version_type(3) < ar.get_library_version()) {
+        ar >> BOOST_SERIALIZATION_NVP(item_version);
+    }
+
+    vec.clear();
+    vec.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        T item;
+        ar >> boost::serialization::make_nvp("item", item);
+        vec.push_back(std::move(item));
+    }
+}
+
+template <typename Archive, typename T, size_t N>
+void serialize(Archive& ar, SmallVector<T, N>& vec, const unsigned version) {
+    boost::serialization::split_free(ar, vec, version);
+}
+}  // namespace util
 
 namespace geom {
 
@@ -60,18 +112,6 @@ void serialize(Archive& ar, TimeMs& obj, [[maybe_unused]] const unsigned version
 }  // namespace model
 
 
-namespace app {
-// template <typename Archive>
-// void serialize(Archive& ar, Session::Id& sess_id, [[maybe_unused]] const unsigned version) {
-//     ar& sess_id;
-// }
-
-template <typename Archive>
-void serialize(Archive& ar, Token& obj, [[maybe_unused]] const unsigned version) {
-    ar&(*obj);
-}
-}  // namespace app
-
 namespace serialization {
 using namespace std::literals;
 
@@ -95,6 +135,12 @@ public:
         ar& bag_capacity_;
         ar& score_;
         ar& bag_content_;
+        //Saves without these restore as dogs that joined and stopped just now
+        if (version >= 1) {
+            ar& join_time_ms_;
+            ar& is_idle_;
+            ar& idle_since_ms_;
+        }
     }
 
 private:
@@ -107,6 +153,10 @@ private:
     size_t bag_capacity_ {0u};
     model::Score score_ {0u};
     model::Dog::BagContent bag_content_;
+    //Session times
+    int64_t join_time_ms_ {0};
+    bool is_idle_ {true};
+    int64_t idle_since_ms_ {0};
 };
 
 struct LootItemRepr {
@@ -126,11 +176,43 @@ struct LootItemRepr {
     model::Point2D pos;
 };
 
+//Plain copy of a session, made on the tick. Objects are copied as they are and the random engine as its raw words,
+//its text form and the Repr objects are made from the copy on the save thread
+struct SessionCapture {
+    explicit SessionCapture(const app::Session& session);
+
+    app::Session::Id id {0u};
+    model::Map::Id map_id {""s};
+    model::TimeMs time {0};
+    app::Session::GeneratorState generator;
+    //Collision order
+    std::vector<model::Dog> dogs;
+    std::vector<model::LootItem> loot_items;
+};
+
+struct PlayerCapture {
+    app::Player::Id id {0u};
+    app::Session::Id session_id {0u};
+    model::Dog::Id dog_id {0u};
+    app::Token token;
+};
+
+//All a save needs, copied on the tick without building a single string
+struct StateCapture {
+    explicit StateCapture(const app::PlayerSessionManager& psm);
+
+    std::vector<SessionCapture> sessions;
+    std::vector<PlayerCapture> players;
+    app::PlayerSessionManager::IdCounters counters;
+    uint64_t log_segment {0u};
+};
+
 class SessionRepr {
 public:
     SessionRepr() = default;
 
     explicit SessionRepr(const app::Session& session);
+    explicit SessionRepr(const SessionCapture& session);
 
     app::Session Restore(const app::GamePtr& game) const;
 
@@ -140,13 +222,27 @@ public:
     void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
         ar& id_;
         ar& map_id_content_;
+        if (version >= 1) {
+            ar& time_ms_;
+        }
         ar& dog_reprs_;
         ar& loot_item_reprs_;
+        //Without these the session keeps its fresh generator state, later ticks then differ from the original
+        if (version >= 2) {
+            ar& rng_state_;
+            ar& next_object_id_;
+            ar& time_without_loot_ms_;
+        }
     }
 
 private:
     size_t id_ {0u};
     std::string map_id_content_ {""s};
+    int64_t time_ms_ {0};
+    //Engine in its standard text form, empty if not saved
+    std::string rng_state_;
+    model::GameObject::Id next_object_id_ {0u};
+    int64_t time_without_loot_ms_ {0};
 
     std::vector<DogRepr> dog_reprs_;
     std::vector<LootItemRepr> loot_item_reprs_;
@@ -156,7 +252,7 @@ class PlayerRepr {
 public:
     PlayerRepr() = default;
 
-    explicit PlayerRepr(const app::Player& player, app::Token token);
+    explicit PlayerRepr(const PlayerCapture& player);
 
     template <typename Archive>
     void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
@@ -169,12 +265,14 @@ public:
     app::Player::Id GetId() const;
     app::Session::Id GetSessionId() const;
     model::Dog::Id GetDogId() const;
+    //Throws std::runtime_error if the saved token is malformed
     app::Token GetToken() const;
 
 private:
     app::Player::Id id_;
     app::Session::Id session_id_;
     model::Dog::Id dog_id_;
+    //Saved in the external hex form
     std::string token_content_;
 };
 
@@ -183,18 +281,37 @@ public:
     PsmRepr() = default;
 
     explicit PsmRepr(const app::PlayerSessionManager& psm);
+    explicit PsmRepr(const StateCapture& state);
 
-    app::PlayerSessionManager Restore(const app::GamePtr& game) const;
+    //With a pool, sessions are restored concurrently. Players whose session or dog is missing
+    //are left out and counted in skipped_players if given
+    app::PlayerSessionManager Restore(const app::GamePtr& game, util::WorkStealingPool* pool = nullptr,
+                                      size_t* skipped_players = nullptr) const;
+
+    //First state log segment written after this state, the ones before it are already in here
+    uint64_t GetLogSegment() const;
+    void SetLogSegment(uint64_t segment);
 
     template <typename Archive>
     void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
         ar& session_reprs_;
         ar& player_reprs_;
+        if (version >= 1) {
+            ar& next_dog_id_;
+            ar& next_player_id_;
+            ar& next_session_id_;
+            ar& log_segment_;
+        }
     }
 
 private:
     std::vector<SessionRepr> session_reprs_;
     std::vector<PlayerRepr> player_reprs_;
+    //Restore raises them to the ids in use anyway
+    model::Dog::Id next_dog_id_ {0u};
+    app::Player::Id next_player_id_ {0u};
+    app::Session::Id next_session_id_ {0u};
+    uint64_t log_segment_ {0u};
 };
 
 
@@ -202,15 +319,46 @@ private:
 //================ Serializer =====================
 namespace fs = std::filesystem;
 namespace arch = boost::archive;
+//Periodic saves copy the state into a StateCapture on the tick and leave building the PsmRepr, encoding
+//and disk io to a thread of their own.
+//With the state log on, inputs between saves go to <save file>.log.<segment>, every save starts a new segment
+//and removes the ones it covers once it is on disk. Restore loads the save and replays the segments after it
 class StateSerializer : public app::ApplicationListener {
 public:
-    StateSerializer(fs::path save_file, bool enable_periodic_backup, int64_t save_period);
-    ~StateSerializer() override = default;
-
-    void OnTick(model::TimeMs delta_t, const app::PlayerSessionManager& psm) override;
-    void SaveGameState(const app::PlayerSessionManager& psm) const;
-
-    app::PlayerSessionManager Restore(app::GamePtr game) const override;
+    struct Stats {
+        size_t saves = 0;
+        //Ticks on which a save was due while the previous one was still being written
+        size_t deferred = 0;
+        size_t failed = 0;
+        //Spent on the tick
+        std::chrono::nanoseconds capture_time{0};
+        std::chrono::nanoseconds max_capture_time{0};
+        //Spent on the save thread
+        std::chrono::nanoseconds write_time{0};
+    };
+
+    StateSerializer(fs::path save_file, bool enable_periodic_backup, int64_t save_period,
+                    SnapshotOptions snapshot_options = {}, bool enable_state_log = false);
+    //Finishes the save in flight
+    ~StateSerializer() override;
+
+    StateSerializer(const StateSerializer&) = delete;
+    StateSerializer& operator=(const StateSerializer&) = delete;
+
+    void OnJoin(app::ConstPlayerPtr player, const app::Token& token) override;
+    void OnMove(app::ConstPlayerPtr player, char move) override;
+    void OnTick(model::TimeMs delta_t, std::span<const app::RetiredPlayer> retired,
+                const app::PlayerSessionManager& psm) override;
+    //Synchronous, a background save still in flight cannot overwrite it afterwards
+    void SaveGameState(const app::PlayerSessionManager& psm);
+    //Waits until the background save in flight, if any, is on disk
+    void Flush() const;
+
+    Stats GetStats() const;
+
+    //Saves from before the binary format are text archives, they still load and the next save rewrites them.
+    //State log segments are replayed whether or not the log is on now, new inputs go to the segment after them
+    app::PlayerSessionManager Restore(app::GamePtr game) override;
 
 private:
     fs::path save_temp_ = "temp"s;
@@ -219,9 +367,52 @@ private:
 
     bool enable_periodic_backup_ = false;
     model::TimeMs save_period_;
+    SnapshotOptions snapshot_options_;
 
     model::TimeMs time_since_last_save_ {0u};
+
+    //Inputs and the saves that split them into segments come from the api strand,
+    //the final save at shutdown from wherever the server stops
+    bool enable_state_log_ = false;
+    std::mutex log_mtx_;
+    app::InputLogWriterPtr log_;
+    //Segment new inputs go to. Restore sets it past the segments it found
+    uint64_t log_segment_ = 0;
+
+    mutable std::mutex mtx_;
+    mutable std::condition_variable wake_;
+    mutable std::condition_variable idle_;
+    std::optional<StateCapture> pending_;
+    bool writing_ = false;
+    bool stop_ = false;
+    Stats stats_;
+
+    //Temp file and rename, shared by background and synchronous saves
+    std::mutex file_mtx_;
+    //Saves reach the disk in segment order, an older one finishing late is dropped
+    uint64_t written_segment_ = 0;
+
+    //Started last, after everything it uses
+    std::thread thread_;
+
+    //Copies the state and starts a new log segment at the same point
+    StateCapture Capture(const app::PlayerSessionManager& psm);
+    //Returns false if the previous save is still in flight
+    bool StartBackgroundSave(const app::PlayerSessionManager& psm);
+    void Run();
+    void WriteFile(const PsmRepr& repr);
+
+    app::InputLogWriter& GetLog();
+    fs::path GetLogPath(uint64_t segment) const;
+    //Ascending
+    std::vector<uint64_t> FindLogSegments(uint64_t first_segment) const;
 };
 
 
 }  // namespace serialization
+
+//Version 1: dog join and idle times, session time
+//Version 2 of SessionRepr, 1 of PsmRepr: generator state and id counters, for replaying a state log
+BOOST_CLASS_VERSION(::serialization::DogRepr, 1)
+BOOST_CLASS_VERSION(::serialization::SessionRepr, 2)
+BOOST_CLASS_VERSION(::serialization::PsmRepr, 1)
@@ -0,0 +1,133 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+//Hierarchical timing wheel keyed by time in ms. Schedule is O(1), Advance costs O(expired entries + levels)
+//no matter how many entries wait or how far time jumps: empty slots are skipped with per-level bitmasks.
+//Entries cannot be cancelled, the owner ignores the ones that went stale when they fire.
+template<typename T>
+class TimerWheel {
+public:
+    using Time = std::chrono::milliseconds;
+
+    void Schedule(Time at, T value) {
+        Insert({ToUnits(at), std::move(value)});
+        ++size_;
+    }
+
+    //Calls fn(T&) for every entry due at or before now, in order of slots, not exactly of time.
+    //Entries fn schedules at or before now fire on the next call
+    template<typename Fn>
+    void Advance(Time now, Fn&& fn) {
+        const uint64_t target = std::max(ToUnits(now), now_);
+
+        scratch_.swap(due_);
+        Fire(fn);
+
+        while(true) {
+            int level = 0;
+            uint64_t mask = 0;
+            for(; level < LEVELS; ++level) {
+                mask = occupied_[level] & SlotsAfter(Digit(now_, level));
+                if(mask) {
+                    break;
+                }
+            }
+            if(!mask) {
+                break;
+            }
+
+            //Start of the first occupied slot, lower levels are empty until then
+            const auto slot = static_cast<uint64_t>(std::countr_zero(mask));
+            const int shift = level * SLOT_BITS;
+            const int block_shift = shift + SLOT_BITS;
+            const uint64_t block = block_shift >= 64 ? 0 : (now_ >> block_shift) << block_shift;
+            const uint64_t slot_start = block | (slot << shift);
+            if(slot_start > target) {
+                break;
+            }
+
+            now_ = slot_start;
+            scratch_.swap(slots_[level][slot]);
+            occupied_[level] &= ~(uint64_t{1} << slot);
+            //Due entries fire, the rest move down to finer levels
+            for(auto& entry : scratch_) {
+                if(entry.at > now_) {
+                    Insert(std::move(entry));
+                    entry.at = DONE;
+                }
+            }
+            Fire(fn);
+        }
+        now_ = target;
+    }
+
+    size_t Size() const { return size_; }
+    bool Empty() const { return size_ == 0; }
+
+private:
+    static constexpr int SLOT_BITS = 6;
+    static constexpr int SLOTS = 1 << SLOT_BITS;
+    //Enough levels to cover all 64 bits of time
+    static constexpr int LEVELS = (64 + SLOT_BITS - 1) / SLOT_BITS;
+    static constexpr uint64_t DONE = static_cast<uint64_t>(-1);
+
+    struct Entry {
+        uint64_t at;
+        T value;
+    };
+
+    //Level L slot s holds entries that share all digits above L with now_ and have digit s at L, s > digit of now_
+    std::array<std::array<std::vector<Entry>, SLOTS>, LEVELS> slots_;
+    std::array<uint64_t, LEVELS> occupied_{};
+    //Scheduled at or before now_, fire on the next Advance
+    std::vector<Entry> due_;
+    //Swapped with the slot being processed, keeps its capacity between calls
+    std::vector<Entry> scratch_;
+    uint64_t now_ = 0;
+    size_t size_ = 0;
+
+    static uint64_t ToUnits(Time time) {
+        return time.count() > 0 ? static_cast<uint64_t>(time.count()) : 0;
+    }
+
+    static uint64_t Digit(uint64_t time, int level) {
+        return (time >> (level * SLOT_BITS)) & (SLOTS - 1);
+    }
+
+    static uint64_t SlotsAfter(uint64_t digit) {
+        return digit + 1 >= SLOTS ? 0 : ~uint64_t{0} << (digit + 1);
+    }
+
+    void Insert(Entry entry) {
+        if(entry.at <= now_) {
+            due_.push_back(std::move(entry));
+            return;
+        }
+        //Highest digit where the time differs from now_
+        const int level = (std::bit_width(entry.at ^ now_) - 1) / SLOT_BITS;
+        const auto slot = Digit(entry.at, level);
+        slots_[level][slot].push_back(std::move(entry));
+        occupied_[level] |= uint64_t{1} << slot;
+    }
+
+    //Fires everything in scratch_ not marked DONE and empties it
+    template<typename Fn>
+    void Fire(Fn& fn) {
+        for(auto& entry : scratch_) {
+            if(entry.at != DONE) {
+                --size_;
+                fn(entry.value);
+            }
+        }
+        scratch_.clear();
+    }
+};
+
+} // namespace util
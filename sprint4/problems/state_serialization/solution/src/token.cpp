@@ -0,0 +1,83 @@
+#include "token.h"
+
+namespace app {
+namespace {
+constexpr uint8_t NOT_HEX = 0xFF;
+
+constexpr std::array<uint8_t, 256> MakeHexDecodeTable() {
+    std::array<uint8_t, 256> table{};
+    for(auto& val : table) {
+        val = NOT_HEX;
+    }
+    for(int c = 0; c < 10; ++c) {
+        table['0' + c] = static_cast<uint8_t>(c);
+    }
+    //Lowercase only: tokens used to be looked up as strings, an uppercase one never matched
+    for(int c = 0; c < 6; ++c) {
+        table['a' + c] = static_cast<uint8_t>(10 + c);
+    }
+    return table;
+}
+
+//Two hex digits for every byte value
+constexpr std::array<char, 512> MakeHexEncodeTable() {
+    constexpr char digits[] = "0123456789abcdef";
+    std::array<char, 512> table{};
+    for(int byte = 0; byte < 256; ++byte) {
+        table[byte * 2] = digits[byte >> 4];
+        table[byte * 2 + 1] = digits[byte & 0xF];
+    }
+    return table;
+}
+
+constexpr auto HEX_DECODE = MakeHexDecodeTable();
+constexpr auto HEX_ENCODE = MakeHexEncodeTable();
+
+//Decodes 16 hex digits. No branches inside the loop: bad digits are collected in a flag and checked once
+bool DecodeHalf(const char* hex, uint64_t& out) {
+    uint64_t value = 0;
+    uint8_t bad = 0;
+    for(int i = 0; i < 16; ++i) {
+        const uint8_t nibble = HEX_DECODE[static_cast<unsigned char>(hex[i])];
+        bad |= nibble & 0xF0;
+        value = (value << 4) | (nibble & 0x0F);
+    }
+    out = value;
+    return bad == 0;
+}
+
+void EncodeHalf(uint64_t value, char* out) {
+    for(int byte_idx = 7; byte_idx >= 0; --byte_idx) {
+        const auto byte = static_cast<uint8_t>(value >> (byte_idx * 8));
+        *out++ = HEX_ENCODE[byte * 2];
+        *out++ = HEX_ENCODE[byte * 2 + 1];
+    }
+}
+} // namespace
+
+std::optional<Token> Token::FromHex(std::string_view hex) {
+    if(hex.size() != HEX_LEN) {
+        return std::nullopt;
+    }
+
+    Token token;
+    const bool hi_ok = DecodeHalf(hex.data(), token.hi);
+    const bool lo_ok = DecodeHalf(hex.data() + HEX_LEN / 2, token.lo);
+    if(!hi_ok || !lo_ok) {
+        return std::nullopt;
+    }
+    return token;
+}
+
+std::string Token::ToHex() const {
+    std::string hex(HEX_LEN, '0');
+    ToHex(hex.data());
+    return hex;
+}
+
+void Token::ToHex(char* out) const {
+    EncodeHalf(hi, out);
+    EncodeHalf(lo, out + HEX_LEN / 2);
+}
+
+} // namespace app
@@ -0,0 +1,35 @@
+#pragma once
+#include <array>
+#include <compare>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace app {
+
+//128-bit auth token. Externally (http, save files) it is always 32 lowercase hex digits, hi first
+struct Token {
+    static constexpr size_t HEX_LEN = 32;
+
+    uint64_t hi = 0;
+    uint64_t lo = 0;
+
+    //nullopt unless hex is exactly 32 lowercase hex digits
+    static std::optional<Token> FromHex(std::string_view hex);
+
+    std::string ToHex() const;
+    //Writes exactly HEX_LEN chars, no terminating zero
+    void ToHex(char* out) const;
+
+    auto operator<=>(const Token&) const = default;
+};
+
+struct TokenHasher {
+    size_t operator()(const Token& token) const {
+        //Tokens are random already, just fold the halves
+        return static_cast<size_t>((token.hi ^ token.lo) * 0x9E3779B97F4A7C15ull);
+    }
+};
+
+} // namespace app
@@ -0,0 +1,146 @@
+#include "work_stealing_pool.h"
+
+#include <algorithm>
+
+namespace util {
+
+WorkStealingPool::WorkStealingPool(unsigned num_threads) {
+    num_threads = std::max(1u, num_threads);
+
+    queues_.reserve(num_threads);
+    for(unsigned i = 0; i < num_threads; ++i) {
+        queues_.emplace_back(std::make_unique<Queue>());
+    }
+
+    workers_.reserve(num_threads);
+    for(unsigned i = 0; i < num_threads; ++i) {
+        workers_.emplace_back([this, i] {
+            WorkerLoop(i);
+        });
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard lock{wake_mtx_};
+        stop_ = true;
+    }
+    wake_.notify_all();
+
+    for(auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+size_t WorkStealingPool::GetThreadCount() const {
+    return workers_.size();
+}
+
+void WorkStealingPool::RunAll(std::vector<Task> tasks) {
+    if(tasks.empty()) {
+        return;
+    }
+
+    Batch batch;
+    batch.remaining = tasks.size();
+
+    //Deal tasks out round-robin, stealing evens out the rest
+    for(size_t i = 0; i < tasks.size(); ++i) {
+        Queue& queue = *queues_[i % queues_.size()];
+        std::lock_guard lock{queue.mtx};
+        queue.jobs.push_back({std::move(tasks[i]), &batch});
+        //Counted under the same lock as the pop that uncounts it, so it never goes below zero
+        ++queued_;
+    }
+    {
+        //A worker that saw queued_ == 0 is either waiting already or will see the new count
+        std::lock_guard lock{wake_mtx_};
+    }
+    wake_.notify_all();
+
+    //Help out instead of idling
+    Job job;
+    while(TrySteal(queues_.size(), job)) {
+        Execute(job);
+    }
+
+    std::unique_lock lock{batch.mtx};
+    batch.done.wait(lock, [&batch] {
+        return batch.remaining == 0;
+    });
+
+    if(batch.error) {
+        std::rethrow_exception(batch.error);
+    }
+}
+
+void WorkStealingPool::WorkerLoop(size_t own_idx) {
+    while(true) {
+        Job job;
+        if(TryPop(own_idx, job) || TrySteal(own_idx, job)) {
+            Execute(job);
+            continue;
+        }
+
+        std::unique_lock lock{wake_mtx_};
+        wake_.wait(lock, [this] {
+            return stop_ || queued_ > 0;
+        });
+        if(stop_ && queued_ == 0) {
+            return;
+        }
+    }
+}
+
+bool WorkStealingPool::TryPop(size_t queue_idx, Job& job) {
+    Queue& queue = *queues_[queue_idx];
+    std::lock_guard lock{queue.mtx};
+    if(queue.jobs.empty()) {
+        return false;
+    }
+    job = std::move(queue.jobs.back());
+    queue.jobs.pop_back();
+    --queued_;
+    return true;
+}
+
+bool WorkStealingPool::TrySteal(size_t thief_idx, Job& job) {
+    //Start with the neighbour, so thieves don't all pile onto queue 0
+    for(size_t i = 1; i <= queues_.size(); ++i) {
+        const size_t victim = (thief_idx + i) % queues_.size();
+        if(victim == thief_idx) {
+            continue;
+        }
+
+        Queue& queue = *queues_[victim];
+        std::lock_guard lock{queue.mtx};
+        if(queue.jobs.empty()) {
+            continue;
+        }
+        job = std::move(queue.jobs.front());
+        queue.jobs.pop_front();
+        --queued_;
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::Execute(Job& job) {
+    Batch& batch = *job.batch;
+    try {
+        job.task();
+    } catch(...) {
+        std::lock_guard lock{batch.mtx};
+        if(!batch.error) {
+            batch.error = std::current_exception();
+        }
+    }
+
+    //Count down under the lock: once the waiter sees zero it destroys the batch
+    std::lock_guard lock{batch.mtx};
+    if(--batch.remaining == 0) {
+        batch.done.notify_all();
+    }
+}
+
+} // namespace util
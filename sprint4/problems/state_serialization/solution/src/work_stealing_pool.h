@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace util {
+
+//Fixed set of worker threads, each with its own task queue.
+//A worker takes tasks from the back of its own queue and, when it runs dry, steals from the front of the others.
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(unsigned num_threads);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    size_t GetThreadCount() const;
+
+    //Runs all tasks and returns once every one of them has finished (barrier).
+    //The calling thread takes part in the work. The first exception thrown by a task is rethrown here.
+    void RunAll(std::vector<Task> tasks);
+
+private:
+    //Tasks submitted by one RunAll call
+    struct Batch {
+        size_t remaining = 0;
+        std::mutex mtx;
+        std::condition_variable done;
+        std::exception_ptr error;
+    };
+
+    struct Job {
+        Task task;
+        Batch* batch;
+    };
+
+    struct Queue {
+        std::mutex mtx;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+
+    std::mutex wake_mtx_;
+    std::condition_variable wake_;
+    std::atomic<size_t> queued_{0u};
+    bool stop_ = false;
+
+    void WorkerLoop(size_t own_idx);
+
+    bool TryPop(size_t queue_idx, Job& job);
+    bool TrySteal(size_t thief_idx, Job& job);
+
+    static void Execute(Job& job);
+};
+
+} // namespace util
@@ -1,7 +1,28 @@
 #include <catch2/catch_test_macros.hpp>
 
 #include "../src/model.h"
+#include "../src/application.h"
 #include "../src/loot_generator.h"
+#include "../src/slot_map.h"
+#include "../src/small_vector.h"
+#include "../src/flat_hash_map.h"
+#include "../src/token.h"
+#include "../src/work_stealing_pool.h"
+#include "../src/fixed_step_clock.h"
+#include "../src/alias_table.h"
+#include "../src/input_log.h"
+#include "../src/leaderboard.h"
+#include "../src/records_writer.h"
+#include "../src/timer_wheel.h"
+#include "../src/spatial_grid.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
 
 SCENARIO("Game model testing") {
  //... ?
@@ -9,6 +30,82 @@ SCENARIO("Game model testing") {
 
 using namespace std::literals;
 
+TEST_CASE("Road index lookup", "[RoadIndex]") {
+    using model::Road;
+    using model::Point;
+
+    model::Map map{model::Map::Id{"test"s}, "Test"s};
+    map.AddRoad({Road::HORIZONTAL, Point{0, 0}, 40});   // 0
+    map.AddRoad({Road::VERTICAL, Point{40, 0}, 30});    // 1
+    map.AddRoad({Road::HORIZONTAL, Point{40, 30}, 0});  // 2, reversed
+    map.AddRoad({Road::VERTICAL, Point{0, 0}, 30});     // 3
+    map.AddRoad({Road::HORIZONTAL, Point{40, 0}, 60});  // 4, continues road 0
+    map.BuildRoadIndex();
+
+    const auto& roads = map.GetRoads();
+    const auto& index = map.GetRoadIndex();
+
+    SECTION("points on roads") {
+        CHECK(map.FindHorRoad({20.0, 0.3}) == &roads[0]);
+        CHECK(map.FindHorRoad({20.0, 29.8}) == &roads[2]);
+        CHECK(map.FindVertRoad({39.7, 15.0}) == &roads[1]);
+        CHECK(map.FindVertRoad({0.0, 30.0}) == &roads[3]);
+        CHECK(map.FindHorRoad({55.0, 0.0}) == &roads[4]);
+    }
+
+    SECTION("points off roads") {
+        CHECK(map.FindHorRoad({20.0, 15.0}) == nullptr);
+        CHECK(map.FindVertRoad({20.0, 15.0}) == nullptr);
+        CHECK(map.FindVertRoad({40.0, 31.0}) == nullptr);
+        CHECK(map.FindHorRoad({61.0, 0.0}) == nullptr);
+        CHECK(map.FindHorRoad({-1.0, 0.0}) == nullptr);
+    }
+
+    SECTION("junctions are ordered along the road") {
+        auto junctions = index.GetJunctions(0);
+        REQUIRE(junctions.size() == 3);
+        CHECK(junctions[0].road_idx == 3);
+        CHECK(junctions[0].x == 0);
+        CHECK(junctions[1].x == 40);
+        CHECK(junctions[2].x == 40);
+
+        auto continuation = index.GetJunctions(4);
+        REQUIRE(continuation.size() == 2);
+        CHECK(continuation[0].x == 40);
+    }
+
+    SECTION("movement is limited by the road") {
+        auto result = map.ComputeRoadMove({20.0, 0.0}, {20.0, 5.0});
+        CHECK(result.road_edge_reached_);
+        CHECK(result.dst.y == 0.4);
+
+        result = map.ComputeRoadMove({20.0, 0.0}, {25.0, 0.0});
+        CHECK_FALSE(result.road_edge_reached_);
+        CHECK(result.dst.x == 25.0);
+    }
+
+    SECTION("long move stops at the end of the starting road") {
+        auto result = map.ComputeRoadMove({20.0, 0.0}, {100.0, 0.0});
+        CHECK(result.road_edge_reached_);
+        CHECK(result.dst.x == 40.4);
+    }
+
+    SECTION("long move continues across junctions") {
+        auto result = map.ComputeRoadMove({20.0, 0.0}, {50.0, 0.0}, true);
+        CHECK_FALSE(result.road_edge_reached_);
+        CHECK(result.dst.x == 50.0);
+
+        result = map.ComputeRoadMove({20.0, 0.0}, {100.0, 0.0}, true);
+        CHECK(result.road_edge_reached_);
+        CHECK(result.dst.x == 60.4);
+
+        //no vertical continuation past the end of road 1
+        result = map.ComputeRoadMove({40.0, 10.0}, {40.0, 100.0}, true);
+        CHECK(result.road_edge_reached_);
+        CHECK(result.dst.y == 30.4);
+    }
+}
+
 SCENARIO("LootItem generation") {
     using loot_gen::LootGenerator;
     using TimeInterval = LootGenerator::TimeInterval;
@@ -80,20 +177,940 @@ SCENARIO("LootItem generation") {
 
 
 //Gathering Test
-TEST_CASE("Basic Gather test", "[LootGathering]") {
-    //setup sessiion
-    //gen object
-    //collect object
-    //return object
-    SECTION("collecting object") {
-        //...
+TEST_CASE("Work stealing pool runs every task before returning", "[WorkStealingPool]") {
+    util::WorkStealingPool pool{4};
+    CHECK(pool.GetThreadCount() == 4);
+
+    SECTION("all tasks are done after RunAll") {
+        std::vector<int> results(100, 0);
+        for(int round = 1; round <= 3; ++round) {
+            std::vector<util::WorkStealingPool::Task> tasks;
+            for(size_t i = 0; i < results.size(); ++i) {
+                tasks.emplace_back([&results, i, round] {
+                    results[i] += round;
+                });
+            }
+            pool.RunAll(std::move(tasks));
+        }
+        for(int res : results) {
+            CHECK(res == 6);
+        }
+    }
+
+    SECTION("exception from a task is rethrown, other tasks still run") {
+        std::atomic<int> done{0};
+        std::vector<util::WorkStealingPool::Task> tasks;
+        for(int i = 0; i < 10; ++i) {
+            tasks.emplace_back([&done, i] {
+                if(i == 3) {
+                    throw std::runtime_error("task failed");
+                }
+                ++done;
+            });
+        }
+        CHECK_THROWS_AS(pool.RunAll(std::move(tasks)), std::runtime_error);
+        CHECK(done == 9);
+    }
+}
+
+TEST_CASE("Fixed step clock hands out whole steps", "[FixedStepClock]") {
+    using util::FixedStepClock;
+    using Ms = FixedStepClock::Duration;
+
+    FixedStepClock::Settings settings;
+    settings.step = Ms{50};
+    settings.max_steps_per_wakeup = 3;
+
+    auto run = [](FixedStepClock& clock, Ms elapsed) {
+        std::vector<Ms> steps;
+        clock.Advance(elapsed, [&steps](Ms step) {
+            steps.push_back(step);
+        });
+        return steps;
+    };
+
+    SECTION("remainder carries over to the next wakeup") {
+        FixedStepClock clock{settings};
+        CHECK(run(clock, Ms{30}).empty());
+        CHECK(run(clock, Ms{30}) == std::vector<Ms>{Ms{50}});
+        CHECK(run(clock, Ms{90}) == std::vector<Ms>{Ms{50}, Ms{50}});
+        CHECK(clock.GetStats().lag == Ms{0});
+        CHECK(clock.GetStats().overruns == 0);
+    }
+
+    SECTION("merge folds the extra time into the last step") {
+        settings.catch_up = FixedStepClock::CatchUp::MERGE;
+        settings.max_step = Ms{200};
+        FixedStepClock clock{settings};
+        CHECK(run(clock, Ms{320}) == std::vector<Ms>{Ms{50}, Ms{50}, Ms{200}});
+        CHECK(clock.GetStats().overruns == 1);
+        CHECK(clock.GetStats().merged == Ms{150});
+        CHECK(clock.GetStats().max_lag == Ms{170});
+        CHECK(run(clock, Ms{30}) == std::vector<Ms>{Ms{50}});
+    }
+
+    SECTION("a merged step is capped, the rest is dropped") {
+        settings.catch_up = FixedStepClock::CatchUp::MERGE;
+        settings.max_step = Ms{120};
+        FixedStepClock clock{settings};
+        CHECK(run(clock, Ms{10'000}) == std::vector<Ms>{Ms{50}, Ms{50}, Ms{120}});
+        CHECK(clock.GetStats().merged == Ms{70});
+        CHECK(clock.GetStats().skipped == Ms{9'780});
+
+        //Without max_step a step takes at most a whole wakeup worth of steps
+        settings.max_step = Ms{0};
+        FixedStepClock uncapped{settings};
+        CHECK(run(uncapped, Ms{10'000}) == std::vector<Ms>{Ms{50}, Ms{50}, Ms{150}});
+    }
+
+    SECTION("skip drops the extra time") {
+        settings.catch_up = FixedStepClock::CatchUp::SKIP;
+        FixedStepClock clock{settings};
+        CHECK(run(clock, Ms{320}) == std::vector<Ms>{Ms{50}, Ms{50}, Ms{50}});
+        CHECK(clock.GetStats().skipped == Ms{150});
+        CHECK(clock.GetStats().steps == 3);
+    }
+
+    SECTION("step grows under sustained overload and shrinks back") {
+        settings.max_step = Ms{100};
+        settings.overloaded_wakeups = 2;
+        FixedStepClock clock{settings};
+        run(clock, Ms{500});
+        run(clock, Ms{500});
+        CHECK(clock.GetStep() == Ms{100});
+        run(clock, Ms{500});
+        run(clock, Ms{500});
+        CHECK(clock.GetStep() == Ms{100});
+
+        run(clock, Ms{100});
+        run(clock, Ms{100});
+        CHECK(clock.GetStep() == Ms{50});
+    }
+
+    SECTION("zero step is rejected") {
+        settings.step = Ms{0};
+        CHECK_THROWS_AS(FixedStepClock{settings}, std::invalid_argument);
+    }
+}
+
+TEST_CASE("Alias table samples by weight", "[AliasTable]") {
+    std::mt19937 rng{42};
+
+    SECTION("zero weight is never picked, the rest follows the weights") {
+        const std::vector<double> weights{1.0, 0.0, 3.0};
+        util::AliasTable table{weights};
+        REQUIRE(table.Size() == 3);
+
+        std::vector<int> hits(3, 0);
+        constexpr int samples = 40000;
+        for(int i = 0; i < samples; ++i) {
+            ++hits[table.Sample(rng)];
+        }
+        CHECK(hits[1] == 0);
+        CHECK(hits[0] > samples / 4 - samples / 40);
+        CHECK(hits[0] < samples / 4 + samples / 40);
+    }
+
+    SECTION("all zero weights fall back to uniform") {
+        const std::vector<double> weights{0.0, 0.0};
+        util::AliasTable table{weights};
+        std::vector<int> hits(2, 0);
+        for(int i = 0; i < 1000; ++i) {
+            ++hits[table.Sample(rng)];
+        }
+        CHECK(hits[0] > 0);
+        CHECK(hits[1] > 0);
+    }
+}
+
+TEST_CASE("Maps are compiled on add", "[Map]") {
+    using model::Road;
+    using model::Point;
+
+    model::Game game;
+    for(const auto& id : {"first"s, "second"s}) {
+        model::Map map{model::Map::Id{id}, id};
+        map.AddRoad({Road::HORIZONTAL, Point{0, 0}, 100});
+        map.AddRoad({Road::VERTICAL, Point{5, 5}, 5});
+        game.AddMap(std::move(map));
+    }
+
+    const auto idx = game.FindMapIndex(model::Map::Id{"second"s});
+    REQUIRE(idx);
+    CHECK(*idx == 1);
+    CHECK(game.GetMap(*idx)->GetIndex() == 1);
+    CHECK(game.GetMap(*idx) == game.FindMap(model::Map::Id{"second"s}));
+    CHECK_FALSE(game.FindMapIndex(model::Map::Id{"third"s}));
+
+    //Zero length road has no spawn points
+    for(int i = 0; i < 100; ++i) {
+        CHECK(game.GetMap(0)->GetRandomRoadPt().y == 0.0);
+    }
+}
+
+TEST_CASE("Slot map keeps values packed and handles generational", "[SlotMap]") {
+    util::SlotMap<std::string> slots;
+    const auto a = slots.Emplace("a"s);
+    const auto b = slots.Emplace("b"s);
+    const auto c = slots.Emplace("c"s);
+    REQUIRE(slots.Size() == 3);
+
+    SECTION("erase moves the last value into the hole") {
+        CHECK(slots.Erase(a));
+        CHECK(slots.Size() == 2);
+        CHECK(slots[0] == "c"s);
+        CHECK(*slots.Find(c) == "c"s);
+        CHECK(*slots.Find(b) == "b"s);
+        CHECK(slots.GetHandle(0) == c);
+    }
+
+    SECTION("stale handle does not resolve after its slot is reused") {
+        CHECK(slots.Erase(b));
+        CHECK_FALSE(slots.Erase(b));
+        const auto d = slots.Emplace("d"s);
+        CHECK(d.index == b.index);
+        CHECK_FALSE(slots.Contains(b));
+        CHECK(slots.Find(b) == nullptr);
+        CHECK(*slots.Find(d) == "d"s);
+    }
+
+    SECTION("clear invalidates all handles") {
+        slots.Clear();
+        CHECK(slots.Empty());
+        CHECK_FALSE(slots.Contains(a));
+        CHECK_FALSE(slots.Contains(c));
+    }
+}
+
+TEST_CASE("Small vector stays inline up to its inline capacity", "[SmallVector]") {
+    util::SmallVector<std::string, 2> vec;
+    vec.push_back("a"s);
+    vec.push_back("b"s);
+    CHECK(vec.is_inline());
+
+    vec.push_back("c"s);
+    CHECK_FALSE(vec.is_inline());
+    CHECK(vec.size() == 3);
+    CHECK(vec[2] == "c"s);
+
+    auto moved = std::move(vec);
+    CHECK(moved.size() == 3);
+    CHECK(vec.empty());
+
+    SECTION("an element of a full vector can be pushed back into it") {
+        //Longer than the small string buffer, so a freed copy would not survive by chance
+        const auto first = std::string(64, 'f');
+        const auto second = std::string(64, 's');
+        util::SmallVector<std::string, 2> full{first, second};
+        REQUIRE(full.size() == full.capacity());
+
+        //Inline to heap
+        full.push_back(full[0]);
+        CHECK(full[2] == first);
+
+        //Heap to a bigger heap block
+        full.push_back(full[1]);
+        REQUIRE(full.size() == full.capacity());
+        full.emplace_back(full[3]);
+        CHECK(full[3] == second);
+        CHECK(full[4] == second);
+        CHECK(full.size() == 5);
+    }
+
+    SECTION("dog bag is reserved from its capacity") {
+        model::Dog small_bag{0, {0.0, 0.0}, 0.6, model::Dog::Tag{"rex"s}, 3};
+        model::Dog big_bag{1, {0.0, 0.0}, 0.6, model::Dog::Tag{"max"s}, 10};
+        CHECK(small_bag.GetBag().is_inline());
+        CHECK(big_bag.GetBag().capacity() >= 10);
+
+        for(size_t i = 0; i < 10; ++i) {
+            CHECK(big_bag.TryCollectItem(model::LootItemInfo{i, 0}));
+        }
+        CHECK_FALSE(big_bag.TryCollectItem(model::LootItemInfo{10, 0}));
+        CHECK(big_bag.GetBag().capacity() == 10);
+    }
+}
+
+TEST_CASE("Token hex form round trips", "[Token]") {
+    const auto hex = "0123456789abcdef00ff10aa7c3e5b91"s;
+    const auto token = app::Token::FromHex(hex);
+    REQUIRE(token);
+    CHECK(token->hi == 0x0123456789abcdefull);
+    CHECK(token->lo == 0x00ff10aa7c3e5b91ull);
+    CHECK(token->ToHex() == hex);
+    CHECK(app::Token{0, 1}.ToHex() == "00000000000000000000000000000001"s);
+
+    //Same as before tokens were parsed: an uppercase token is unknown
+    CHECK_FALSE(app::Token::FromHex("0123456789ABCDEF00FF10AA7C3E5B91"sv));
+    CHECK_FALSE(app::Token::FromHex("0123456789abcdef00ff10aa7c3e5b9A"sv));
+    CHECK_FALSE(app::Token::FromHex(hex.substr(1)));
+    CHECK_FALSE(app::Token::FromHex(hex + "0"s));
+    CHECK_FALSE(app::Token::FromHex("0123456789abcdef00ff10aa7c3e5b9g"sv));
+    CHECK_FALSE(app::Token::FromHex("0123456789abcde 00ff10aa7c3e5b91"sv));
+}
+
+TEST_CASE("Flat hash map finds what was inserted and survives erase", "[FlatHashMap]") {
+    //Bad hash on purpose, everything lands in a few long probe chains
+    struct CollidingHash {
+        size_t operator()(int key) const { return static_cast<size_t>(key % 3); }
+    };
+    util::FlatHashMap<int, int, CollidingHash> map;
+
+    for(int i = 0; i < 100; ++i) {
+        CHECK(map.Emplace(i, i * 10).second);
+    }
+    CHECK_FALSE(map.Emplace(5, 0).second);
+    CHECK(map.Size() == 100);
+
+    for(int i = 0; i < 100; i += 2) {
+        CHECK(map.Erase(i));
+    }
+    CHECK_FALSE(map.Erase(0));
+    CHECK(map.Size() == 50);
+
+    for(int i = 0; i < 100; ++i) {
+        const int* value = map.Find(i);
+        if(i % 2 == 0) {
+            CHECK(value == nullptr);
+        } else {
+            REQUIRE(value != nullptr);
+            CHECK(*value == i * 10);
+        }
+    }
+}
+
+TEST_CASE("Session roster lists players by id", "[PlayerSessionManager]") {
+    auto game = std::make_shared<model::Game>();
+    for(const auto& id : {"map1"s, "map2"s}) {
+        model::Map map{model::Map::Id{id}, id};
+        map.AddRoad({model::Road::HORIZONTAL, model::Point{0, 0}, 10});
+        map.AddLootInfo(boost::json::array{});
+        game->AddMap(std::move(map));
+    }
+
+    app::PlayerSessionManager psm{game};
+    const auto first = psm.CreatePlayer(model::Map::Id{"map1"s}, model::Dog::Tag{"a"s});
+    const auto other = psm.CreatePlayer(model::Map::Id{"map2"s}, model::Dog::Tag{"b"s});
+    const auto second = psm.CreatePlayer(model::Map::Id{"map1"s}, model::Dog::Tag{"c"s});
+
+    const auto roster = psm.GetAllPlayersInSession(second);
+    REQUIRE(roster.size() == 2);
+    CHECK(roster[0] == first);
+    CHECK(roster[1] == second);
+    CHECK(psm.GetAllPlayersInSession(other).size() == 1);
+
+    //Same storage on every call, nothing is rebuilt
+    CHECK(psm.GetAllPlayersInSession(first).data() == roster.data());
+}
+
+TEST_CASE("Restored players without their session or dog are skipped and counted", "[PlayerSessionManager]") {
+    auto game = std::make_shared<model::Game>();
+    model::Map map{model::Map::Id{"map1"s}, "Map 1"s};
+    map.AddRoad({model::Road::HORIZONTAL, model::Point{0, 0}, 10});
+    map.AddLootInfo(boost::json::array{});
+    game->AddMap(std::move(map));
+
+    app::PlayerSessionManager psm{game};
+    const auto session = psm.CreatePlayer(model::Map::Id{"map1"s}, model::Dog::Tag{"a"s})->GetSession();
+    session->AddDog(50, model::Dog::Tag{"b"s});
+
+    const auto token = app::Token::FromHex("0123456789abcdef0123456789abcdef"sv);
+    REQUIRE(token);
+    const std::vector<app::PlayerSessionManager::RestoredPlayer> players{
+        {10, 99, session->GetId(), *token},
+        {11, 50, session->GetId() + 7, *token},
+        {12, 50, session->GetId(), *token},
+    };
+    CHECK(psm.RestorePlayers(players) == 2);
+    CHECK(psm.GetAllPlayers().size() == 2);
+    CHECK(psm.GetPlayerByToken(*token)->GetId() == 12);
+}
+
+TEST_CASE("Busy maps are split into capped sessions", "[PlayerSessionManager]") {
+    auto game = std::make_shared<model::Game>();
+    model::Map map{model::Map::Id{"map1"s}, "Map 1"s};
+    map.AddRoad({model::Road::HORIZONTAL, model::Point{0, 0}, 10});
+    map.AddLootInfo(boost::json::array{});
+    game->AddMap(std::move(map));
+    game->SetMaxDogsPerSession(2);
+
+    app::PlayerSessionManager psm{game};
+    std::vector<app::PlayerPtr> players;
+    for(int i = 0; i < 5; ++i) {
+        players.push_back(psm.CreatePlayer(model::Map::Id{"map1"s}, model::Dog::Tag{"dog"s}));
+    }
+
+    CHECK(psm.GetAllSessions().size() == 3);
+    for(const auto& [_, session] : psm.GetAllSessions()) {
+        CHECK(session.GetDogCount() <= 2);
+    }
+    CHECK(players[0]->GetSession() == players[1]->GetSession());
+    CHECK(players[2]->GetSession() != players[0]->GetSession());
+    CHECK(psm.GetAllPlayersInSession(players[4]).size() == 1);
+
+    //A session with room is filled before a new one opens
+    const auto freed_session = players[4]->GetSession();
+    psm.RetirePlayer(players[4]->GetId());
+    CHECK(psm.GetAllPlayers().size() == 4);
+    const auto next = psm.CreatePlayer(model::Map::Id{"map1"s}, model::Dog::Tag{"dog"s});
+    CHECK(next->GetSession() == freed_session);
+    CHECK(psm.GetAllSessions().size() == 3);
+}
+
+TEST_CASE("Seeded game replays the same from its input log", "[InputLog]") {
+    auto make_game = [] {
+        auto game = std::make_shared<model::Game>();
+        model::Map map{model::Map::Id{"map1"s}, "Map 1"s};
+        map.AddRoad({model::Road::HORIZONTAL, model::Point{0, 0}, 40});
+        map.AddRoad({model::Road::VERTICAL, model::Point{40, 0}, 30});
+        map.AddLootInfo(boost::json::array{boost::json::object{{"value", 1}}, boost::json::object{{"value", 2}}});
+        game->AddMap(std::move(map));
+        game->EnableRandomDogSpawn(true);
+        game->ConfigLootGen(model::TimeMs{1000}, 0.5);
+        game->SetRandomSeed(7);
+        return game;
+    };
+
+    auto positions = [](const app::GameInterface& game_app) {
+        std::vector<std::pair<double, double>> result;
+        for(const auto& [_, session] : game_app.GetPlayerManager().GetAllSessions()) {
+            for(const auto& [_, dog] : session.GetDogs()) {
+                result.emplace_back(dog.GetPos().x, dog.GetPos().y);
+            }
+            for(const auto& loot : session.GetLootItems()) {
+                result.emplace_back(loot.GetPos().x, loot.GetPos().y);
+            }
+        }
+        return result;
+    };
+
+    boost::asio::io_context io;
+    app::GameInterface recorded(io, make_game(), nullptr);
+
+    auto out = std::make_unique<std::stringstream>();
+    auto* log_text = out.get();
+    //Keeps the stream alive after recording stops
+    const auto writer = std::make_shared<app::InputLogWriter>(std::move(out), 7);
+    recorded.SetInputLog(writer);
+
+    const auto rex = recorded.JoinGame("map1"s, "rex the dog"s);
+    recorded.AdvanceGameTime(model::TimeMs{500});
+    const auto bob = recorded.JoinGame("map1"s, "bob"s);
+    recorded.SetPlayerMovement(recorded.FindPlayerByToken(*rex.token), 'R');
+    recorded.SetPlayerMovement(recorded.FindPlayerByToken(*bob.token), 'D');
+    for(int i = 0; i < 20; ++i) {
+        recorded.AdvanceGameTime(model::TimeMs{250});
+    }
+    recorded.SetInputLog(nullptr);
+    writer->Flush();
+
+    const auto log = app::ReadInputLog(*log_text);
+    CHECK(log.random_seed == 7u);
+    REQUIRE(log.records.size() == 25);
+    CHECK(log.records[0].dog_name == "rex the dog"s);
+    CHECK(log.records[3].move == 'R');
+
+    app::GameInterface replayed(io, make_game(), nullptr);
+    const auto stats = app::ReplayInputLog(replayed, log);
+    CHECK(stats.joins == 2);
+    CHECK(stats.moves == 2);
+    CHECK(stats.ticks == 21);
+    CHECK(stats.game_time == model::TimeMs{5500});
+
+    const auto expected = positions(recorded);
+    CHECK(expected.size() > 2);
+    CHECK(positions(replayed) == expected);
+
+    SECTION("malformed logs are rejected") {
+        std::istringstream no_header{"J 0 0 4 map1 3 rex\n"s};
+        CHECK_THROWS_AS(app::ReadInputLog(no_header), std::runtime_error);
+
+        std::istringstream short_name{"seed -\nJ 0 0 4 map1 10 rex\n"s};
+        CHECK_THROWS_AS(app::ReadInputLog(short_name), std::runtime_error);
+
+        std::istringstream unsized_map{"seed -\nJ 0 0 map1 3 rex\n"s};
+        CHECK_THROWS_AS(app::ReadInputLog(unsized_map), std::runtime_error);
+    }
+
+    SECTION("map ids and names with spaces survive the round trip") {
+        auto out = std::make_unique<std::stringstream>();
+        auto* text = out.get();
+        app::InputLogWriter writer{std::move(out), std::nullopt};
+        writer.RecordJoin(4, "big map 1"sv, " rex 2 "sv);
+        writer.RecordMove(4, 'U');
+        writer.Flush();
+
+        const auto log = app::ReadInputLog(*text);
+        REQUIRE(log.records.size() == 2);
+        CHECK(log.records[0].player_id == 4);
+        CHECK(log.records[0].map_id == "big map 1"s);
+        CHECK(log.records[0].dog_name == " rex 2 "s);
+        CHECK(log.records[1].move == 'U');
+    }
+
+    SECTION("state log records keep tokens and retirements, a torn last line is dropped") {
+        const auto token = app::Token::FromHex("0123456789abcdef0123456789abcdef"sv);
+        REQUIRE(token);
+        std::istringstream state_log{"seed -\nJ 0 3 4 map1 3 rex 0123456789abcdef0123456789abcdef\nR 5 3\nM 6 3 8"s};
+        const auto log = app::ReadInputLog(state_log);
+        REQUIRE(log.records.size() == 2);
+        CHECK(log.records[0].token == token);
+        CHECK(log.records[1].type == app::InputRecord::Type::RETIRE);
+        CHECK(log.records[1].player_id == 3);
+    }
+}
+
+TEST_CASE("Timer wheel fires entries in time order buckets", "[TimerWheel]") {
+    using Time = util::TimerWheel<int>::Time;
+    util::TimerWheel<int> wheel;
+    std::mt19937 rng{3};
+    std::uniform_int_distribution<int64_t> at(0, 5'000'000);
+
+    //Brute force reference: everything not fired yet
+    std::multimap<int64_t, int> pending;
+    for(int i = 0; i < 2000; ++i) {
+        const auto time = at(rng);
+        wheel.Schedule(Time{time}, i);
+        pending.emplace(time, i);
+    }
+    CHECK(wheel.Size() == 2000);
+
+    int64_t now = 0;
+    std::uniform_int_distribution<int64_t> step(1, 200'000);
+    while(!pending.empty()) {
+        now += step(rng);
+        std::vector<int> fired;
+        wheel.Advance(Time{now}, [&fired](int value) { fired.push_back(value); });
+
+        std::vector<int> expected;
+        for(auto it = pending.begin(); it != pending.end() && it->first <= now; it = pending.erase(it)) {
+            expected.push_back(it->second);
+        }
+        std::ranges::sort(fired);
+        std::ranges::sort(expected);
+        REQUIRE(fired == expected);
+        CHECK(wheel.Size() == pending.size());
+    }
+    CHECK(wheel.Empty());
+
+    SECTION("entries in the past fire on the next advance") {
+        wheel.Schedule(Time{now - 10}, 1);
+        wheel.Schedule(Time{now}, 2);
+        std::vector<int> fired;
+        wheel.Advance(Time{now}, [&fired](int value) { fired.push_back(value); });
+        std::ranges::sort(fired);
+        CHECK(fired == std::vector<int>{1, 2});
+    }
+}
+
+TEST_CASE("Idle dogs retire after the retirement time", "[PlayerSessionManager]") {
+    auto game = std::make_shared<model::Game>();
+    model::Map map{model::Map::Id{"map1"s}, "Map 1"s};
+    map.AddRoad({model::Road::HORIZONTAL, model::Point{0, 0}, 50});
+    map.AddLootInfo(boost::json::array{});
+    game->AddMap(std::move(map));
+    game->SetDogRetirementTime(model::TimeMs{60000});
+
+    app::PlayerSessionManager psm{game};
+    const auto idle = psm.CreatePlayer(model::Map::Id{"map1"s}, model::Dog::Tag{"idle"s});
+    const auto moving = psm.CreatePlayer(model::Map::Id{"map1"s}, model::Dog::Tag{"moving"s});
+    const auto idle_id = idle->GetId();
+    const auto idle_token = *psm.GetToken(idle);
+    moving->SetDirection(model::Direction::EAST);
+
+    CHECK(psm.AdvanceTime(model::TimeMs{59950}).empty());
+    const auto retired = psm.AdvanceTime(model::TimeMs{50});
+    REQUIRE(retired.size() == 1);
+    CHECK(retired[0].id == idle_id);
+    CHECK(*retired[0].name == "idle"s);
+    CHECK(retired[0].play_time == model::TimeMs{60000});
+
+    CHECK(psm.GetPlayerByToken(idle_token) == nullptr);
+    CHECK(psm.GetAllPlayers().size() == 1);
+    CHECK(psm.GetAllPlayersInSession(moving).size() == 1);
+    CHECK(moving->GetSession()->GetDogCount() == 1);
+
+    SECTION("a dog that stopped at the road end retires a retirement time after that tick") {
+        CHECK(psm.AdvanceTime(model::TimeMs{59000}).empty());
+        CHECK(psm.AdvanceTime(model::TimeMs{1000}).size() == 1);
+        CHECK(psm.GetAllPlayers().empty());
+    }
+}
+
+TEST_CASE("Dogs retired on one tick leave the gatherers in order", "[PlayerSessionManager]") {
+    auto game = std::make_shared<model::Game>();
+    model::Map map{model::Map::Id{"map1"s}, "Map 1"s};
+    map.AddRoad({model::Road::HORIZONTAL, model::Point{0, 0}, 1000});
+    map.AddLootInfo(boost::json::array{});
+    game->AddMap(std::move(map));
+    game->SetDogRetirementTime(model::TimeMs{1000});
+
+    app::PlayerSessionManager psm{game};
+    std::vector<model::Dog::Id> kept;
+    for(int i = 0; i < 50; ++i) {
+        const auto player = psm.CreatePlayer(model::Map::Id{"map1"s}, model::Dog::Tag{"dog"s});
+        //Every third dog keeps moving, the rest retire together
+        if(i % 3 == 0) {
+            player->SetDirection(model::Direction::EAST);
+            kept.push_back(player->GetDog()->GetId());
+        }
+    }
+    const auto session = psm.GetAllPlayers().begin()->second.GetSession();
+
+    CHECK(psm.AdvanceTime(model::TimeMs{1000}).size() == 50 - kept.size());
+    std::vector<model::Dog::Id> gatherers;
+    for(const auto dog : session->GetGatherers()) {
+        gatherers.push_back(dog->GetId());
+    }
+    CHECK(gatherers == kept);
+
+    //Positions stay right for the next removals
+    session->RemoveDog(kept[1]);
+    session->CompactGatherers();
+    REQUIRE(session->GetGatherers().size() == kept.size() - 1);
+    CHECK(session->GetGatherers()[1]->GetId() == kept[2]);
+}
+
+TEST_CASE("Spatial grid finds the same points as a full scan", "[SpatialGrid]") {
+    std::mt19937 rng{5};
+    //Clustered points and one far away, so coarsening kicks in
+    std::uniform_real_distribution<double> coord(0, 100);
+    std::vector<geom::Point2D> points;
+    for(int i = 0; i < 500; ++i) {
+        points.push_back({coord(rng), coord(rng)});
+    }
+    points.push_back({10000, -10000});
+
+    util::SpatialGrid grid{10.0};
+    grid.Build(points.size(), [&points](size_t idx) { return points[idx]; });
+    CHECK(grid.Size() == points.size());
+
+    std::uniform_real_distribution<double> center(-50, 150);
+    std::uniform_real_distribution<double> radius(0, 40);
+    for(int query = 0; query < 200; ++query) {
+        const geom::Point2D pos{center(rng), center(rng)};
+        const double r = radius(rng);
+
+        std::vector<size_t> found;
+        grid.ForEachInRadius(pos, r, [&found](size_t idx) { found.push_back(idx); });
+        std::ranges::sort(found);
+
+        std::vector<size_t> expected;
+        for(size_t idx = 0; idx < points.size(); ++idx) {
+            const double dx = points[idx].x - pos.x;
+            const double dy = points[idx].y - pos.y;
+            if(dx * dx + dy * dy <= r * r) {
+                expected.push_back(idx);
+            }
+        }
+        REQUIRE(found == expected);
+    }
+
+    SECTION("an empty grid finds nothing") {
+        grid.Build(0, [&points](size_t idx) { return points[idx]; });
+        size_t found = 0;
+        grid.ForEachInRadius({0, 0}, 1000, [&found](size_t) { ++found; });
+        CHECK(found == 0);
+    }
+}
+
+TEST_CASE("Session reports only what lies within the view radius", "[Session]") {
+    auto game = std::make_shared<model::Game>();
+    model::Map map{model::Map::Id{"map1"s}, "Map 1"s};
+    map.AddRoad({model::Road::HORIZONTAL, model::Point{0, 0}, 100});
+    map.AddLootInfo(boost::json::array{});
+    game->AddMap(std::move(map));
+
+    app::PlayerSessionManager psm{game};
+    const auto standing = psm.CreatePlayer(model::Map::Id{"map1"s}, model::Dog::Tag{"standing"s});
+    const auto running = psm.CreatePlayer(model::Map::Id{"map1"s}, model::Dog::Tag{"running"s});
+    running->SetDirection(model::Direction::EAST);
+    const auto session = standing->GetSession();
+
+    auto visible = session->FindVisible(*standing, 5.0);
+    CHECK(visible.players.size() == 2);
+
+    //Moving dogs invalidate the index
+    psm.AdvanceTime(model::TimeMs{20000});
+    REQUIRE(running->GetDog()->GetPos().x > 10.0);
+    visible = session->FindVisible(*standing, 5.0);
+    REQUIRE(visible.players.size() == 1);
+    CHECK(visible.players[0] == standing);
+
+    visible = session->FindVisible(*standing, 1000.0);
+    CHECK(visible.players.size() == 2);
+    CHECK(visible.players[0]->GetId() < visible.players[1]->GetId());
+
+    //The viewer sees itself whatever the radius
+    for (const double radius : {0.0, -1.0}) {
+        visible = session->FindVisible(*running, radius);
+        REQUIRE(visible.players.size() == 1);
+        CHECK(visible.players[0] == running);
+        CHECK(visible.loot.empty());
     }
+}
+
+TEST_CASE("Records writer batches, retries and drops what it cannot keep", "[RecordsWriter]") {
+    auto make_records = [](size_t count) {
+        std::vector<app::RetiredPlayer> records;
+        for(size_t i = 0; i < count; ++i) {
+            records.push_back({i, model::Dog::Tag{"dog"s + std::to_string(i)}, i, model::TimeMs{1000}});
+        }
+        return records;
+    };
+
+    app::RecordsWriter::Settings settings;
+    settings.max_batch = 10;
+    settings.flush_interval = model::TimeMs{10000};
+    settings.max_queued = 100;
+    settings.max_attempts = 3;
+    settings.retry_delay = model::TimeMs{1};
+
+    std::mutex mtx;
+    std::vector<size_t> batch_sizes;
+    std::vector<std::string> names;
+    int failures_left = 0;
+    auto sink = [&](std::span<const app::RetiredPlayer> batch) {
+        std::lock_guard lock{mtx};
+        if(failures_left > 0) {
+            --failures_left;
+            throw std::runtime_error("db is down");
+        }
+        batch_sizes.push_back(batch.size());
+        for(const auto& record : batch) {
+            names.push_back(*record.name);
+        }
+    };
+
+    SECTION("full batches go out in order, flush sends the rest") {
+        app::RecordsWriter writer{sink, settings};
+        CHECK(writer.Push(make_records(25)));
+        writer.Flush();
+
+        CHECK(batch_sizes == std::vector<size_t>{10, 10, 5});
+        REQUIRE(names.size() == 25);
+        CHECK(names.front() == "dog0"s);
+        CHECK(names.back() == "dog24"s);
+        CHECK(writer.GetStats().written == 25);
+    }
+
+    SECTION("a failing batch is retried") {
+        failures_left = 2;
+        app::RecordsWriter writer{sink, settings};
+        CHECK(writer.Push(make_records(3)));
+        writer.Flush();
+
+        CHECK(names.size() == 3);
+        CHECK(writer.GetStats().failed_attempts == 2);
+        CHECK(writer.GetStats().dropped == 0);
+    }
+
+    SECTION("a batch out of attempts is dropped") {
+        failures_left = 3;
+        app::RecordsWriter writer{sink, settings};
+        CHECK(writer.Push(make_records(3)));
+        writer.Flush();
+
+        CHECK(names.empty());
+        CHECK(writer.GetStats().dropped == 3);
+        CHECK(writer.GetStats().queue_full == 0);
+        CHECK(writer.GetStats().failed_attempts == 3);
+    }
+
+    SECTION("records beyond the queue limit are dropped, not waited for") {
+        //Holds the writer thread inside the sink while the queue fills up
+        std::unique_lock hold{mtx};
+        app::RecordsWriter writer{sink, settings};
+        CHECK(writer.Push(make_records(10)));
+        CHECK_FALSE(writer.Push(make_records(150)));
+        hold.unlock();
+        writer.Flush();
+
+        const auto stats = writer.GetStats();
+        CHECK(stats.written + stats.dropped == 160);
+        CHECK(stats.dropped >= 50);
+        CHECK(stats.queue_full == stats.dropped);
+        CHECK(names.size() == stats.written);
+    }
+
+    SECTION("queued records are written on destruction") {
+        {
+            app::RecordsWriter writer{sink, settings};
+            writer.Push(make_records(3));
+        }
+        CHECK(names.size() == 3);
+    }
+}
+
+TEST_CASE("Leaderboard serves the top from memory and deep pages from the loader", "[Leaderboard]") {
+    auto retired = [](std::string name, model::Score score, int64_t play_time_ms) {
+        return app::RetiredPlayer{0, model::Dog::Tag{std::move(name)}, score, model::TimeMs{play_time_ms}};
+    };
+    //Stands in for the database query: keyset after a record, then an offset
+    auto load_after = [](const std::vector<app::PlayerRecord>& stored, const app::PlayerRecord* after, size_t skip,
+                         size_t max_items) {
+        auto first = after ? std::ranges::upper_bound(stored, *after, app::RecordOrder{}) : stored.begin();
+        first += std::min<ptrdiff_t>(skip, stored.end() - first);
+        return std::vector(first, first + std::min<ptrdiff_t>(max_items, stored.end() - first));
+    };
+
+    SECTION("score desc, then play time, then name") {
+        app::Leaderboard leaderboard{10};
+        const std::vector players{
+            retired("b"s, 10, 500), retired("a"s, 10, 500), retired("c"s, 20, 900), retired("d"s, 10, 100)
+        };
+        leaderboard.Add(players);
+
+        const auto page = leaderboard.GetPage(0, 10);
+        REQUIRE(page.size() == 4);
+        CHECK(page[0].name == "c"s);
+        CHECK(page[1].name == "d"s);
+        CHECK(page[2].name == "a"s);
+        CHECK(page[3].name == "b"s);
+
+        CHECK(leaderboard.GetPage(1, 2) == std::vector(page.begin() + 1, page.begin() + 3));
+        CHECK(leaderboard.GetPage(10, 5).empty());
+    }
+
+    SECTION("records below a full cache come from the loader") {
+        //Stands in for the database: everything ever stored, in leaderboard order
+        std::vector<app::PlayerRecord> stored;
+        for(model::Score score = 100; score > 0; --score) {
+            stored.push_back({"p"s + std::to_string(score), score, model::TimeMs{1000}});
+        }
+        size_t loads = 0;
+        app::Leaderboard leaderboard{10, [&](const app::PlayerRecord* after, size_t skip, size_t max_items) {
+            ++loads;
+            return load_after(stored, after, skip, max_items);
+        }};
+        leaderboard.Warm({stored.begin(), stored.begin() + 10});
+
+        CHECK(leaderboard.GetPage(0, 10) == std::vector(stored.begin(), stored.begin() + 10));
+        CHECK(loads == 0);
+
+        //Straddles the cache end
+        CHECK(leaderboard.GetPage(5, 10) == std::vector(stored.begin() + 5, stored.begin() + 15));
+        CHECK(leaderboard.GetPage(50, 3) == std::vector(stored.begin() + 50, stored.begin() + 53));
+        CHECK(loads == 2);
+
+        //A new best pushes the 10th out of the cache
+        const std::vector best{retired("best"s, 1000, 1)};
+        leaderboard.Add(best);
+        const auto top = leaderboard.GetPage(0, 10);
+        CHECK(top.front().name == "best"s);
+        CHECK(top.back().name == "p92"s);
+        CHECK(leaderboard.GetCachedCount() == 10);
+    }
+
+    SECTION("pages across the cache end neither skip nor repeat records the store lacks") {
+        std::vector<app::PlayerRecord> stored;
+        for(model::Score score = 30; score > 0; --score) {
+            stored.push_back({"p"s + std::to_string(score), score, model::TimeMs{1000}});
+        }
+        app::Leaderboard leaderboard{10, [&](const app::PlayerRecord* after, size_t skip, size_t max_items) {
+            return load_after(stored, after, skip, max_items);
+        }};
+        leaderboard.Warm({stored.begin(), stored.begin() + 10});
+
+        //Retired a moment ago: cached, but the writer has not stored it yet, or dropped it
+        leaderboard.Add(std::vector{retired("new"s, 25, 1)});
+        std::vector<app::PlayerRecord> expected{stored.begin(), stored.begin() + 5};
+        expected.push_back({"new"s, 25, model::TimeMs{1}});
+        expected.insert(expected.end(), stored.begin() + 5, stored.begin() + 20);
+
+        const auto page = leaderboard.GetPage(0, 21);
+        CHECK(page == expected);
+        CHECK(leaderboard.GetPage(8, 4) == std::vector(expected.begin() + 8, expected.begin() + 12));
+        CHECK(leaderboard.GetPage(12, 3) == std::vector(expected.begin() + 12, expected.begin() + 15));
+    }
+
+    SECTION("a new last record replaces the old last one") {
+        app::Leaderboard leaderboard{3};
+        leaderboard.Add(std::vector{retired("a"s, 30, 1), retired("b"s, 20, 1), retired("c"s, 10, 1)});
+        leaderboard.Add(std::vector{retired("d"s, 15, 1)});
+        const auto page = leaderboard.GetPage(0, 10);
+        REQUIRE(page.size() == 3);
+        CHECK(page.back().name == "d"s);
+    }
+
+    SECTION("an empty store needs no queries") {
+        size_t loads = 0;
+        app::Leaderboard leaderboard{10, [&loads](const app::PlayerRecord*, size_t, size_t) {
+            ++loads;
+            return std::vector<app::PlayerRecord>{};
+        }};
+        leaderboard.Warm({});
+        leaderboard.Add(std::vector{retired("a"s, 1, 1)});
+        CHECK(leaderboard.GetPage(0, 100).size() == 1);
+        CHECK(loads == 0);
+    }
+}
 
-    SECTION("returning object") {
-        //...
+TEST_CASE("Live top keeps the best current scores", "[LiveTop]") {
+    app::LiveTop top{3};
+    const model::Dog::Tag name{"dog"s};
+    for(size_t id = 0; id < 5; ++id) {
+        top.Update(id, name, 0);
     }
+    REQUIRE(top.GetEntries().size() == 3);
+    CHECK(top.GetEntries()[0].player_id == 0);
+
+    top.Update(4, name, 10);
+    top.Update(3, name, 5);
+    top.Update(3, name, 20);
+    auto ids = [&top] {
+        std::vector<size_t> result;
+        for(const auto& entry : top.GetEntries()) {
+            result.push_back(entry.player_id);
+        }
+        return result;
+    };
+    CHECK(ids() == std::vector<size_t>{3, 4, 0});
+    CHECK(top.GetEntries()[0].score == 20);
+
+    CHECK(top.Remove(4));
+    CHECK_FALSE(top.Remove(4));
+    CHECK(ids() == std::vector<size_t>{3, 0});
+}
+
+TEST_CASE("Basic Gather test", "[LootGathering]") {
+    using model::Road;
+    using model::Point;
 
-    //etc...
+    model::Map map{model::Map::Id{"test"s}, "Test"s};
+    map.AddRoad({Road::HORIZONTAL, Point{0, 0}, 20});
+    map.AddOffice({model::Office::Id{"o0"s}, Point{10, 0}, model::Offset{0, 0}});
+    map.AddLootInfo(boost::json::array{
+        boost::json::object{{"value", 5}},
+        boost::json::object{{"value", 7}},
+    });
+    map.Compile();
+
+    gamedata::Settings settings;
+
+    auto run_session = [&](size_t bag_cap) {
+        settings.default_bag_capacity = bag_cap;
+        app::Session session{0, &map, settings};
+        session.AddLootItem(100, 0, {3.0, 0.0});
+        session.AddLootItem(101, 1, {5.0, 0.0});
+
+        auto dog = session.AddDog(0, model::Dog::Tag{"rex"s});
+        dog->SetMovement(model::Direction::EAST, 1.0);
+        session.AdvanceTime(model::TimeMs{12000});
+        return std::make_pair(dog->GetScore(), session.GetLootCount());
+    };
+
+    SECTION("collecting and returning objects") {
+        const auto [score, loot_left] = run_session(3);
+        CHECK(score == 12);
+        CHECK(loot_left == 0);
+    }
+
+    SECTION("full bag leaves the item on the road") {
+        const auto [score, loot_left] = run_session(1);
+        CHECK(score == 5);
+        CHECK(loot_left == 1);
+    }
 }
 
 ///Main Example
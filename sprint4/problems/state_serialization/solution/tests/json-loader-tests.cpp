@@ -0,0 +1,105 @@
+#include <boost/system/system_error.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "../src/json_loader.h"
+
+using namespace std::literals;
+
+namespace {
+//Pads a body past the stack buffer, so its document spills to the heap
+std::string Padding() {
+    return ", \"padding\": \""s + std::string(json_loader::REQUEST_BODY_BUFFER_SIZE * 2, 'x') + "\""s;
+}
+
+//One small map, game_params and map_params go in front of the rest of their object
+model::Game LoadConfig(std::string_view game_params, std::string_view map_params = {},
+                       std::string_view loot_types = R"([{"name": "key", "value": 10}])") {
+    const auto path = std::filesystem::temp_directory_path() / "json_loader_tests_config.json";
+    {
+        std::ofstream out{path, std::ios_base::trunc};
+        out << "{" << game_params << R"("maps": [{)" << map_params
+            << R"("id": "map1", "name": "Map 1", "lootTypes": )" << loot_types << ","
+            << R"("roads": [{"x0": 0, "y0": 0, "x1": 40}], "buildings": [], "offices": []}]})";
+    }
+    auto game = json_loader::LoadGame(path);
+    std::filesystem::remove(path);
+    return game;
+}
+} // namespace
+
+TEST_CASE("Config values out of range leave the game empty", "[LoadGame]") {
+    CHECK(LoadConfig(""sv).GetMaps().size() == 1);
+
+    CHECK(LoadConfig(R"("maxDogsPerSession": 2,)"sv).GetMaps().size() == 1);
+    CHECK(LoadConfig(R"("maxDogsPerSession": 0,)"sv).GetMaps().size() == 1);
+    CHECK(LoadConfig(R"("maxDogsPerSession": -1,)"sv).GetMaps().empty());
+
+    CHECK(LoadConfig(""sv, R"("viewRadius": 2.5,)"sv).GetMaps().size() == 1);
+    CHECK(LoadConfig(""sv, R"("viewRadius": 0,)"sv).GetMaps().empty());
+    CHECK(LoadConfig(""sv, R"("viewRadius": -1,)"sv).GetMaps().empty());
+
+    CHECK(LoadConfig(""sv, ""sv, R"([{"name": "key", "value": 0}])"sv).GetMaps().size() == 1);
+    CHECK(LoadConfig(""sv, ""sv, R"([{"name": "key"}])"sv).GetMaps().empty());
+    CHECK(LoadConfig(""sv, ""sv, R"([{"name": "key", "value": 10}, {"name": "gem", "value": -5}])"sv).GetMaps().empty());
+}
+
+TEST_CASE("Move bodies", "[RequestBody]") {
+    using json_loader::ParseMove;
+
+    CHECK(ParseMove(R"({"move": "L"})"sv) == 'L');
+    CHECK(ParseMove(R"({"move": ""})"sv) == char{});
+    CHECK(ParseMove("{\"move\": \"U\""s + Padding() + "}"s) == 'U');
+
+    CHECK_THROWS_AS(ParseMove(R"({"move": "L")"sv), boost::system::system_error);
+    CHECK_THROWS_AS(ParseMove(""sv), boost::system::system_error);
+    CHECK_THROWS(ParseMove(R"(["L"])"sv));
+    CHECK_THROWS_AS(ParseMove(R"({"mvoe": "L"})"sv), std::invalid_argument);
+    CHECK_THROWS(ParseMove(R"({"move": 1})"sv));
+}
+
+TEST_CASE("Tick bodies", "[RequestBody]") {
+    using json_loader::ParseTick;
+
+    CHECK(ParseTick(R"({"timeDelta": 100})"sv) == model::TimeMs{100});
+    CHECK(ParseTick("{\"timeDelta\": 7"s + Padding() + "}"s) == model::TimeMs{7});
+
+    CHECK_THROWS_AS(ParseTick(R"({"timeDelta": 0})"sv), std::invalid_argument);
+    CHECK_THROWS_AS(ParseTick(R"({"timeDelta": })"sv), boost::system::system_error);
+    CHECK_THROWS(ParseTick(R"(100)"sv));
+    CHECK_THROWS(ParseTick(R"({})"sv));
+    CHECK_THROWS(ParseTick(R"({"timeDelta": "100"})"sv));
+    CHECK_THROWS(ParseTick(R"({"timeDelta": 1.5})"sv));
+}
+
+TEST_CASE("Join bodies", "[RequestBody]") {
+    using json_loader::ParseJoin;
+
+    const auto join = ParseJoin(R"({"userName": "Scooby \"Doo\"", "mapId": "map1"})"sv);
+    REQUIRE(join);
+    CHECK(join->map_id == "map1"s);
+    CHECK(join->user_name == "Scooby \"Doo\""s);
+
+    const std::string long_name(json_loader::REQUEST_BODY_BUFFER_SIZE * 2, 'n');
+    const auto big = ParseJoin(R"({"mapId": "map1", "userName": ")"s + long_name + "\"}"s);
+    REQUIRE(big);
+    CHECK(big->user_name == long_name);
+
+    //The handler turns an empty name into its own error
+    const auto no_name = ParseJoin(R"({"mapId": "map1", "userName": ""})"sv);
+    REQUIRE(no_name);
+    CHECK(no_name->user_name.empty());
+
+    CHECK_FALSE(ParseJoin(R"({"userName": "rex"})"sv));
+    CHECK_FALSE(ParseJoin(R"({"mapId": "map1"})"sv));
+    CHECK_FALSE(ParseJoin(R"({"mapId": 1, "userName": "rex"})"sv));
+    CHECK_FALSE(ParseJoin(R"({"mapId": "map1", "userName": null})"sv));
+
+    //Not an api error, as before
+    CHECK_THROWS_AS(ParseJoin(R"({"mapId": "map1", "userName": "rex")"sv), boost::system::system_error);
+    CHECK_THROWS(ParseJoin(R"("map1")"sv));
+}
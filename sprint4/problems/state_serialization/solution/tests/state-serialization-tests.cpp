@@ -1,11 +1,16 @@
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
 #include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
 #include <sstream>
 
 #include "../src/model.h"
 #include "../src/json_loader.h"
 #include "../src/state_serialization.h"
+#include "../src/work_stealing_pool.h"
 
 using namespace model;
 using namespace std::literals;
@@ -149,4 +154,238 @@ SCENARIO_METHOD(Fixture, "Psm serialization") {
             }
         }
     }
-}
\ No newline at end of file
+}
+
+SCENARIO("Binary snapshot") {
+    auto game = std::make_shared<model::Game>(json_loader::LoadGame(GAME_CONFIG));
+    GIVEN("a psm with a moving dog") {
+        app::PlayerSessionManager psm(game);
+        const auto pluto = psm.CreatePlayer(Map::Id{"map1"s}, Dog::Tag{"pluto"s});
+        psm.CreatePlayer(Map::Id{"map1"s}, Dog::Tag{"mercury"s});
+        pluto->SetDirection(Direction::EAST);
+        psm.AdvanceTime(TimeMs{1500});
+
+        WHEN("psm is written as a snapshot") {
+            const bool compress = GENERATE(true, false);
+            std::stringstream strm;
+            //Small blocks, so the payload spans several of them
+            serialization::WriteSnapshot(strm, serialization::PsmRepr{psm}, {.compress = compress, .block_size = 64});
+
+            THEN("it reads back to the same state") {
+                CHECK(serialization::IsBinarySnapshot(strm));
+                const auto restored = serialization::ReadSnapshot(strm).Restore(game);
+                REQUIRE(restored.GetAllPlayers().size() == 2u);
+
+                for(const auto& [id, player] : psm.GetAllPlayers()) {
+                    const auto restored_player = restored.GetPlayerByToken(*psm.GetToken(id));
+                    REQUIRE(restored_player != nullptr);
+                    CHECK(restored_player->GetId() == id);
+
+                    const auto dog = player.GetDog();
+                    const auto restored_dog = restored_player->GetDog();
+                    CHECK(dog->GetTag() == restored_dog->GetTag());
+                    CHECK(dog->GetPos() == restored_dog->GetPos());
+                    CHECK(dog->GetSpeed() == restored_dog->GetSpeed());
+                    CHECK(dog->GetDirection() == restored_dog->GetDirection());
+                    CHECK(dog->GetJoinTime() == restored_dog->GetJoinTime());
+                    CHECK(dog->GetIdleSince() == restored_dog->GetIdleSince());
+                    CHECK(player.GetSession()->GetTime() == restored_player->GetSession()->GetTime());
+                }
+            }
+
+            THEN("decoding it on a pool gives the same state") {
+                util::WorkStealingPool pool{3};
+                const auto bytes = strm.str();
+                const auto restored = serialization::ReadSnapshot(std::span{bytes.data(), bytes.size()}, &pool)
+                                          .Restore(game, &pool);
+                REQUIRE(restored.GetAllPlayers().size() == 2u);
+
+                for(const auto& [id, player] : psm.GetAllPlayers()) {
+                    const auto restored_player = restored.GetPlayerByToken(*psm.GetToken(id));
+                    REQUIRE(restored_player != nullptr);
+                    CHECK(restored_player->GetId() == id);
+                    CHECK(player.GetDog()->GetPos() == restored_player->GetDog()->GetPos());
+                }
+                CHECK(restored.GetLiveTop(0).size() == 2u);
+            }
+
+            THEN("a damaged snapshot is rejected") {
+                auto bytes = strm.str();
+                bytes[bytes.size() / 2] ^= 0x5a;
+                std::stringstream damaged{bytes};
+                CHECK_THROWS_AS(serialization::ReadSnapshot(damaged), std::runtime_error);
+
+                std::stringstream truncated{bytes.substr(0, bytes.size() - 1)};
+                CHECK_THROWS_AS(serialization::ReadSnapshot(truncated), std::runtime_error);
+            }
+        }
+
+        WHEN("a text archive from an older server is restored") {
+            const auto dir = std::filesystem::temp_directory_path() / "state_serialization_tests";
+            std::filesystem::create_directories(dir);
+            {
+                std::ofstream file{dir / "state"};
+                OutputArchive text_archive{file};
+                text_archive << serialization::PsmRepr{psm};
+            }
+            serialization::StateSerializer serializer{dir / "state", false, 0};
+
+            THEN("it loads and the next save is binary") {
+                const auto restored = serializer.Restore(game);
+                CHECK(restored.GetAllPlayers().size() == 2u);
+
+                serializer.SaveGameState(restored);
+                std::ifstream file{dir / "state", std::ios_base::binary};
+                CHECK(serialization::IsBinarySnapshot(file));
+                CHECK(serializer.Restore(game).GetAllPlayers().size() == 2u);
+            }
+            std::filesystem::remove_all(dir);
+        }
+    }
+}
+
+SCENARIO("Background state saves") {
+    auto game = std::make_shared<model::Game>(json_loader::LoadGame(GAME_CONFIG));
+    const auto dir = std::filesystem::temp_directory_path() / "state_serialization_bg_tests";
+    std::filesystem::remove_all(dir);
+
+    GIVEN("a serializer saving every 100 ms of game time") {
+        app::PlayerSessionManager psm(game);
+        psm.CreatePlayer(Map::Id{"map1"s}, Dog::Tag{"pluto"s});
+        serialization::StateSerializer serializer{dir / "state", true, 100};
+
+        WHEN("less than a period passes") {
+            serializer.OnTick(TimeMs{60}, {}, psm);
+            serializer.Flush();
+
+            THEN("nothing is saved") {
+                CHECK_FALSE(std::filesystem::exists(dir / "state"));
+                CHECK(serializer.GetStats().saves == 0u);
+            }
+        }
+
+        WHEN("a period passes") {
+            serializer.OnTick(TimeMs{60}, {}, psm);
+            serializer.OnTick(TimeMs{60}, {}, psm);
+            psm.CreatePlayer(Map::Id{"map1"s}, Dog::Tag{"mercury"s});
+            serializer.Flush();
+
+            THEN("the state captured on that tick is on disk") {
+                CHECK(serializer.GetStats().saves == 1u);
+                CHECK(serializer.Restore(game).GetAllPlayers().size() == 1u);
+            }
+
+            THEN("a synchronous save replaces it") {
+                serializer.SaveGameState(psm);
+                CHECK(serializer.Restore(game).GetAllPlayers().size() == 2u);
+            }
+        }
+    }
+    std::filesystem::remove_all(dir);
+}
+
+SCENARIO("State log between saves") {
+    auto game = std::make_shared<model::Game>(json_loader::LoadGame(GAME_CONFIG));
+    game->SetRandomSeed(7u);
+    game->SetDogRetirementTime(TimeMs{1000});
+    const auto dir = std::filesystem::temp_directory_path() / "state_serialization_log_tests";
+    std::filesystem::remove_all(dir);
+
+    GIVEN("a game logged through a serializer, with a save in the middle") {
+        app::PlayerSessionManager psm(game);
+        auto serializer = std::make_unique<serialization::StateSerializer>(dir / "state", false, 0,
+                                                                           serialization::SnapshotOptions{}, true);
+        //What GameInterface does for each input
+        const auto join = [&](std::string name) {
+            auto player = psm.CreatePlayer(Map::Id{"map1"s}, Dog::Tag{std::move(name)});
+            serializer->OnJoin(player, *psm.GetToken(player));
+            return player;
+        };
+        const auto move = [&](app::ConstPlayerPtr player, char move_command) {
+            player->SetDirection(static_cast<Direction>(move_command));
+            serializer->OnMove(player, move_command);
+        };
+        const auto tick = [&](TimeMs delta_t) {
+            const auto retired = psm.AdvanceTime(delta_t);
+            serializer->OnTick(delta_t, retired, psm);
+            return retired.size();
+        };
+
+        const auto pluto = join("pluto"s);
+        move(pluto, 'R');
+        tick(TimeMs{100});
+        serializer->SaveGameState(psm);
+
+        const auto mercury = join("mercury"s);
+        move(pluto, 'L');
+        tick(TimeMs{600});
+        move(pluto, 'R');
+        size_t retired = tick(TimeMs{600});
+        retired += tick(TimeMs{600});
+        REQUIRE(retired > 0u);
+        const auto venus = join("venus"s);
+        move(venus, 'U');
+        tick(TimeMs{50});
+
+        const auto check_same_state = [&](const app::PlayerSessionManager& restored) {
+            REQUIRE(restored.GetAllPlayers().size() == psm.GetAllPlayers().size());
+            for(const auto& [id, player] : psm.GetAllPlayers()) {
+                const auto restored_it = restored.GetAllPlayers().find(id);
+                REQUIRE(restored_it != restored.GetAllPlayers().end());
+                const auto& restored_player = restored_it->second;
+                CHECK(*restored.GetToken(id) == *psm.GetToken(id));
+                CHECK(restored_player.GetDog()->GetTag() == player.GetDog()->GetTag());
+                CHECK(restored_player.GetDog()->GetPos() == player.GetDog()->GetPos());
+                CHECK(restored_player.GetDog()->GetSpeed() == player.GetDog()->GetSpeed());
+                CHECK(restored_player.GetDog()->GetScore() == player.GetDog()->GetScore());
+
+                const auto& loot = app::PlayerSessionManager::GetSessionLootList(&player);
+                const auto& restored_loot = app::PlayerSessionManager::GetSessionLootList(&restored_player);
+                CHECK(std::equal(loot.begin(), loot.end(), restored_loot.begin(), restored_loot.end(),
+                                 [](const LootItem& lhs, const LootItem& rhs) {
+                                     return lhs.GetId() == rhs.GetId() && lhs.GetPos() == rhs.GetPos();
+                                 }));
+            }
+            CHECK(restored.GetIdCounters().next_player == psm.GetIdCounters().next_player);
+            CHECK(restored.GetIdCounters().next_dog == psm.GetIdCounters().next_dog);
+        };
+        const auto count_segments = [&] {
+            return std::count_if(std::filesystem::directory_iterator{dir}, std::filesystem::directory_iterator{},
+                                 [](const auto& entry) {
+                                     return entry.path().filename().string().starts_with("state.log.");
+                                 });
+        };
+
+        WHEN("the server stops without another save") {
+            serializer.reset();
+            serialization::StateSerializer restarted{dir / "state", false, 0, serialization::SnapshotOptions{}, true};
+            const auto restored = restarted.Restore(game);
+
+            THEN("replaying the log after the save ends where the game did") {
+                check_same_state(restored);
+            }
+
+            THEN("the next save makes the replayed segments unnecessary") {
+                CHECK(count_segments() == 1);
+                restarted.SaveGameState(restored);
+                CHECK(count_segments() == 0);
+                serialization::StateSerializer again{dir / "state", false, 0};
+                check_same_state(again.Restore(game));
+            }
+        }
+
+        WHEN("a crash cut the last record short") {
+            serializer.reset();
+            {
+                std::ofstream segment{dir / "state.log.1", std::ios_base::app};
+                segment << "M 0 " << venus->GetId() << " 68";
+            }
+            serialization::StateSerializer restarted{dir / "state", false, 0};
+
+            THEN("it is ignored") {
+                check_same_state(restarted.Restore(game));
+            }
+        }
+    }
+    std::filesystem::remove_all(dir);
+}